@@ -0,0 +1,37 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <ostream>
+
+enum AllocPhase {
+  PHASE_OTHER,
+  PHASE_READ,
+  PHASE_LEX,
+  PHASE_INCLUDE,
+  PHASE_PARSE,
+  PHASE_REPORT,
+  PHASE_COUNT
+};
+
+// With COMPILER_ALLOC_STATS defined, global operator new/delete are replaced
+// to count allocations per phase, and counting starts once
+// enableAllocationTracking() is called. The replacement puts a header on
+// every block, so only the command-line compiler is built with it; a
+// program embedding the compiler keeps its own allocator, and these calls
+// do nothing.
+void enableAllocationTracking();
+void printAllocationStats(std::ostream &os);
+
+// Attributes allocations made by this thread to a phase until destroyed.
+class PhaseScope {
+public:
+  explicit PhaseScope(AllocPhase phase);
+  ~PhaseScope();
+  PhaseScope(const PhaseScope &) = delete;
+  PhaseScope &operator=(const PhaseScope &) = delete;
+
+private:
+  AllocPhase previous;
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef AST_H
+#define AST_H
+
+#include "Token.h"
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+enum TypeKind {
+  TYPE_VOID,
+  TYPE_INT,
+  TYPE_FLOAT,
+  TYPE_CHAR,
+  TYPE_STRING,
+  TYPE_STRUCT
+};
+
+struct TypeRef {
+  TypeKind kind = TYPE_VOID;
+  // Interned struct name for TYPE_STRUCT.
+  uint32_t structName = 0;
+  bool pointer = false;
+  // SIMw or SIMwf: 32 bits in a struct layout. The bytecode treats them as
+  // Imw and IMwf.
+  bool narrow = false;
+};
+
+enum ExprKind {
+  EXPR_INT,
+  EXPR_FLOAT,
+  EXPR_STRING,
+  EXPR_VARIABLE,
+  EXPR_FIELD,
+  EXPR_INDEX,
+  EXPR_CALL,
+  EXPR_BINARY,
+  EXPR_ASSIGN
+};
+
+// One node type for every expression. Operands are in `children`:
+// field [base], index [base, index], call [args...], binary [lhs, rhs] and
+// assign [target, value].
+struct Expr {
+  ExprKind kind;
+  // Operator of a binary node, contents of a string literal.
+  std::string text;
+  // Variable, field or function name.
+  uint32_t symbol = 0;
+  int64_t intValue = 0;
+  double floatValue = 0;
+  std::vector<std::unique_ptr<Expr>> children;
+  uint32_t offset = 0;
+  uint16_t file = 0;
+};
+
+struct VarDecl {
+  TypeRef type;
+  uint32_t name = 0;
+  // 0 for scalars.
+  uint32_t arraySize = 0;
+  std::unique_ptr<Expr> init;
+  uint32_t offset = 0;
+  uint16_t file = 0;
+};
+
+enum StmtKind {
+  STMT_EXPR,
+  STMT_BLOCK,
+  STMT_VAR,
+  STMT_IF,
+  STMT_WHILE,
+  STMT_FOR,
+  STMT_RETURN,
+  STMT_BREAK
+};
+
+// if: body [then, else?]; while: body [loop]; for: body [init, loop] with
+// `expr` the condition and `step` the increment; return: expr may be null.
+struct Stmt {
+  StmtKind kind;
+  std::unique_ptr<Expr> expr;
+  std::unique_ptr<Expr> step;
+  std::vector<std::unique_ptr<Stmt>> body;
+  VarDecl var;
+  uint32_t offset = 0;
+  uint16_t file = 0;
+};
+
+struct StructDecl {
+  uint32_t name = 0;
+  std::vector<VarDecl> fields;
+  uint32_t offset = 0;
+  uint16_t file = 0;
+};
+
+struct FunctionDecl {
+  TypeRef returnType;
+  uint32_t name = 0;
+  std::vector<VarDecl> params;
+  std::unique_ptr<Stmt> body;
+  uint32_t offset = 0;
+  uint16_t file = 0;
+};
+
+struct Program {
+  std::vector<StructDecl> structs;
+  std::vector<VarDecl> globals;
+  std::vector<FunctionDecl> functions;
+};
+
+// Thrown for programs the backend cannot handle. Carries the position of the
+// offending token so the caller can turn it into line:column.
+class CompileError : public std::runtime_error {
+public:
+  CompileError(const std::string &message, uint32_t offset, uint16_t file)
+      : std::runtime_error(message), offset(offset), file(file) {}
+  uint32_t offset;
+  uint16_t file;
+};
+
+// Builds the tree from tokens the parser has already accepted. It follows the
+// same grammar but reports nothing: the first surprise is a CompileError.
+class AstBuilder {
+public:
+  explicit AstBuilder(TokenSpan tokens);
+  Program build();
+
+private:
+  std::vector<const Token *> tokens;
+  size_t pos = 0;
+  Token eof;
+  // Every later pass walks expressions recursively. The parser bounds
+  // nesting, but a flat chain like 1 + 1 + ... still becomes one level per
+  // operator, so the builder bounds the height of the tree as well. Lowering
+  // an assignment takes about 1.8 KB of stack per level under AddressSanitizer
+  // and 1.2 KB in an unoptimized build, so this leaves room to spare on an
+  // 8 MB stack in both.
+  static const unsigned int MAX_HEIGHT = 1000;
+  unsigned int height = 0;
+
+  const Token &current() const;
+  const Token &peek(size_t n = 1) const;
+  void next();
+  void expect(TokenType type, const char *what);
+  [[noreturn]] void fail(const std::string &message) const;
+  void deepen();
+
+  bool atType() const;
+  TypeRef parseType();
+  void parseStruct(Program &program, const Token &name);
+  VarDecl parseVarRest(TypeRef type);
+  FunctionDecl parseFunction(TypeRef type, uint32_t name);
+  std::unique_ptr<Stmt> parseBlock();
+  std::unique_ptr<Stmt> parseStatement();
+  std::unique_ptr<Stmt> parseVarStatement();
+
+  std::unique_ptr<Expr> parseExpression();
+  std::unique_ptr<Expr> parseSimpleExpression();
+  std::unique_ptr<Expr> parseAdditive();
+  std::unique_ptr<Expr> parseTerm();
+  std::unique_ptr<Expr> parseFactor();
+  std::unique_ptr<Expr> parseAccess();
+  std::unique_ptr<Expr> parseConstant(bool negate);
+  std::unique_ptr<Expr> node(ExprKind kind) const;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "Ast.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// X(name): one entry per opcode, so the enum and the VM's dispatch table
+// cannot drift apart.
+#define OPCODES(X)                                                             \
+  X(MOVE)    /* R[a] = R[b] */                                                 \
+  X(LOADK)   /* R[a] = K[bx] */                                                \
+  X(GETG)    /* R[a] = G[bx] */                                                \
+  X(SETG)    /* G[bx] = R[a] */                                                \
+  X(ADDI)    /* R[a] = R[b] + R[c], integers */                                \
+  X(SUBI)                                                                      \
+  X(MULI)                                                                      \
+  X(DIVI)                                                                      \
+  X(ADDF)    /* R[a] = R[b] + R[c], floats */                                  \
+  X(SUBF)                                                                      \
+  X(MULF)                                                                      \
+  X(DIVF)                                                                      \
+  X(LTI)     /* R[a] = R[b] < R[c] */                                          \
+  X(LEI)                                                                       \
+  X(EQI)                                                                       \
+  X(NEI)                                                                       \
+  X(LTF)                                                                       \
+  X(LEF)                                                                       \
+  X(EQF)                                                                       \
+  X(NEF)                                                                       \
+  X(ITOF)    /* R[a] = (float)R[b] */                                          \
+  X(FTOI)    /* R[a] = (int)R[b] */                                            \
+  X(JMP)     /* pc = bx */                                                     \
+  X(JMPF)    /* if R[a] == 0: pc = bx */                                       \
+  X(JMPT)    /* if R[a] != 0: pc = bx */                                       \
+  X(NEW)     /* R[a] = new object of bx slots */                               \
+  X(GETX)    /* R[a] = R[b][R[c]], bounds checked */                           \
+  X(SETX)    /* R[a][R[b]] = R[c], bounds checked */                           \
+  X(GETF)    /* R[a] = R[b][c] */                                              \
+  X(SETF)    /* R[a][b] = R[c] */                                              \
+  X(CALL)    /* R[a] = F[bx](R[a], R[a+1], ...) */                             \
+  X(RET)     /* return R[a] */                                                 \
+  X(RETV)    /* return 0 */
+
+enum Opcode : uint8_t {
+#define OPCODE_ENUM(name) OP_##name,
+  OPCODES(OPCODE_ENUM)
+#undef OPCODE_ENUM
+      OP_COUNT
+};
+
+// Four bytes: an opcode and three register operands. b and c together form
+// the 16-bit bx operand of constant, global, jump and call instructions.
+struct Instruction {
+  uint8_t op;
+  uint8_t a;
+  uint8_t b;
+  uint8_t c;
+  uint16_t bx() const { return static_cast<uint16_t>(b | (c << 8)); }
+};
+
+// Registers are untyped; every instruction knows which member it reads.
+// Objects and arrays are heap indexes stored in `i`, 0 being null.
+union Value {
+  int64_t i;
+  double f;
+};
+
+struct Function {
+  uint32_t name = 0;
+  uint8_t params = 0;
+  // Registers the frame needs, parameters included.
+  uint16_t registers = 0;
+  // Whether the value RET hands back is an IMwf.
+  bool floatResult = false;
+  // Which parameters are IMwf; native calls pass those in SSE registers.
+  std::vector<bool> floatParams;
+  std::vector<Instruction> code;
+};
+
+struct Bytecode {
+  std::vector<Function> functions;
+  std::vector<Value> constants;
+  // Whether each constant is an IMwf, for listings.
+  std::vector<bool> floatConstants;
+  // String literals are copied to the heap before the program starts, and
+  // their constant is set to the resulting reference.
+  struct StringConstant {
+    uint16_t constant;
+    std::string text;
+  };
+  std::vector<StringConstant> strings;
+  uint16_t globals = 0;
+  // Allocates global arrays and structs; runs before main.
+  int init = -1;
+  int main = -1;
+};
+
+// Lowers an AST to bytecode. Types are resolved here: Imw, SIMw and Chj are
+// integers, IMwf and SIMwf floats, and Series, arrays and Loli values are
+// references to heap objects.
+class BytecodeCompiler {
+public:
+  Bytecode compile(const Program &program);
+
+private:
+  enum ValueType { VAL_VOID, VAL_INT, VAL_FLOAT, VAL_REF };
+
+  // Static type of a variable or an expression result.
+  struct Shape {
+    ValueType type = VAL_VOID;
+    // Element type of arrays and strings.
+    ValueType element = VAL_VOID;
+    // Struct name of objects.
+    uint32_t structName = 0;
+  };
+
+  struct Local {
+    uint32_t name;
+    uint8_t reg;
+    Shape shape;
+  };
+
+  struct Global {
+    uint16_t slot;
+    Shape shape;
+  };
+
+  struct FunctionInfo {
+    uint16_t index;
+    const FunctionDecl *decl;
+  };
+
+  struct StructInfo {
+    const StructDecl *decl;
+    std::unordered_map<uint32_t, uint8_t> fields;
+  };
+
+  Bytecode out;
+  std::unordered_map<uint32_t, FunctionInfo> functions;
+  std::unordered_map<uint32_t, StructInfo> structs;
+  std::unordered_map<uint32_t, Global> globals;
+  std::unordered_map<int64_t, uint16_t> intConstants;
+  std::unordered_map<uint64_t, uint16_t> floatConstants;
+
+  Function *function = nullptr;
+  const FunctionDecl *decl = nullptr;
+  std::vector<Local> locals;
+  // Depth of nested struct allocation, to stop structs that contain
+  // themselves.
+  unsigned int nesting = 0;
+  // First free register; everything above it is a temporary.
+  unsigned int top = 0;
+  // Jumps to patch at the end of every enclosing loop.
+  std::vector<std::vector<size_t>> breaks;
+
+  [[noreturn]] void fail(const std::string &message, uint32_t offset,
+                         uint16_t file) const;
+  Shape shapeOf(const TypeRef &type, uint32_t arraySize, uint32_t offset,
+                uint16_t file) const;
+  const StructInfo &structInfo(uint32_t name, uint32_t offset,
+                               uint16_t file) const;
+
+  uint8_t reserve(uint32_t offset, uint16_t file);
+  static const uint8_t NO_REG = 255;
+
+  size_t emit(Opcode op, unsigned int a, unsigned int b = 0,
+              unsigned int c = 0);
+  size_t emitBx(Opcode op, unsigned int a, unsigned int bx);
+  void patch(size_t at, size_t target);
+  uint16_t intConstant(int64_t value);
+  uint16_t floatConstant(double value);
+  uint16_t addConstant(Value value, bool isFloat = false);
+
+  void compileFunction(const FunctionDecl &decl, uint16_t index);
+  void compileInit(const Program &program);
+  void allocate(const Shape &shape, uint32_t arraySize, uint8_t reg,
+                uint32_t offset, uint16_t file);
+  void declareLocal(const VarDecl &var);
+  void compileStatement(const Stmt &stmt);
+  // Emits jumps, added to `jumps`, that are taken when the condition's truth
+  // equals `jumpIf`; && and || short-circuit.
+  void compileCondition(const Expr &expr, bool jumpIf,
+                        std::vector<size_t> &jumps);
+
+  Shape compileExpr(const Expr &expr, uint8_t target);
+  // Like compileExpr, but a plain local is returned in place instead of being
+  // copied; `reg` receives the register that holds the value.
+  Shape compileOperand(const Expr &expr, uint8_t &reg);
+  Shape compileAssign(const Expr &expr, uint8_t target);
+  Shape compileBinary(const Expr &expr, uint8_t target);
+  Shape compileCall(const Expr &expr, uint8_t target);
+  // Converts between integer and float; returns the register holding the
+  // result, which is `reg` itself only when inPlace is set.
+  uint8_t coerce(Shape &shape, ValueType to, uint8_t reg, bool inPlace,
+                 const Expr &at);
+  const Local *findLocal(uint32_t name) const;
+};
+
+#endif
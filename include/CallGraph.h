@@ -0,0 +1,75 @@
+#ifndef CALL_GRAPH_H
+#define CALL_GRAPH_H
+
+#include "Ast.h"
+#include "SourceMap.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+// Which functions call which, from the call expressions in each body.
+// Functions are numbered by their index in Program::functions.
+class CallGraph {
+public:
+  explicit CallGraph(const Program &program);
+
+  // Each function a body calls, once.
+  const std::vector<uint32_t> &callees(size_t function) const;
+  // Everything main can reach. Without a main every function counts as
+  // reachable, since nothing says where the program starts.
+  std::vector<bool> reachable() const;
+
+private:
+  std::vector<std::vector<uint32_t>> edges;
+  // Function index by name.
+  std::unordered_map<uint32_t, uint32_t> index;
+  size_t entry;
+
+  void addCalls(const Expr &expr, std::vector<uint32_t> &calls) const;
+  void addCalls(const Stmt &stmt, std::vector<uint32_t> &calls) const;
+};
+
+// What was dropped from one source file.
+struct DeadCodeFile {
+  uint16_t file = 0;
+  // Declared in this file.
+  size_t functions = 0;
+  size_t structs = 0;
+  // Names of those removed.
+  std::vector<uint32_t> deadFunctions;
+  std::vector<uint32_t> deadStructs;
+};
+
+struct DeadCodeStats {
+  size_t functions = 0;
+  size_t structs = 0;
+  // By file ID, for every file that declares a function or struct.
+  std::vector<DeadCodeFile> files;
+};
+
+// Removes the functions main cannot reach, and the structs that no kept
+// function, global or kept struct mentions. An included file usually
+// brings many functions of which a unit calls a few, so this runs before
+// everything else in the backend.
+class DeadCodeEliminator {
+public:
+  DeadCodeStats eliminate(Program &program);
+
+private:
+  std::vector<bool> liveStructs;
+  // Struct index by name.
+  std::unordered_map<uint32_t, uint32_t> index;
+  // Live structs whose fields are still to be marked.
+  std::vector<uint32_t> pending;
+
+  void markType(const TypeRef &type);
+  void markStmt(const Stmt &stmt);
+};
+
+// The totals, then a line for each file that lost something.
+void printDeadCode(const DeadCodeStats &stats, const SourceMap &sources,
+                   std::ostream &os);
+
+#endif
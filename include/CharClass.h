@@ -0,0 +1,55 @@
+#ifndef CHAR_CLASS_H
+#define CHAR_CLASS_H
+
+#include <cstdint>
+
+// Byte classes for the lexer, one table lookup each. Unlike <cctype> these
+// take any char, including the bytes of UTF-8 sequences, and do not depend
+// on the locale. Bytes from 0x80 up are in no class.
+enum CharClass : uint8_t {
+  CHAR_SPACE = 1,
+  CHAR_DIGIT = 2,
+  CHAR_ALPHA = 4,
+  CHAR_UNDERSCORE = 8
+};
+
+struct CharTable {
+  uint8_t classes[256];
+};
+
+constexpr CharTable makeCharTable() {
+  CharTable table{};
+  for (int c = 0; c < 256; c++) {
+    uint8_t bits = 0;
+    if (c == ' ' || (c >= '\t' && c <= '\r'))
+      bits |= CHAR_SPACE;
+    if (c >= '0' && c <= '9')
+      bits |= CHAR_DIGIT;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+      bits |= CHAR_ALPHA;
+    if (c == '_')
+      bits |= CHAR_UNDERSCORE;
+    table.classes[c] = bits;
+  }
+  return table;
+}
+
+inline constexpr CharTable CHAR_TABLE = makeCharTable();
+
+constexpr bool inClass(char c, uint8_t classes) {
+  return (CHAR_TABLE.classes[static_cast<unsigned char>(c)] & classes) != 0;
+}
+
+constexpr bool isSpaceChar(char c) { return inClass(c, CHAR_SPACE); }
+constexpr bool isDigitChar(char c) { return inClass(c, CHAR_DIGIT); }
+constexpr bool isIdentStart(char c) {
+  return inClass(c, CHAR_ALPHA | CHAR_UNDERSCORE);
+}
+constexpr bool isIdentChar(char c) {
+  return inClass(c, CHAR_ALPHA | CHAR_DIGIT | CHAR_UNDERSCORE);
+}
+constexpr bool isAsciiChar(char c) {
+  return static_cast<unsigned char>(c) < 0x80;
+}
+
+#endif
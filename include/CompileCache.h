@@ -0,0 +1,33 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Directory of finished compile results keyed by a content hash. Entries are
+// written to a temporary file and renamed into place, so concurrent readers
+// and writers only ever see complete entries; the process ID in a temporary's
+// name lets a later run remove the ones a crashed writer left behind. Reads
+// refresh an entry's modification time, which the size-bounded eviction uses
+// as its LRU order.
+class CompileCache {
+public:
+  CompileCache(const std::string &directory, uintmax_t maxBytes);
+
+  static uint64_t hash(const std::string &data, uint64_t seed = 0);
+  static uint64_t buildHash(const std::string &version);
+
+  bool load(uint64_t key, std::string &output, bool &passed);
+  void store(uint64_t key, const std::string &output, bool passed);
+
+private:
+  std::filesystem::path directory;
+  uintmax_t maxBytes;
+
+  std::filesystem::path entryPath(uint64_t key) const;
+  void removeStaleTemporaries();
+  void evict();
+};
+
+#endif
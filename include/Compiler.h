@@ -2,18 +2,88 @@
 #include "lexer.h"
 #include "parser.h"
 #include "helpers.h"
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+// Part of every compile cache key; bump it when the output format changes.
+#define COMPILER_VERSION "1.1"
+
+enum ReportFormat { FORMAT_TEXT, FORMAT_NDJSON, FORMAT_NONE };
+
+struct CompilerOptions {
+  // Lex on a second thread and feed the parser through a TokenRing.
+  bool pipelined = false;
+  // Give up lexing and parsing after this many errors; 0 means no limit.
+  unsigned int maxErrors = 0;
+  // Allow non-ASCII characters in identifiers.
+  bool unicodeIdentifiers = false;
+  // Reuse results stored under this directory; empty disables the cache.
+  std::string cacheDir;
+  uintmax_t cacheMaxBytes = 64 * 1024 * 1024;
+  // Text prints the token table and the parser report; NDJSON streams only
+  // the parser's reports to stdout; none just sets the result.
+  ReportFormat report = FORMAT_TEXT;
+  // Compile an error-free program to bytecode and run its main.
+  bool run = false;
+  // Drop unreachable functions and unused structs, fold constants and drop
+  // dead code before generating bytecode.
+  bool optimize = true;
+  // Print every function's three-address IR with its live registers.
+  bool dumpIr = false;
+  // Print how long each backend pass took.
+  bool timePasses = false;
+  // Print every struct's layout and a padding-minimizing field order.
+  bool layout = false;
+  // Store struct fields in that order.
+  bool reorderFields = false;
+  // Write x86-64 assembly to this path plus ".s" and link it into an
+  // executable there; empty for none.
+  std::string nativeOutput;
+};
+
+struct CompileStats {
+  size_t identifiers = 0;
+  size_t identifierBytes = 0;
+  size_t constants = 0;
+};
+
+void printStats(const CompileStats &stats);
 
 class Compiler {
 private:
-  vector<Token> tokens;
+  TokenBuffer tokens;
+  // Comments, which the parser never sees; the token table puts them back.
+  std::vector<Trivia> trivia;
   Lexer lexer;
-  Parser parser;
-  std::string sourceCode;
+  std::shared_ptr<const SourceMap> sources;
+  // Tokens were handed in already lexed, so the lexer is not used.
+  bool prelexed = false;
+  std::ostream *console = &std::cout;
   std::ofstream out;
+  std::string resultsName;
+  CompilerOptions options;
+
+  template <typename Sink> void runPipelined(BasicParser<Sink> &parser);
+  template <typename Sink> bool runWith(Sink sink);
+  bool run();
+  bool backend();
+  uint64_t cacheKey();
 
 public:
-  Compiler(std::string filename, std::string resultsname = "result.txt");
+  Compiler(std::string filename, std::string resultsname = "result.txt",
+           CompilerOptions options = CompilerOptions());
+  // For tokens lexed elsewhere, ending in EOF, with their comments and the
+  // map their file IDs refer to. The result cache is not used.
+  Compiler(TokenBuffer tokens, std::vector<Trivia> trivia,
+           std::shared_ptr<const SourceMap> sources, std::string resultsname,
+           CompilerOptions options);
+  // Where the report and program output go besides the results file;
+  // stdout by default.
+  void setConsole(std::ostream &stream);
   int calcLexerErrorCount();
   void printLexerTokens();
   bool compile();
+  void collectStats(CompileStats &stats) const;
 };
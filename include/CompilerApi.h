@@ -0,0 +1,88 @@
+#ifndef COMPILER_API_H
+#define COMPILER_API_H
+
+/* C interface to CompilerContext, for callers that cannot use C++. No
+   exception crosses it: cmp_context_new returns NULL and cmp_compile -1 if
+   the compiler fails, for example by running out of memory. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct cmp_context cmp_context;
+
+/* Same values as ReportKind. */
+enum cmp_report_kind {
+  CMP_REPORT_RULE,
+  CMP_REPORT_SYNTAX_ERROR,
+  CMP_REPORT_SEMANTIC_ERROR,
+  CMP_REPORT_NOTE
+};
+
+/* Stores the contents of the included file `path` in *data and *size and
+   returns nonzero, or returns 0 if there is no such file. The bytes are
+   copied before the callback is called again. */
+typedef int (*cmp_include_resolver)(void *user, const char *path,
+                                    const char **data, size_t *size);
+
+typedef struct cmp_token {
+  /* Not NUL-terminated. */
+  const char *text;
+  size_t size;
+  /* As printed in the token table, e.g. "IDENTIFIER". */
+  const char *type;
+  uint32_t line;
+  uint32_t column;
+  /* 0 for the compiled source, includes follow. */
+  uint16_t file;
+  int error;
+} cmp_token;
+
+typedef struct cmp_diagnostic {
+  enum cmp_report_kind kind;
+  /* 0 when the report is not tied to a token. */
+  uint32_t line;
+  uint32_t column;
+  const char *message;
+  /* The file the line and column are in; see cmp_file_name. */
+  uint16_t file;
+} cmp_diagnostic;
+
+/* 0 for no limit. */
+cmp_context *cmp_context_new(unsigned int max_errors,
+                             int unicode_identifiers);
+void cmp_context_free(cmp_context *context);
+void cmp_context_set_include_resolver(cmp_context *context,
+                                      cmp_include_resolver resolver,
+                                      void *user);
+/* Returns 1 if the source has no errors and 0 if it has. Pointers into the
+   results stay valid until the next cmp_compile or cmp_context_reset. */
+int cmp_compile(cmp_context *context, const char *source, size_t size);
+void cmp_context_reset(cmp_context *context);
+
+size_t cmp_token_count(const cmp_context *context);
+/* Returns 0 if index is out of range. */
+int cmp_token_get(const cmp_context *context, size_t index, cmp_token *token);
+/* Comments are not tokens; each is given with the index of the token it
+   precedes. */
+size_t cmp_comment_count(const cmp_context *context);
+int cmp_comment_get(const cmp_context *context, size_t index,
+                    cmp_token *token, size_t *before);
+size_t cmp_diagnostic_count(const cmp_context *context);
+int cmp_diagnostic_get(const cmp_context *context, size_t index,
+                       cmp_diagnostic *diagnostic);
+/* The path the file with this ID was included by, "" for the compiled
+   source, or NULL if there is no such file. */
+const char *cmp_file_name(const cmp_context *context, uint16_t file);
+unsigned int cmp_lexical_error_count(const cmp_context *context);
+unsigned int cmp_error_count(const cmp_context *context);
+unsigned int cmp_semantic_error_count(const cmp_context *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
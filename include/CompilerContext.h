@@ -0,0 +1,68 @@
+#ifndef COMPILER_CONTEXT_H
+#define COMPILER_CONTEXT_H
+
+#include "Compiler.h"
+#include "ConstantPool.h"
+#include "Interner.h"
+#include "ParserSink.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Lexes and parses sources held in memory, for programs that embed the
+// compiler instead of running it. Nothing is printed and no file is opened;
+// included files come from the include resolver. A context is used by one
+// thread at a time, but any number of contexts can compile at once. Each has
+// its own symbol table and constant pool, emptied at every compile, so a
+// long-lived context does not grow with the sources it has seen. Reusing one
+// for the next source keeps the capacity of its tokens, comments, diagnostics
+// and parser.
+class CompilerContext {
+public:
+  explicit CompilerContext(CompilerOptions options = CompilerOptions());
+  CompilerContext(const CompilerContext &) = delete;
+  CompilerContext &operator=(const CompilerContext &) = delete;
+  // Without a resolver every include is missing, and so an error.
+  void setIncludeResolver(Lexer::IncludeResolver resolver);
+  // Returns whether the source has no lexical, syntax or semantic errors.
+  // The results stay valid until the next compile() or reset().
+  bool compile(std::string source);
+  // Drops the results of the last compile but not the memory behind them.
+  void reset();
+
+  // Every token of the source and its includes, ending in EOF.
+  const std::vector<Token> &getTokens() const;
+  // The comments, each with the index of the token it precedes.
+  const std::vector<Trivia> &getTrivia() const;
+  // The parser's reports, matched rules included, in the order made.
+  const std::vector<Diagnostic> &getDiagnostics() const;
+  // The path each file was included by, indexed by the file ID in tokens
+  // and diagnostics; empty for the compiled source itself.
+  const std::vector<std::string> &getFileNames() const;
+  unsigned int getLexicalErrorCount() const;
+  unsigned int getErrorCount() const;
+  unsigned int getSemanticErrorCount() const;
+  // 1-based, in the file the token came from.
+  void position(const Token &token, uint32_t &line, uint32_t &column) const;
+
+private:
+  CompilerOptions options;
+  Lexer::IncludeResolver resolver;
+  std::shared_ptr<SourceMap> sources;
+  // Current on this thread during compile(); token symbols and constants
+  // are IDs into these.
+  Interner interner;
+  ConstantPool constants;
+  BasicParser<StructuredSink> parser;
+  // Refilled in place by every compile(), which hands them to the parser
+  // again before it parses.
+  std::shared_ptr<std::vector<Token>> tokens;
+  std::vector<Trivia> trivia;
+  std::vector<Diagnostic> diagnostics;
+  std::vector<std::string> fileNames;
+  unsigned int lexicalErrors = 0;
+  unsigned int errors = 0;
+  unsigned int semanticErrors = 0;
+};
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef CONST_LEXER_H
+#define CONST_LEXER_H
+
+#include "CharClass.h"
+#include "Token.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// The keywords and the kind each lexes to. Lexer builds its keyword lookup
+// from this table too, so both lexers always know the same keywords.
+struct Keyword {
+  std::string_view text;
+  TokenType type;
+};
+
+inline constexpr Keyword KEYWORDS[] = {
+    {"IfTrue", CONDITION},   {"Otherwise", OTHERWISE}, {"Imw", INTEGER},
+    {"SIMw", SINTEGER},      {"Chj", CHARACTER},       {"Series", STRING},
+    {"IMwf", FLOAT},         {"SIMwf", SFLOAT},        {"NOReturn", VOID},
+    {"RepeatWhen", LOOP},    {"Reiterate", REITERATE}, {"Turnback", RETURN},
+    {"OutLoop", BREAK},      {"Stop", BREAK},          {"Loli", STRUCT},
+    {"include", INCLUSION},  {"int", INTEGER}};
+
+// A token as the compile-time lexer sees it: where it is in the source,
+// without the text, symbol and constant that need the runtime interner and
+// pools.
+struct ConstToken {
+  TokenType type = INVALID;
+  uint32_t offset = 0;
+  uint32_t length = 0;
+  bool error = false;
+};
+
+// The runtime lexer's rules for ASCII sources, as a constexpr scanner.
+// Comments come out as the same start, content and end tokens the runtime
+// lexer keeps as trivia, in source order with the other tokens; isTrivia()
+// tells them apart. Anything it does not model, a non-ASCII byte or an
+// unterminated comment, is an UNKNOWN error token; the prelude sources are
+// checked to have none.
+class ConstLexer {
+public:
+  constexpr explicit ConstLexer(std::string_view source) : source(source) {}
+
+  // False once the source is used up.
+  constexpr bool next(ConstToken &token) {
+    if (comment != NO_COMMENT)
+      return nextInComment(token);
+    while (pos < source.size() && isSpaceChar(source[pos]))
+      pos++;
+    if (pos >= source.size())
+      return false;
+    if (peek() == '/' && peek(1) == '^') {
+      token = make(SINGLE_LINE_COMMENT_START, pos, pos + 2, false);
+      pos += 2;
+      comment = LINE_CONTENT;
+      return true;
+    }
+    if (peek() == '/' && peek(1) == '@') {
+      if (source.find("@/", pos + 2) == std::string_view::npos) {
+        token = make(UNKNOWN, pos, source.size(), true);
+        pos = source.size();
+        return true;
+      }
+      token = make(COMMENT_START, pos, pos + 2, false);
+      pos += 2;
+      comment = BLOCK_CONTENT;
+      return true;
+    }
+    size_t start = pos;
+    char c = source[pos];
+    if (c == '"') {
+      token = lexString();
+    } else if (c == '\'') {
+      pos++;
+      if (pos < source.size() && peek() != '\'')
+        pos++;
+      bool closed = peek() == '\'';
+      if (closed)
+        pos++;
+      token = make(closed ? CHARACTER_LITERAL : UNTERMINATED_CHAR, start, pos,
+                   !closed);
+    } else if (isIdentStart(c)) {
+      while (pos < source.size() && isIdentChar(source[pos]))
+        pos++;
+      TokenType type = keywordType(source.substr(start, pos - start));
+      token = make(type, start, pos, false);
+      if (type == INCLUSION) {
+        size_t after = pos;
+        while (after < source.size() && isSpaceChar(source[after]))
+          after++;
+        if (after >= source.size() || source[after] != '"')
+          token = make(INVALID_INCLUSION, start, pos, true);
+      }
+    } else if (isDigitChar(c) ||
+               ((c == '-' || c == '+') && isDigitChar(peek(1)))) {
+      token = lexNumber();
+    } else if (!isAsciiChar(c)) {
+      while (pos < source.size() && !isAsciiChar(source[pos]))
+        pos++;
+      token = make(UNKNOWN, start, pos, true);
+    } else {
+      token = lexOperator();
+    }
+    return true;
+  }
+
+  static constexpr bool isTrivia(TokenType type) {
+    return type == COMMENT_START || type == COMMENT_CONTENT ||
+           type == COMMENT_END || type == SINGLE_LINE_COMMENT_START ||
+           type == SINGLE_LINE_COMMENT_CONTENT;
+  }
+
+  static constexpr TokenType keywordType(std::string_view text) {
+    for (const Keyword &keyword : KEYWORDS) {
+      if (keyword.text == text)
+        return keyword.type;
+    }
+    return IDENTIFIER;
+  }
+
+private:
+  // What is left of the comment whose start token was just returned.
+  enum CommentPart { NO_COMMENT, LINE_CONTENT, BLOCK_CONTENT, BLOCK_END };
+
+  std::string_view source;
+  size_t pos = 0;
+  CommentPart comment = NO_COMMENT;
+
+  // An unterminated "/@" never gets here; next() has made it an error.
+  constexpr bool nextInComment(ConstToken &token) {
+    size_t start = pos;
+    switch (comment) {
+    case LINE_CONTENT:
+      pos = std::min(source.find('\n', pos), source.size());
+      token = make(SINGLE_LINE_COMMENT_CONTENT, start, pos, false);
+      comment = NO_COMMENT;
+      break;
+    case BLOCK_CONTENT:
+      pos = source.find("@/", pos);
+      token = make(COMMENT_CONTENT, start, pos, false);
+      comment = BLOCK_END;
+      break;
+    default:
+      pos += 2;
+      token = make(COMMENT_END, start, pos, false);
+      comment = NO_COMMENT;
+      break;
+    }
+    return true;
+  }
+
+  constexpr char peek(size_t n = 0) const {
+    return pos + n < source.size() ? source[pos + n] : '\0';
+  }
+
+  static constexpr ConstToken make(TokenType type, size_t start, size_t end,
+                                   bool error) {
+    ConstToken token;
+    token.type = type;
+    token.offset = static_cast<uint32_t>(start);
+    token.length = static_cast<uint32_t>(end - start);
+    token.error = error;
+    return token;
+  }
+
+  constexpr ConstToken lexString() {
+    size_t start = pos++;
+    while (pos < source.size() && peek() != '"' && peek() != '\n')
+      pos++;
+    bool closed = peek() == '"';
+    if (closed)
+      pos++;
+    return make(closed ? STRING_LITERAL : UNTERMINATED_STRING, start, pos,
+                !closed);
+  }
+
+  // Range errors are only found when the runtime decodes the value.
+  constexpr ConstToken lexNumber() {
+    size_t start = pos;
+    bool error = false;
+    bool seenDot = false;
+    if (peek() == '-' || peek() == '+')
+      pos++;
+    while (pos < source.size() && (isDigitChar(peek()) || peek() == '.')) {
+      if (peek() == '.') {
+        error = error || seenDot;
+        seenDot = true;
+      }
+      pos++;
+    }
+    if (pos < source.size() && isIdentStart(peek())) {
+      while (pos < source.size() && isIdentChar(peek()))
+        pos++;
+      return make(INVALID_IDENTIFIER, start, pos, true);
+    }
+    return make(CONSTANT, start, pos, error);
+  }
+
+  constexpr ConstToken lexOperator() {
+    size_t start = pos;
+    char c = source[pos++];
+    TokenType type = UNKNOWN;
+    switch (c) {
+    case '=':
+      type = peek() == '=' ? RELATIONAL_OP : ASSIGNMENT_OP;
+      if (type == RELATIONAL_OP)
+        pos++;
+      break;
+    case '<':
+    case '>':
+      if (peek() == '=')
+        pos++;
+      type = RELATIONAL_OP;
+      break;
+    case '!':
+      type = peek() == '=' ? RELATIONAL_OP : LOGIC_OP;
+      if (type == RELATIONAL_OP)
+        pos++;
+      break;
+    case '&':
+      type = peek() == '&' ? LOGIC_OP : AMPERSAND;
+      if (type == LOGIC_OP)
+        pos++;
+      break;
+    case '|':
+      type = peek() == '|' ? LOGIC_OP : ARITHMETIC_OP;
+      if (type == LOGIC_OP)
+        pos++;
+      break;
+    case '-':
+      type = peek() == '>' ? ACCESS_OP : MINUS;
+      if (type == ACCESS_OP)
+        pos++;
+      break;
+    case '+':
+      type = PLUS;
+      break;
+    case '*':
+      type = STAR;
+      break;
+    case '/':
+      type = SLASH;
+      break;
+    case '~':
+      type = LOGIC_OP;
+      break;
+    case '(':
+      type = LEFT_PAREN;
+      break;
+    case ')':
+      type = RIGHT_PAREN;
+      break;
+    case '{':
+      type = LEFT_BRACE;
+      break;
+    case '}':
+      type = RIGHT_BRACE;
+      break;
+    case '[':
+      type = LEFT_BRACKET;
+      break;
+    case ']':
+      type = RIGHT_BRACKET;
+      break;
+    case ';':
+      type = SEMICOLON;
+      break;
+    case ',':
+      type = COMMA;
+      break;
+    }
+    return make(type, start, pos, type == UNKNOWN);
+  }
+};
+
+constexpr size_t constTokenCount(std::string_view source) {
+  ConstLexer lexer(source);
+  ConstToken token;
+  size_t count = 0;
+  while (lexer.next(token))
+    count++;
+  return count;
+}
+
+// The tokens of a source known at compile time, without EOF. N must be
+// constTokenCount(source).
+template <size_t N>
+constexpr std::array<ConstToken, N> constTokenize(std::string_view source) {
+  std::array<ConstToken, N> tokens{};
+  ConstLexer lexer(source);
+  for (ConstToken &token : tokens)
+    lexer.next(token);
+  return tokens;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef CONSTANTPOOL_H
+#define CONSTANTPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Which declared type a numeric literal fits: a literal with a dot is an IMwf,
+// anything else an Imw.
+enum LiteralKind : uint8_t { LITERAL_IMW, LITERAL_IMWF };
+
+// Both values are set for an Imw; an IMwf only has its floatValue.
+struct Constant {
+  LiteralKind kind = LITERAL_IMW;
+  int64_t intValue = 0;
+  double floatValue = 0;
+};
+
+// Table of the numeric literals the lexer has decoded. Equal values share
+// one ID, so a program that repeats 0 and 1 everywhere holds each once. ID 0
+// means "not decoded".
+class ConstantPool {
+public:
+  ConstantPool();
+  ConstantPool(const ConstantPool &) = delete;
+  ConstantPool &operator=(const ConstantPool &) = delete;
+
+  // The pool of the calling thread, chosen like Interner::current().
+  static ConstantPool &current();
+
+  // Makes `pool` the current one on this thread until destroyed.
+  class Scope {
+  public:
+    explicit Scope(ConstantPool &pool);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    ConstantPool *previous;
+  };
+
+  uint32_t addInt(int64_t value);
+  uint32_t addFloat(double value);
+  Constant get(uint32_t id) const;
+  // Drops every constant, keeping the memory.
+  void clear();
+
+  size_t constantCount() const;
+  size_t lookupCount() const;
+
+private:
+  mutable std::mutex mutex;
+  std::vector<Constant> constants;
+  // Keyed by the value's bits, so -0.0 and 0.0 stay apart.
+  std::unordered_map<uint64_t, uint32_t> ints;
+  std::unordered_map<uint64_t, uint32_t> floats;
+  size_t lookups = 0;
+
+  uint32_t add(std::unordered_map<uint64_t, uint32_t> &ids, uint64_t bits,
+               const Constant &constant);
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef IR_H
+#define IR_H
+
+#include "Bytecode.h"
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+enum IrOp {
+  IR_CONST,
+  IR_COPY,
+  IR_ADD,
+  IR_SUB,
+  IR_MUL,
+  IR_DIV,
+  IR_LT,
+  IR_LE,
+  IR_EQ,
+  IR_NE,
+  IR_ITOF,
+  IR_FTOI,
+  IR_GETG,
+  IR_SETG,
+  IR_NEW,
+  IR_GETX,
+  IR_SETX,
+  IR_GETF,
+  IR_SETF,
+  IR_CALL
+};
+
+// dst = a op b. Values are the function's registers; NO_VALUE marks an
+// unused operand. Stores read a third register: setx a[b] = c and
+// setf a.imm = b.
+struct IrInstr {
+  static const uint32_t NO_VALUE = UINT32_MAX;
+
+  IrOp op;
+  // Arithmetic, comparisons and constants on IMwf operands.
+  bool isFloat = false;
+  uint32_t dst = NO_VALUE;
+  uint32_t a = NO_VALUE;
+  uint32_t b = NO_VALUE;
+  uint32_t c = NO_VALUE;
+  // Index into Bytecode::constants, global slot, member index, object size
+  // or callee index.
+  uint32_t imm = 0;
+  // Call arguments, as a range of IrFunction::args.
+  uint32_t argStart = 0;
+  uint32_t argCount = 0;
+};
+
+enum IrTermKind { TERM_JUMP, TERM_BRANCH, TERM_RETURN };
+
+// How a block ends. A branch goes to succs[0] when `cond` is non-zero and to
+// succs[1] otherwise; a return without a value has value == NO_VALUE.
+struct IrTerminator {
+  IrTermKind kind = TERM_RETURN;
+  uint32_t cond = IrInstr::NO_VALUE;
+  uint32_t value = IrInstr::NO_VALUE;
+};
+
+// Fixed-size set of registers, one bit each.
+class BitSet {
+public:
+  BitSet() = default;
+  explicit BitSet(size_t bits) : words((bits + 63) / 64, 0) {}
+  void set(uint32_t bit) { words[bit >> 6] |= uint64_t(1) << (bit & 63); }
+  bool test(uint32_t bit) const {
+    return (words[bit >> 6] >> (bit & 63)) & 1;
+  }
+  // this = use | (out & ~def); returns whether anything changed.
+  bool assignTransfer(const BitSet &use, const BitSet &out, const BitSet &def);
+  void unite(const BitSet &other);
+  size_t count() const;
+
+private:
+  std::vector<uint64_t> words;
+};
+
+struct IrBlock {
+  std::vector<IrInstr> code;
+  IrTerminator term;
+  std::vector<uint32_t> succs;
+  std::vector<uint32_t> preds;
+  BitSet use;
+  BitSet def;
+  BitSet liveIn;
+  BitSet liveOut;
+};
+
+struct IrFunction {
+  uint32_t name = 0;
+  uint32_t params = 0;
+  uint32_t registers = 0;
+  bool floatResult = false;
+  std::vector<bool> floatParams;
+  // Block 0 is the entry; unreachable blocks are dropped.
+  std::vector<IrBlock> blocks;
+  std::vector<uint32_t> args;
+};
+
+struct IrModule {
+  std::vector<IrFunction> functions;
+  const Bytecode *bytecode = nullptr;
+};
+
+// Splits each function's register code into basic blocks at jump targets
+// and after jumps and returns, and links them into a control-flow graph.
+IrModule lowerToIr(const Bytecode &bytecode);
+
+// Backward dataflow over dense bit vectors, one bit per register. Blocks are
+// first visited in post-order, then only blocks whose successors changed are
+// revisited. Returns the number of block visits.
+size_t computeLiveness(IrFunction &function);
+
+void dumpIr(const IrModule &module, std::ostream &out);
+
+#endif
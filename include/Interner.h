@@ -0,0 +1,100 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Keywords are interned first, in this order, so their IDs are fixed and the
+// parser can test for them with an integer compare.
+enum KnownSymbol : uint32_t {
+  SYM_NONE = 0,
+  SYM_IFTRUE,
+  SYM_OTHERWISE,
+  SYM_IMW,
+  SYM_SIMW,
+  SYM_CHJ,
+  SYM_SERIES,
+  SYM_IMWF,
+  SYM_SIMWF,
+  SYM_NORETURN,
+  SYM_REPEATWHEN,
+  SYM_REITERATE,
+  SYM_TURNBACK,
+  SYM_OUTLOOP,
+  SYM_STOP,
+  SYM_LOLI,
+  SYM_INCLUDE,
+  SYM_INT,
+  SYM_KEYWORD_COUNT
+};
+
+// Table that maps every distinct lexeme to a dense 32-bit ID. The bytes live
+// in an append-only arena, so views returned by text() stay valid until the
+// table is cleared or destroyed. Every table starts with the keywords.
+class Interner {
+public:
+  Interner();
+  Interner(const Interner &) = delete;
+  Interner &operator=(const Interner &) = delete;
+
+  // The table of the calling thread: the process-wide one, unless a Scope
+  // has put another in its place.
+  static Interner &current();
+
+  // Makes `table` the current one on this thread until destroyed.
+  class Scope {
+  public:
+    explicit Scope(Interner &table);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    Interner *previous;
+  };
+
+  uint32_t intern(std::string_view text);
+  std::string_view text(uint32_t id) const;
+  // Drops every symbol but the keywords. The arena's chunks and the slot
+  // table are kept for the symbols interned next.
+  void clear();
+
+  size_t symbolCount() const;
+  size_t arenaBytes() const;
+  // Everything the table has allocated: slots, entries and arena chunks.
+  size_t memoryBytes() const;
+  size_t lookupCount() const;
+
+private:
+  static const size_t CHUNK_SIZE = 64 * 1024;
+
+  struct Entry {
+    const char *data;
+    uint32_t size;
+    uint32_t hash;
+  };
+
+  mutable std::mutex mutex;
+  std::vector<uint32_t> slots;
+  std::vector<Entry> entries;
+  std::vector<std::unique_ptr<char[]>> chunks;
+  // Texts too long to share a chunk, one allocation each.
+  std::vector<std::unique_ptr<char[]>> large;
+  char *chunk;
+  size_t chunk_used;
+  // Index in `chunks` of the chunk to fill after the current one.
+  size_t next_chunk;
+  size_t arena_bytes;
+  size_t large_bytes;
+  size_t lookups;
+
+  const char *store(std::string_view text);
+  void grow();
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "Ast.h"
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+// Where a Loli struct's fields would sit in memory, laid out like a C struct:
+// Chj is 1 byte, SIMw and SIMwf 4, Imw and IMwf 8, and Series and pointers
+// are 8-byte references. Arrays repeat their element, and a nested Loli is
+// stored inline.
+struct FieldLayout {
+  uint32_t name = 0;
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  uint64_t align = 1;
+  // '->' uses in function bodies, weighted by loop depth.
+  uint64_t accesses = 0;
+};
+
+struct StructLayout {
+  uint32_t name = 0;
+  uint64_t size = 0;
+  uint64_t align = 1;
+  uint64_t padding = 0;
+  // In declaration order.
+  std::vector<FieldLayout> fields;
+  // Indices into `fields` by falling alignment, which leaves no padding
+  // between fields of power-of-two size, hot fields first where that is free.
+  std::vector<uint32_t> suggested;
+  uint64_t suggestedSize = 0;
+  // How many of `suggested` are hot, used at least an eighth as often as the
+  // most used field and split off from the rest; 0 if not split.
+  size_t hotFields = 0;
+};
+
+class LayoutEngine {
+public:
+  explicit LayoutEngine(const Program &program);
+  const std::vector<StructLayout> &getLayouts() const;
+  // Size, padding and offsets of every struct, and the suggested order
+  // where it differs.
+  void print(std::ostream &os) const;
+  // Reorders each struct's fields as suggested. Fields are looked up by
+  // name, so this only changes where they are stored.
+  void apply(Program &program) const;
+
+private:
+  // Each enclosing loop multiplies an access by this, up to MAX_LOOP_DEPTH.
+  static const uint64_t LOOP_WEIGHT = 8;
+  static const unsigned int MAX_LOOP_DEPTH = 6;
+
+  struct Var {
+    TypeRef type;
+    uint32_t arraySize = 0;
+  };
+
+  const Program &program;
+  std::vector<StructLayout> layouts;
+  std::unordered_map<uint32_t, size_t> index;
+  std::unordered_map<uint32_t, TypeRef> returns;
+  std::unordered_map<uint32_t, Var> globals;
+  std::vector<std::unordered_map<uint32_t, Var>> scopes;
+  std::vector<bool> laying;
+  uint64_t weight = 1;
+  unsigned int loops = 0;
+
+  const StructLayout &layout(uint32_t name, uint32_t offset, uint16_t file);
+  void sizeOf(const TypeRef &type, uint32_t arraySize, uint32_t offset,
+              uint16_t file, uint64_t &size, uint64_t &align);
+  void suggest(StructLayout &layout) const;
+  void countStmt(const Stmt &stmt);
+  bool countExpr(const Expr &expr, Var &type);
+  const Var *findVar(uint32_t name) const;
+};
+
+#endif
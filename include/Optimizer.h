@@ -0,0 +1,40 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "Ast.h"
+#include <cstddef>
+
+struct OptimizeStats {
+  // Operators replaced by their constant result.
+  size_t folded = 0;
+  // IfTrue/loop statements whose condition was constant.
+  size_t branches = 0;
+  // Statements after Turnback, OutLoop or Stop.
+  size_t unreachable = 0;
+  // Expression and statement nodes that are no longer in the tree.
+  size_t nodes = 0;
+};
+
+// Rewrites function bodies in place. Folding follows the bytecode's typing
+// rules: Imw with Imw stays an integer and wraps, anything with an IMwf is a
+// float, and comparisons give 0 or 1. Integer division by zero is left for
+// the VM to report.
+class AstOptimizer {
+public:
+  OptimizeStats optimize(Program &program);
+
+private:
+  OptimizeStats stats;
+
+  void foldExpr(std::unique_ptr<Expr> &expr);
+  bool foldBinary(std::unique_ptr<Expr> &expr);
+  void optimizeStmt(std::unique_ptr<Stmt> &stmt);
+  void pruneBlock(Stmt &block);
+  static bool isConstant(const Expr &expr);
+  static bool isTrue(const Expr &expr);
+  static bool terminates(const Stmt &stmt);
+  static size_t countNodes(const Expr *expr);
+  static size_t countNodes(const Stmt *stmt);
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef PARSER_SINK_H
+#define PARSER_SINK_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum ReportKind {
+  REPORT_RULE,
+  REPORT_SYNTAX_ERROR,
+  REPORT_SEMANTIC_ERROR,
+  REPORT_NOTE
+};
+
+struct Diagnostic {
+  ReportKind kind;
+  // The source map ID of the file the line and column are in.
+  uint16_t file;
+  // 1-based; 0 when the report is not tied to a token.
+  uint32_t line;
+  uint32_t column;
+  std::string message;
+};
+
+// The parser is instantiated once per sink. A sink with `enabled` false never
+// sees a report, and the parser skips building them, so checking a file costs
+// only the parse itself. A report gives the file it is in by source map ID
+// and by path; the path is empty for the file being compiled, so only
+// reports from included files name theirs.
+struct NullSink {
+  static constexpr bool enabled = false;
+  void begin() {}
+  void report(ReportKind, uint16_t, const std::string &, uint32_t, uint32_t,
+              const std::string &) {}
+  void finish(unsigned int, unsigned int) {}
+  void print(std::ostream &) const {}
+};
+
+// Keeps every report in memory, for callers that inspect them.
+class StructuredSink {
+public:
+  static constexpr bool enabled = true;
+  void begin();
+  void report(ReportKind kind, uint16_t file, const std::string &path,
+              uint32_t line, uint32_t column, const std::string &message);
+  void finish(unsigned int errors, unsigned int semanticErrors);
+  void print(std::ostream &) const {}
+  const std::vector<Diagnostic> &getDiagnostics() const;
+  unsigned int getErrorCount() const;
+  unsigned int getSemanticErrorCount() const;
+
+private:
+  std::vector<Diagnostic> diagnostics;
+  unsigned int errors = 0;
+  unsigned int semanticErrors = 0;
+};
+
+// The "Line : l:c ..." report printed after the token table.
+class TextSink {
+public:
+  static constexpr bool enabled = true;
+  void begin();
+  void report(ReportKind kind, uint16_t file, const std::string &path,
+              uint32_t line, uint32_t column, const std::string &message);
+  void finish(unsigned int errors, unsigned int semanticErrors);
+  void print(std::ostream &out) const;
+
+private:
+  struct Line {
+    // Files are ranked in the order their first report came in, which is
+    // token order: included files before the file that includes them. A
+    // file included twice keeps one rank, as in --project mode, where both
+    // inclusions share one file ID.
+    uint32_t fileRank;
+    // 0 for notes that are not tied to a token; they go after the reports.
+    uint32_t line;
+    uint32_t column;
+    std::string text;
+  };
+  std::vector<Line> lines;
+  // Rank of each file ID that has reports, plus one; 0 for none yet.
+  std::vector<uint32_t> fileRanks;
+  // The same by path, for files that have more than one ID.
+  std::unordered_map<std::string, uint32_t> pathRanks;
+  unsigned int errors = 0;
+  unsigned int semanticErrors = 0;
+};
+
+// Writes one JSON object per report as soon as it is made, so an error log of
+// any size is never held in memory.
+class NdjsonSink {
+public:
+  static constexpr bool enabled = true;
+  explicit NdjsonSink(std::ostream *out = nullptr);
+  void setStream(std::ostream *out);
+  void begin() {}
+  void report(ReportKind kind, uint16_t file, const std::string &path,
+              uint32_t line, uint32_t column, const std::string &message);
+  void finish(unsigned int errors, unsigned int semanticErrors);
+  void print(std::ostream &) const {}
+
+private:
+  std::ostream *out;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef PRELUDE_H
+#define PRELUDE_H
+
+#include "ConstLexer.h"
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// A standard header built into the compiler. Its source and its tokens are
+// both compiled in: the tokens are lexed by ConstLexer while the compiler
+// itself is built, so including a prelude neither reads nor lexes a file.
+struct Prelude {
+  // The path an include names it by, e.g. include ".\prelude\math.txt";
+  std::string_view path;
+  std::string_view source;
+  const ConstToken *tokens;
+  size_t tokenCount;
+};
+
+// nullptr if `path` is not a prelude.
+const Prelude *findPrelude(std::string_view path);
+const Prelude *preludesBegin();
+const Prelude *preludesEnd();
+
+// An included file: the built-in source for a prelude, or the file on disk.
+std::string readInclude(const std::string &path);
+
+// Lexes every prelude with the runtime lexer and compares the tokens with
+// the compiled-in ones, reporting each difference to `os`.
+bool checkPreludes(std::ostream &os);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef PROJECT_H
+#define PROJECT_H
+
+#include "Compiler.h"
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compiles several entry files that share includes. The include graph of all
+// entries is scanned first; every distinct file is then read and lexed once,
+// on its own, and each entry's token stream is spliced together from those
+// shared buffers the way the lexer splices includes. Lexing and compiling run
+// on a pool of threads: a file's lex is ready at once, an entry's compile as
+// soon as every file it pulls in has been lexed.
+class Project {
+public:
+  Project(std::vector<std::string> entries, CompilerOptions options);
+  // Returns whether every entry compiled without errors. Each entry's output
+  // is printed in the order the entries were given.
+  bool build(unsigned int threads);
+  // Re-reads the changed files, lexes them and any file they newly include,
+  // and recompiles only the entries that pull one of them in; every other
+  // file keeps its tokens. Prints what changed in each recompiled entry's
+  // diagnostics instead of its whole output.
+  bool rebuild(const std::vector<std::string> &changed, unsigned int threads,
+               std::ostream &os);
+  // Every file of the project, entries and includes.
+  std::vector<std::string> files() const;
+  // Work, wall time, achieved parallelism and the critical path.
+  void printSchedule(std::ostream &os) const;
+  void collectStats(CompileStats &stats) const;
+
+private:
+  struct Unit {
+    std::string path;
+    std::unique_ptr<Lexer> lexer;
+    // Files named by the include directives, in order.
+    std::vector<uint32_t> includes;
+    // This file's own tokens, without included files and EOF.
+    TokenBuffer tokens;
+    // Its comments, indexed into `tokens`.
+    std::vector<Trivia> trivia;
+    uint32_t size = 0;
+    uint16_t file = 0;
+    // Entries that need this file.
+    std::vector<uint32_t> dependents;
+    double start = 0;
+    double finish = 0;
+  };
+
+  struct Entry {
+    uint32_t unit;
+    std::string resultsName;
+    // Every file the entry pulls in, itself included.
+    std::vector<uint32_t> closure;
+    size_t waiting = 0;
+    // How many files the entry would lex on its own.
+    size_t lexes = 0;
+    std::string output;
+    bool passed = false;
+    CompileStats stats;
+    double start = 0;
+    double finish = 0;
+  };
+
+  CompilerOptions options;
+  std::shared_ptr<SourceMap> sources;
+  std::vector<Unit> units;
+  std::vector<Entry> entries;
+  std::unordered_map<std::string, uint32_t> index;
+  // Units in post-order, includes before the files that include them.
+  std::vector<uint32_t> order;
+  double scanSeconds = 0;
+  double wallSeconds = 0;
+  unsigned int threadCount = 0;
+
+  uint32_t addUnit(const std::string &path);
+  void scanIncludes(uint32_t unit, std::ostream *os);
+  void link();
+  void schedule(const std::vector<bool> &relex, unsigned int threads);
+  void lex(uint32_t unit);
+  void compile(uint32_t entry);
+  void splice(uint32_t unit, std::vector<Token> &tokens,
+              std::vector<Trivia> &trivia, std::vector<bool> &active,
+              unsigned int depth, size_t &lexes);
+};
+
+#endif
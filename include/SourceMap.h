@@ -0,0 +1,81 @@
+#ifndef SOURCE_MAP_H
+#define SOURCE_MAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Byte offsets of the first character of every line in one source.
+class LineIndex {
+public:
+  explicit LineIndex(const std::string &source);
+
+  // Both are 1-based.
+  uint32_t line(uint32_t offset) const;
+  uint32_t column(uint32_t offset) const;
+
+private:
+  std::vector<uint32_t> starts;
+};
+
+// Line indexes of the main file and everything it includes, by the file ID
+// stored in each token. Tokens only carry offsets; lines and columns are
+// looked up here when a token is actually printed or reported.
+class SourceMap {
+public:
+  // File IDs are 16 bits and UINT16_MAX means "none", so this many fit.
+  static const size_t MAX_FILES = UINT16_MAX;
+
+  SourceMap() = default;
+  ~SourceMap();
+  SourceMap(const SourceMap &) = delete;
+  SourceMap &operator=(const SourceMap &) = delete;
+
+  // Throws std::length_error once MAX_FILES are in the map; check full()
+  // first to report that as a diagnostic instead.
+  uint16_t add(const std::string &source);
+  bool full() const;
+  // How many files are in the map; their IDs are 0 to size() - 1.
+  size_t size() const;
+  // Re-indexes a file that changed on disk, keeping its ID, and frees the
+  // index it had. Like clear(), not safe while anything looks that file up.
+  void replace(uint16_t file, const std::string &source);
+  // Forgets every file, so the map can be reused for another compile. Not
+  // safe while anything else uses the map.
+  void clear();
+  // The path a file was read from, for reports; empty if it was not given.
+  void setName(uint16_t file, std::string name);
+  std::string name(uint16_t file) const;
+
+  uint32_t line(uint16_t file, uint32_t offset) const;
+  uint32_t column(uint16_t file, uint32_t offset) const;
+  // Both at once; 0 for unknown files.
+  void position(uint16_t file, uint32_t offset, uint32_t &line,
+                uint32_t &column) const;
+
+private:
+  // Included files are added from the lexer thread while the parser may be
+  // reporting. Lookups happen for every printed token, so they take no
+  // lock: an index is published in its chunk before the count that makes
+  // it visible, and chunks never move. Only writers and names lock.
+  static const size_t CHUNK_BITS = 8;
+  static const size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+  struct Chunk {
+    std::atomic<const LineIndex *> files[CHUNK_SIZE] = {};
+  };
+  std::atomic<Chunk *> chunks[(MAX_FILES + CHUNK_SIZE) / CHUNK_SIZE] = {};
+  std::atomic<size_t> count{0};
+
+  mutable std::mutex mutex;
+  // The published index of each file, by ID.
+  std::vector<std::unique_ptr<LineIndex>> owned;
+  std::vector<std::string> names;
+
+  const LineIndex *find(uint16_t file) const;
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <cstddef>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Open-addressing hash map for non-zero integer keys (key 0 marks an empty
+// slot). Entries are never removed, so probing needs no tombstones.
+template <typename K, typename V> class FlatMap {
+public:
+  FlatMap() : keys(64, 0), values(64), count(0) {}
+
+  V *find(K key) {
+    size_t mask = keys.size() - 1;
+    for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+      if (keys[i] == key)
+        return &values[i];
+      if (keys[i] == 0)
+        return nullptr;
+    }
+  }
+
+  const V *find(K key) const { return const_cast<FlatMap *>(this)->find(key); }
+
+  V &operator[](K key) {
+    if (V *value = find(key))
+      return *value;
+    if ((count + 1) * 2 > keys.size())
+      grow();
+    count++;
+    size_t i = slotFor(keys, key);
+    keys[i] = key;
+    values[i] = V();
+    return values[i];
+  }
+
+  // Empties the map but keeps its table.
+  void clear() {
+    std::fill(keys.begin(), keys.end(), 0);
+    count = 0;
+  }
+
+private:
+  std::vector<K> keys;
+  std::vector<V> values;
+  size_t count;
+
+  static size_t hash(K key) {
+    uint64_t h = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(h ^ (h >> 32));
+  }
+
+  static size_t slotFor(const std::vector<K> &table, K key) {
+    size_t mask = table.size() - 1;
+    size_t i = hash(key) & mask;
+    while (table[i] != 0 && table[i] != key)
+      i = (i + 1) & mask;
+    return i;
+  }
+
+  void grow() {
+    std::vector<K> bigger_keys(keys.size() * 2, 0);
+    std::vector<V> bigger_values(keys.size() * 2);
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (keys[i] != 0) {
+        size_t j = slotFor(bigger_keys, keys[i]);
+        bigger_keys[j] = keys[i];
+        bigger_values[j] = values[i];
+      }
+    }
+    keys.swap(bigger_keys);
+    values.swap(bigger_values);
+  }
+};
+
+enum SymbolKind : uint8_t {
+  SYMBOL_VARIABLE,
+  SYMBOL_PARAMETER,
+  SYMBOL_FUNCTION,
+  SYMBOL_STRUCT
+};
+
+struct Symbol {
+  uint32_t name;
+  // Interned struct name for Loli-typed variables, 0 otherwise.
+  uint32_t type;
+  SymbolKind kind;
+  uint32_t depth;
+  // Binding of the same name in an enclosing scope, 0 if there is none.
+  uint32_t shadowed;
+};
+
+// What a name is doing at one place in the source, for the cross-reference
+// index. Definitions come first, so a lookup can tell them from uses.
+enum ReferenceKind : uint8_t {
+  REF_FUNCTION,
+  REF_STRUCT,
+  REF_VARIABLE,
+  REF_PARAMETER,
+  REF_MEMBER,
+  REF_USE,
+  REF_CALL,
+  REF_TYPE,
+  REF_MEMBER_USE
+};
+
+struct Reference {
+  uint32_t name;
+  uint32_t offset;
+  uint16_t file;
+  ReferenceKind kind;
+};
+
+// Scope stack keyed by interned symbol IDs. Each name maps to its innermost
+// live binding, and every binding remembers the one it shadows, so popping a
+// scope only walks the bindings made in it.
+class SymbolTable {
+public:
+  SymbolTable();
+  // Forgets every name, keeping the memory for the next parse.
+  void clear();
+
+  void pushScope();
+  void popScope();
+  uint32_t depth() const;
+
+  // Returns false if the name is already declared in the current scope.
+  bool declare(uint32_t name, SymbolKind kind, uint32_t type = 0);
+  const Symbol *lookup(uint32_t name) const;
+
+  bool declareMember(uint32_t structName, uint32_t member, uint32_t type = 0);
+  // Type of the member (0 for non-struct members), or -1 if there is none.
+  int64_t memberType(uint32_t structName, uint32_t member) const;
+
+private:
+  std::vector<Symbol> bindings;
+  std::vector<uint32_t> scopes;
+  FlatMap<uint32_t, uint32_t> innermost;
+  FlatMap<uint64_t, uint32_t> members;
+};
+
+#endif
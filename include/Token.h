@@ -1,12 +1,19 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 using namespace std;
 
+// Every bracket and keyword variant has its own kind, so the parser never
+// compares text. Each still prints as the category it shares with the others
+// (BRACE, CONDITION, LOOP). The kinds fit in a 64-bit mask; see below.
 enum TokenType {
     CLEAR,
     CONDITION,
+    OTHERWISE,
     INTEGER,
     SINTEGER,
     CHARACTER,
@@ -15,13 +22,19 @@ enum TokenType {
     SFLOAT,
     VOID,
     LOOP,
+    REITERATE,
     RETURN,
     ARITHMETIC_OP,
     LOGIC_OP,
     RELATIONAL_OP,
     ASSIGNMENT_OP,
     ACCESS_OP,
-    BRACE,
+    LEFT_PAREN,
+    RIGHT_PAREN,
+    LEFT_BRACE,
+    RIGHT_BRACE,
+    LEFT_BRACKET,
+    RIGHT_BRACKET,
     CONSTANT,
     QUOTATION_MARK,
     INCLUSION,
@@ -44,26 +57,102 @@ enum TokenType {
     UNTERMINATED_STRING,
     UNTERMINATED_CHAR,
     INVALID_IDENTIFIER,
-    ADDOP,
-    MULOP,
+    // '+' and '-' print as ADDOP, '*' and '/' as MULOP.
+    PLUS,
+    MINUS,
+    STAR,
+    SLASH,
     AMPERSAND,
     UNKNOWN,
+    INVALID_ENCODING,
     EOF_TOKEN
 };
 
 class Token {
 public:
-    int line;
+    // Byte offset of the first character; SourceMap turns it into a line and
+    // column when the token is printed.
+    uint32_t offset;
+    // ConstantPool ID of a decoded CONSTANT, 0 for everything else.
+    uint32_t constant;
     std::string text;
     TokenType type;
     bool error;
+    // Interned ID of identifiers and keywords, 0 for everything else.
+    uint32_t symbol;
+    // Which source the offset is in: 0 is the main file, includes follow.
+    uint16_t file;
 
-    Token(int line = 0,
+    Token(uint32_t offset = 0,
           const std::string& text = "",
           TokenType type = INVALID,
           bool error = false)
-        : line(line), text(text), type(type), error(error) {}
+        : offset(offset), constant(0), text(text), type(type), error(error),
+          symbol(0), file(0) {}
 };
 std::string tokenTypeToString(TokenType t);
 
+static_assert(EOF_TOKEN < 64, "token kinds must fit in a uint64_t mask");
+
+constexpr uint64_t tokenMask(TokenType type) { return 1ull << type; }
+
+constexpr bool inMask(TokenType type, uint64_t mask) {
+    return (mask >> type) & 1;
+}
+
+constexpr uint64_t DATA_TYPE_TOKENS =
+    tokenMask(INTEGER) | tokenMask(SINTEGER) | tokenMask(CHARACTER) |
+    tokenMask(STRING) | tokenMask(FLOAT) | tokenMask(SFLOAT) |
+    tokenMask(VOID) | tokenMask(STRUCT);
+constexpr uint64_t BRACE_TOKENS =
+    tokenMask(LEFT_PAREN) | tokenMask(RIGHT_PAREN) | tokenMask(LEFT_BRACE) |
+    tokenMask(RIGHT_BRACE) | tokenMask(LEFT_BRACKET) |
+    tokenMask(RIGHT_BRACKET);
+constexpr uint64_t ADD_OP_TOKENS = tokenMask(PLUS) | tokenMask(MINUS);
+constexpr uint64_t MUL_OP_TOKENS = tokenMask(STAR) | tokenMask(SLASH);
+constexpr uint64_t CONDITION_TOKENS = tokenMask(CONDITION) | tokenMask(OTHERWISE);
+constexpr uint64_t LOOP_TOKENS = tokenMask(LOOP) | tokenMask(REITERATE);
+
+constexpr bool isDataTypeToken(TokenType type) {
+    return inMask(type, DATA_TYPE_TOKENS);
+}
+constexpr bool isBraceToken(TokenType type) {
+    return inMask(type, BRACE_TOKENS);
+}
+constexpr bool isAddOpToken(TokenType type) {
+    return inMask(type, ADD_OP_TOKENS);
+}
+constexpr bool isMulOpToken(TokenType type) {
+    return inMask(type, MUL_OP_TOKENS);
+}
+
+// A comment, kept out of the token stream the parser reads. `before` is the
+// index of the token that follows it, which is where the token table prints
+// it.
+struct Trivia {
+    uint32_t before;
+    Token token;
+};
+
+// The lexer builds a token vector once; after that it is shared read-only.
+using TokenBuffer = std::shared_ptr<const std::vector<Token>>;
+
+// Non-owning view over contiguous tokens.
+class TokenSpan {
+public:
+    TokenSpan() : first(nullptr), count(0) {}
+    TokenSpan(const std::vector<Token>& tokens)
+        : first(tokens.data()), count(tokens.size()) {}
+
+    const Token& operator[](size_t i) const { return first[i]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const Token* begin() const { return first; }
+    const Token* end() const { return first + count; }
+
+private:
+    const Token* first;
+    size_t count;
+};
+
 #endif
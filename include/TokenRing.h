@@ -0,0 +1,35 @@
+#ifndef TOKEN_RING_H
+#define TOKEN_RING_H
+
+#include "Token.h"
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <vector>
+
+// Bounded single-producer/single-consumer ring of token batches. The lexer
+// thread pushes, the parser thread pops, and neither side takes a lock.
+class TokenRing {
+public:
+  explicit TokenRing(size_t capacity = 64);
+
+  // Blocks while the ring is full. Returns false if the consumer cancelled.
+  bool push(std::vector<Token> &&batch);
+  // Blocks while the ring is empty. Returns false once closed and drained.
+  bool pop(std::vector<Token> &batch);
+
+  void close(std::exception_ptr error = nullptr);
+  void cancel();
+  std::exception_ptr error() const;
+
+private:
+  std::vector<std::vector<Token>> slots;
+  size_t mask;
+  alignas(64) std::atomic<size_t> head;
+  alignas(64) std::atomic<size_t> tail;
+  std::atomic<bool> closed;
+  std::atomic<bool> cancelled;
+  std::exception_ptr failure;
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstddef>
+
+// Length of the well-formed UTF-8 sequence at the start of `data`, or 0 if
+// it is not one: overlong forms, surrogates and code points past U+10FFFF
+// are rejected. At most `size` bytes are read.
+size_t utf8SequenceLength(const char *data, size_t size);
+
+// Length of the longest prefix of `data` that is valid UTF-8; `size` when it
+// all is. On x86 CPUs with SSSE3 multi-byte text is validated 16 bytes at a
+// time as well as ASCII, and the scalar decoder only runs to pin down an
+// error. Elsewhere runs of ASCII are skipped 16 bytes at a time with SSE2, or
+// 8 at a time in a 64-bit word, and other bytes are decoded one sequence at a
+// time.
+size_t validUtf8Prefix(const char *data, size_t size);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef VM_H
+#define VM_H
+
+#include "Bytecode.h"
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class RuntimeError : public std::runtime_error {
+public:
+  explicit RuntimeError(const std::string &message)
+      : std::runtime_error(message) {}
+};
+
+// Runs bytecode. Dispatch is threaded through a table of label addresses
+// where the compiler supports it, and a plain switch otherwise.
+class VM {
+public:
+  explicit VM(const Bytecode &bytecode);
+  // Runs the global initializer and then main; returns main's result.
+  Value run();
+  uint64_t getInstructionCount() const;
+
+private:
+  static const size_t STACK_SLOTS = 1 << 20;
+  static const size_t MAX_FRAMES = 1 << 18;
+  static const size_t HEAP_LIMIT = size_t(1) << 25;
+
+  struct Frame {
+    const Function *function;
+    const Instruction *pc;
+    Value *base;
+    size_t heapTop;
+  };
+
+  const Bytecode &bytecode;
+  std::vector<Value> constants;
+  std::vector<Value> globals;
+  std::vector<Value> stack;
+  // Objects are a length slot followed by their slots; a reference is the
+  // index of the first slot, so 0 is never a valid one.
+  std::vector<Value> heap;
+  uint64_t executed = 0;
+
+  Value execute(int entry);
+  int64_t allocate(size_t slots);
+  size_t slot(int64_t ref, int64_t index, const Function *function) const;
+  [[noreturn]] void fail(const std::string &message,
+                         const Function *function) const;
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include "Project.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Rebuilds a project each time one of its files is saved, until the process
+// is interrupted. Directories are watched rather than files, because many
+// editors save by writing a new file and renaming it over the old one. A
+// burst of events is collected until the directory has been quiet for
+// DEBOUNCE_MS, then only the affected entries are recompiled.
+//
+// Needs inotify, so it only works on Linux.
+class Watcher {
+public:
+  Watcher(Project &project, unsigned int threads);
+  // Returns false if the files cannot be watched.
+  bool run();
+
+private:
+  static const int DEBOUNCE_MS = 3;
+
+  Project &project;
+  unsigned int threads;
+  int fd = -1;
+  // Watch descriptor to directory.
+  std::unordered_map<int, std::string> directories;
+  // Directory and name to the project's spellings of that file.
+  std::unordered_map<std::string, std::vector<std::string>> files;
+
+  bool watchFiles();
+  void readEvents(std::vector<std::string> &changed);
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef X86_EMITTER_H
+#define X86_EMITTER_H
+
+#include "IR.h"
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Writes a whole program as x86-64 assembly for GNU as, in Intel syntax: one
+// routine per IR function, a small runtime and a _start that runs the global
+// initializer and main and prints main's result. Calls follow the System V
+// ABI; runtime errors are reported the way the VM reports them.
+//
+// Registers are assigned per function by linear scan over live intervals
+// taken from the IR's block liveness. Values live across a call only get
+// callee-saved registers; the rest are spilled to the frame.
+class X86Emitter {
+public:
+  // `module` must have liveness computed.
+  explicit X86Emitter(const IrModule &module);
+  void emit(std::ostream &out);
+
+private:
+  // A register number as x86 encodes it, or a frame slot.
+  struct Location {
+    int reg = -1;
+    int slot = -1;
+  };
+
+  struct Interval {
+    uint32_t value;
+    uint32_t start;
+    uint32_t end;
+    bool crossesCall;
+  };
+
+  const IrModule &module;
+  std::ostream *out = nullptr;
+  // Constant index to string literal index.
+  std::unordered_map<uint32_t, size_t> strings;
+
+  // Per function.
+  size_t index = 0;
+  const IrFunction *function = nullptr;
+  std::vector<Location> locations;
+  std::vector<int> savedRegisters;
+  int slots = 0;
+  unsigned int labels = 0;
+
+  void allocateRegisters();
+  std::string operand(uint32_t value) const;
+  std::string slotAddress(int slot) const;
+  std::string blockLabel(uint32_t block) const;
+  std::string label(const char *what) const;
+  bool sameLocation(uint32_t a, uint32_t b) const;
+  bool inRegister(uint32_t value) const;
+
+  void emitFunction();
+  void emitPrologue();
+  void emitInstr(const IrInstr &instr);
+  void emitArithmetic(const IrInstr &instr);
+  void emitCompare(const IrInstr &instr, bool fused);
+  void emitSlotAddress(const IrInstr &instr);
+  void emitCall(const IrInstr &instr);
+  void emitTerminator(const IrBlock &block, uint32_t b, bool fused);
+  void emitStart();
+  void emitRuntime();
+  void emitData();
+};
+
+// Assembles `assembly` with the system `as` and links the object into the
+// executable `output` with `ld`. On failure `error` says which step failed.
+bool assembleAndLink(const std::string &assembly, const std::string &output,
+                     std::string &error);
+
+#endif
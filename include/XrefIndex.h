@@ -0,0 +1,115 @@
+#ifndef XREF_INDEX_H
+#define XREF_INDEX_H
+
+#include "SymbolTable.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// On-disk cross-reference index: where every function, struct, variable,
+// parameter and member is declared and used. The file is a header followed
+// by four arrays, all in native byte order so it can be used straight from a
+// read-only mapping:
+//   files     sorted by path, with the content hash each was indexed at
+//   names     sorted by text, each a run of postings
+//   postings  by name, then file, line and column
+//   strings   paths and names, not terminated
+struct XrefHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t files;
+  uint32_t names;
+  uint32_t postings;
+  uint32_t stringBytes;
+  // XREF_ options the postings were built with.
+  uint32_t flags;
+};
+
+const uint32_t XREF_UNICODE_IDENTIFIERS = 1;
+
+struct XrefFile {
+  uint64_t hash;
+  uint32_t path;
+  uint32_t pathLength;
+};
+
+struct XrefName {
+  uint32_t text;
+  uint32_t length;
+  uint32_t first;
+  uint32_t count;
+};
+
+struct XrefPosting {
+  uint32_t file;
+  uint32_t line;
+  uint32_t column;
+  uint32_t kind;
+};
+
+const char *referenceKindName(ReferenceKind kind);
+
+// Read-only view of an index file. Opening maps the file and checks the
+// header; a lookup is a binary search over the names that only touches the
+// pages it reads.
+class XrefIndex {
+public:
+  XrefIndex() = default;
+  ~XrefIndex();
+  XrefIndex(const XrefIndex &) = delete;
+  XrefIndex &operator=(const XrefIndex &) = delete;
+
+  // False if there is no such file or it is not a valid index.
+  bool open(const std::string &path);
+  void close();
+
+  // The postings of `name`, empty if it does not occur anywhere.
+  const XrefPosting *lookup(std::string_view name, size_t &count) const;
+  std::string_view filePath(uint32_t file) const;
+  uint64_t fileHash(uint32_t file) const;
+  uint32_t getFlags() const;
+  size_t fileCount() const;
+  size_t nameCount() const;
+  size_t postingCount() const;
+  std::string_view nameText(size_t name) const;
+  const XrefPosting *namePostings(size_t name, size_t &count) const;
+
+private:
+  const char *data = nullptr;
+  size_t size = 0;
+  // Set when the file could not be mapped and was read instead.
+  std::string copy;
+  const XrefHeader *header = nullptr;
+  const XrefFile *files = nullptr;
+  const XrefName *names = nullptr;
+  const XrefPosting *postings = nullptr;
+  const char *strings = nullptr;
+
+  std::string_view text(uint32_t offset, uint32_t length) const;
+};
+
+struct XrefStats {
+  size_t files = 0;
+  // Files that were new or changed and had to be parsed.
+  size_t parsed = 0;
+  // Entries and includes that could not be read.
+  size_t missing = 0;
+  size_t names = 0;
+  size_t postings = 0;
+};
+
+// Brings the index at `path` up to date with `entries` and everything they
+// include. Each file's references depend only on its own text, so a file
+// whose hash is unchanged keeps its postings from the old index and only
+// new or changed files are parsed, each on its own. Files of the old index
+// that are not reached this time keep their postings as they were, so an
+// update can be given just the files that changed; one is dropped only once
+// it is gone from disk. The new index is written beside the old one and
+// renamed over it, so readers holding the old mapping are not disturbed.
+XrefStats updateXrefIndex(const std::string &path,
+                          const std::vector<std::string> &entries,
+                          bool unicodeIdentifiers);
+
+#endif
@@ -1,8 +1,19 @@
 #ifndef HELPERS_H
 #define HELPERS_H
 
+#include <stdexcept>
 #include <string>
 
-std::string readFile(const std::string &fileName);  // Only the declaration
+// Thrown by readFile, so that a program embedding the compiler decides what
+// a missing file means instead of being ended by it.
+class FileError : public std::runtime_error {
+public:
+  explicit FileError(const std::string &fileName)
+      : std::runtime_error("Unable to open file \"" + fileName + "\""),
+        fileName(fileName) {}
+  std::string fileName;
+};
+
+std::string readFile(const std::string &fileName);
 
 #endif
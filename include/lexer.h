@@ -1,36 +1,118 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include "SourceMap.h"
 #include "Token.h"
+#include <functional>
 #include <string>
-#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+struct Prelude;
+class TokenRing;
+
 class Lexer {
 public:
+  // Supplies the contents of an included file; returns false if there is no
+  // such file.
+  using IncludeResolver =
+      std::function<bool(const std::string &path, std::string &contents)>;
+
   Lexer() = default;
-  explicit Lexer(const std::string &sourceCode);
+  explicit Lexer(std::string sourceCode);
+  // Registers the source in an existing map, as included files do.
+  Lexer(std::string sourceCode, std::shared_ptr<SourceMap> sources);
+  // Takes over the ID of a file already in the map, for a new version of it.
+  Lexer(std::string sourceCode, std::shared_ptr<SourceMap> sources,
+        uint16_t file);
   std::vector<Token> tokenize();
+  // The same into `tokens`, which is cleared first but keeps its capacity.
+  void tokenize(std::vector<Token> &tokens);
+  // The same, with the comments going into `trivia`, which is also cleared
+  // first and keeps its capacity.
+  void tokenize(std::vector<Token> &tokens, std::vector<Trivia> &trivia);
+  // Only this file's tokens: include directives are kept but not expanded,
+  // and there is no EOF token. Project mode splices included files itself.
+  std::vector<Token> tokenizeSource();
+  // The comments the last tokenize call found, in order, each with the
+  // index of the token it precedes.
+  std::vector<Trivia> releaseTrivia();
+  // When set, tokenize() publishes batches to the ring as it goes instead of
+  // collecting them for its return value.
+  void setStream(TokenRing *ring);
+  // Stop lexing after this many error tokens; 0 means no limit.
+  void setMaxErrors(size_t limit);
+  // Let identifiers contain any non-ASCII character, as UTF-8. Off by
+  // default, when such bytes outside strings and comments are errors.
+  void setUnicodeIdentifiers(bool enabled);
+  // Included files are read from disk unless this is set. An include the
+  // resolver cannot supply is left out and its file token marked.
+  void setIncludeResolver(IncludeResolver resolver);
+  size_t getErrorCount() const;
+  const std::string &getSource() const;
+  // About how many tokens the source has, without its includes; at least as
+  // many for typical code.
+  size_t expectedTokens() const;
+  std::shared_ptr<const SourceMap> getSources() const;
+  // This file's ID in the source map.
+  uint16_t getFile() const;
+  // Records the path of this file in the source map. Included files get
+  // theirs from the include directive.
+  void setFileName(const std::string &name);
+  // Files named by include directives, without lexing the whole source.
+  std::vector<std::string> scanIncludes();
+  // The file named by an include's string literal token.
+  static std::string includePath(const std::string &literal);
+
+  static const unsigned int MAX_INCLUDE_DEPTH = 256;
 
 private:
+  static const size_t STREAM_BATCH = 256;
+
   std::string source;
   size_t pos;
-  int line;
+  std::shared_ptr<SourceMap> sources;
+  uint16_t file = 0;
+  TokenRing *stream = nullptr;
+  size_t max_errors = 0;
+  size_t error_count = 0;
+  // Tokens already handed to the stream, for the indices of trivia.
+  size_t published = 0;
+  std::vector<Trivia> trivia;
+  bool unicode_identifiers = false;
+  // The source is valid UTF-8 up to here.
+  size_t utf8_valid = 0;
   std::vector<Token> tokens;
-  std::unordered_map<std::string, std::string> keywords;
+  std::vector<TokenType> keywordTypes;
   std::unordered_set<std::string> includedFiles;
+  IncludeResolver resolver;
+  // Includes the resolver could not supply, or that would not fit in the
+  // source map.
+  std::unordered_set<std::string> missing;
 
   char peek(int n = 0);
   char get();
   void skipWhitespace();
-  TokenType TokenTypeFromString(const std::string &typeStr);
   Token lexIdentifierOrKeyword();
   Token lexNumber();
   Token lexString();
   Token lexChar();
   Token lexOperatorOrPunctuation();
-  std::vector<Token> lexComment();
+  Token lexNonAscii();
+  static uint32_t decodeNumber(const std::string &text, bool isFloat);
+  size_t identLength(size_t at) const;
+  bool validText(size_t start, size_t end) const;
+  size_t countComments() const;
+  void lexComment(const std::vector<Token> &tokens);
+  bool lexFile(std::vector<Token> &tokens,
+               std::unordered_set<std::string> &active, unsigned int depth);
+  bool lexSource(std::vector<Token> &tokens,
+                 const std::unordered_set<std::string> &active,
+                 unsigned int depth);
+  bool lexPrelude(const Prelude &prelude, std::vector<Token> &tokens);
+  bool publish(std::vector<Token> &tokens);
+  void emit(std::vector<Token> &tokens, Token token);
+  void emitTrivia(const std::vector<Token> &tokens, Token token);
 };
 
 #endif
@@ -2,79 +2,196 @@
 
 #include <string>
 #include <vector>
-#include <fstream>
+#include <ostream>
+#include "ParserSink.h"
+#include "SourceMap.h"
+#include "SymbolTable.h"
 #include "Token.h"
 
-class Parser {
+class TokenRing;
+
+// Sink decides what happens to reports; see ParserSink.h. The parser is
+// explicitly instantiated for each sink in parser.cpp.
+template <typename Sink>
+class BasicParser {
 private:
-    std::vector<Token> tokens;
-    Token current_token;
+    Sink sink;
+    TokenBuffer buffer;
+    // Only used in pipelined mode, where the parser collects the batches.
+    std::vector<Token> streamed;
+    TokenSpan tokens;
+    TokenRing *stream;
+    const Token *current_token;
     unsigned int token_index;
-    unsigned int line_count;
-    unsigned int slow_count;
     unsigned int error_count;
     bool in_function_scope;
-    std::vector<string> output_lines;
+
+    struct PendingCall {
+        uint32_t name;
+        uint32_t offset;
+        uint16_t file;
+        std::string text;
+    };
+    SymbolTable symbols;
+    std::vector<PendingCall> pending_calls;
+    unsigned int semantic_error_count;
+    // Tokens below this index were already checked, so that a rule that
+    // re-reads tokens does not report them twice.
+    unsigned int checked_index;
+    uint32_t current_struct;
+    uint32_t member_owner;
+    // Declarations and uses are appended here when set.
+    std::vector<Reference> *references;
+    // Like checked_index, for the member names after "->".
+    unsigned int referenced_member;
+
+    unsigned int max_errors;
+    long last_error_index;
+    // Set by throwError and cleared once the grammar accepts a token again.
+    // Errors in between are a cascade of the first and are not reported.
+    bool panic_mode;
+    // Recursion depth of the rules that can nest; see enterNesting.
+    static const unsigned int MAX_NESTING = 1024;
+    unsigned int depth;
+    bool aborted;
+    // The file being compiled, whose reports need no path: the one the EOF
+    // token is in, or in pipelined mode the first file the lexer added.
+    uint16_t main_file;
+    Token eof_token;
+
+    // parseExpression only knows that it read an assignment target once it
+    // reaches the '=' after it. Until then the reports are held back here,
+    // and if there is no '=', they are dropped along with everything else
+    // the attempt changed, and the tokens are parsed again as a value.
+    struct HeldReport {
+        ReportKind kind;
+        uint16_t file;
+        std::string path;
+        uint32_t line;
+        uint32_t column;
+        std::string message;
+    };
+    struct Checkpoint {
+        unsigned int token_index;
+        unsigned int error_count;
+        unsigned int semantic_error_count;
+        unsigned int checked_index;
+        unsigned int referenced_member;
+        uint32_t member_owner;
+        long last_error_index;
+        bool panic_mode;
+        bool speculating;
+        size_t pending_calls;
+        size_t references;
+        size_t held;
+    };
+    std::vector<HeldReport> held;
+    bool speculating;
+    Checkpoint speculate();
+    void keep(const Checkpoint &checkpoint);
+    void undo(const Checkpoint &checkpoint);
+
+    std::shared_ptr<const SourceMap> sources;
+    void report(ReportKind kind, uint16_t file, uint32_t offset,
+                const std::string &message);
+    // At the current token.
+    void report(ReportKind kind, const std::string &message);
+    void rule(const char *name);
+    void moveToEof();
+    bool errorLimitReached() const;
+    void abortParse(const std::string &note);
+    bool enterNesting();
 
     bool isDataType(TokenType token);
     bool isStartOfStatement(TokenType type);
     bool isStartsOfLine(TokenType token);
     void nextToken();
-    void throwError(std::ofstream& out);
-
-    void parseDeclarations(std::ofstream& out);
-    void parseDeclarationList(std::ofstream& out);
-    void parseDeclaration(std::ofstream& out);
-    void parseStructDec(std::ofstream& out);
-    void parseVarDec(std::ofstream& out, bool isStruct);
-    void parseTypeSpecifier(std::ofstream& out);
-    void parseFunDec(std::ofstream& out);
-    void parseParams(std::ofstream& out);
-    void parseParamList(std::ofstream& out);
-    void parsePList(std::ofstream& out);
-    void parseParam(std::ofstream& out);
-
-    void parseCompoundStmt(std::ofstream& out);
-    void parseLocalDecs(std::ofstream& out);
-    void parseStmtList(std::ofstream& out);
-    void parseStatement(std::ofstream& out);
-    void parseExpressionStmt(std::ofstream& out);
-    void parseSelectionStmt(std::ofstream& out);
-    void parseIterationStmt(std::ofstream& out);
-    void parseJumpStmt(std::ofstream& out);
-
-    void parseExpression(std::ofstream& out);
-    void parseIdAssign(std::ofstream& out);
-    void parseSimpleExpression(std::ofstream& out);
-    void parseRelop(std::ofstream& out);
-    void parseAdditiveExpression(std::ofstream& out);
-    void parseAdditiveExpressionPrime(std::ofstream& out);
-    void parseAddOp(std::ofstream& out);
-    void parseTerm(std::ofstream& out);
-    void parseMulOp(std::ofstream& out);
-    void parseTermPrime(std::ofstream& out);
-    void parseFactor(std::ofstream& out);
-    void parseCall(std::ofstream& out);
-    void parseArgs(std::ofstream& out);
-    void parseArgList(std::ofstream& out);
-    void parseAList(std::ofstream& out);
-
-    void parseNum(std::ofstream& out);
-    void parseUnsignedNum(std::ofstream& out);
-    void parseSignedNum(std::ofstream& out);
-    void parsePosNum(std::ofstream& out);
-    void parseNegNum(std::ofstream& out);
-    void parseValue(std::ofstream& out);
-
-    void parseComment(std::ofstream& out);
-    void parseIncludeCommand(std::ofstream& out);
-    void parseFName(std::ofstream& out);
-  int getNum(const std::string &s);
+    void advance();
+    bool fetchBatch();
+    const Token &peekToken();
+
+    bool firstVisit();
+    template <typename... Parts>
+    void semanticError(const Parts &...parts);
+    void declareName(const Token &name, SymbolKind kind, uint32_t type = 0);
+    void checkIdentifierUse();
+    void checkStructType(const Token &name);
+    void recordReference(const Token &name, ReferenceKind kind);
+    void recordMemberUse();
+    void checkPendingCalls();
+    void throwError();
+
+    void parseDeclarations();
+    void parseDeclarationList();
+    void parseDeclaration();
+    void parseStructDec();
+    void parseVarDec(bool isStruct);
+    void parseTypeSpecifier();
+    void parseFunDec();
+    void parseParams();
+    void parseParamList();
+    void parsePList();
+    void parseParam();
+
+    void parseCompoundStmt();
+    void parseLocalDecs();
+    void parseStmtList();
+    void parseStatement();
+    void parseExpressionStmt();
+    void parseSelectionStmt();
+    void parseIterationStmt();
+    void parseJumpStmt();
+
+    void parseExpression();
+    void parseIdAssign();
+    void parseSimpleExpression();
+    void parseRelop();
+    void parseAdditiveExpression();
+    void parseAdditiveExpressionPrime();
+    void parseAddOp();
+    void parseTerm();
+    void parseMulOp();
+    void parseTermPrime();
+    void parseFactor();
+    void parseCall();
+    void parseArgs();
+    void parseArgList();
+    void parseAList();
+
+    void parseNum();
+    void parseUnsignedNum();
+    void parseSignedNum();
+    void parsePosNum();
+    void parseNegNum();
+    void parseValue();
+
+    void parseIncludeCommand();
+    void parseFName();
 
 public:
-    Parser();
-  void setTokens(const std::vector<Token> &input_tokens);
-    void printParserOutput(std::ofstream &out);
-    int parse(std::ofstream& out);
+    explicit BasicParser(Sink sink = Sink());
+    // current_token points into the parser itself, so it cannot be copied.
+    BasicParser(const BasicParser &) = delete;
+    BasicParser &operator=(const BasicParser &) = delete;
+    // Used to turn token offsets into line:column for the report.
+    void setSources(std::shared_ptr<const SourceMap> sources);
+    void setTokens(TokenBuffer buffer);
+    // `expected` tokens are reserved for the batches the parser collects.
+    void setTokenStream(TokenRing &ring, size_t expected = 0);
+    void drainTokenStream();
+    TokenBuffer releaseTokens();
+    Sink &getSink() { return sink; }
+    // Buffered reports go to console and to out; streaming sinks wrote
+    // theirs already.
+    void printParserOutput(std::ostream &console, std::ostream &out);
+    int parse();
     unsigned int getErrorCount() const;
+    unsigned int getSemanticErrorCount() const;
+    // Stop parsing once this many errors were reported; 0 means no limit.
+    void setMaxErrors(unsigned int limit);
+    bool wasAborted() const;
+    // Collect every declaration and identifier use into `references`.
+    void setReferences(std::vector<Reference> *references);
 };
+
+using Parser = BasicParser<TextSink>;
@@ -0,0 +1,136 @@
+#include "AllocStats.h"
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+
+namespace {
+
+thread_local AllocPhase current_phase = PHASE_OTHER;
+
+} // namespace
+
+#ifdef COMPILER_ALLOC_STATS
+
+namespace {
+
+struct PhaseCounters {
+  std::atomic<size_t> allocations{0};
+  std::atomic<size_t> bytes{0};
+  std::atomic<size_t> peak_live{0};
+  std::atomic<size_t> large{0};
+};
+
+// Buffers that scale with the source, like the token vector, are the only
+// allocations this big; see printAllocationStats.
+const size_t LARGE_ALLOCATION = 16 * 1024;
+
+// Every block carries a header with its size, so frees can be subtracted
+// from the live total. The header keeps malloc's 16-byte alignment.
+struct alignas(16) BlockHeader {
+  size_t size;
+  bool tracked;
+};
+
+std::atomic<bool> tracking{false};
+std::atomic<size_t> live_bytes{0};
+PhaseCounters counters[PHASE_COUNT];
+
+const char *const phaseNames[PHASE_COUNT] = {"other",   "read",  "lex",
+                                             "include", "parse", "report"};
+
+void *allocate(size_t size) {
+  void *raw = std::malloc(sizeof(BlockHeader) + (size ? size : 1));
+  if (raw == nullptr)
+    return nullptr;
+  BlockHeader *header = static_cast<BlockHeader *>(raw);
+  header->size = size;
+  header->tracked = tracking.load(std::memory_order_relaxed);
+  if (header->tracked) {
+    PhaseCounters &phase = counters[current_phase];
+    phase.allocations.fetch_add(1, std::memory_order_relaxed);
+    phase.bytes.fetch_add(size, std::memory_order_relaxed);
+    if (size >= LARGE_ALLOCATION)
+      phase.large.fetch_add(1, std::memory_order_relaxed);
+    size_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = phase.peak_live.load(std::memory_order_relaxed);
+    while (live > peak && !phase.peak_live.compare_exchange_weak(
+                              peak, live, std::memory_order_relaxed)) {
+    }
+  }
+  return header + 1;
+}
+
+void release(void *ptr) {
+  if (ptr == nullptr)
+    return;
+  BlockHeader *header = static_cast<BlockHeader *>(ptr) - 1;
+  if (header->tracked)
+    live_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+  std::free(header);
+}
+
+void *allocateOrThrow(size_t size) {
+  void *ptr = allocate(size);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+} // namespace
+
+void *operator new(size_t size) { return allocateOrThrow(size); }
+void *operator new[](size_t size) { return allocateOrThrow(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+void operator delete(void *ptr) noexcept { release(ptr); }
+void operator delete[](void *ptr) noexcept { release(ptr); }
+void operator delete(void *ptr, size_t) noexcept { release(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { release(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  release(ptr);
+}
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+  release(ptr);
+}
+
+void enableAllocationTracking() { tracking.store(true); }
+
+void printAllocationStats(std::ostream &os) {
+  os << "\n" << std::left << std::setw(10) << "Phase" << std::right
+     << std::setw(12) << "Allocs" << std::setw(16) << "Bytes"
+     << std::setw(16) << "Peak live" << "\n";
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    os << std::left << std::setw(10) << phaseNames[i] << std::right
+       << std::setw(12) << counters[i].allocations.load() << std::setw(16)
+       << counters[i].bytes.load() << std::setw(16)
+       << counters[i].peak_live.load() << "\n";
+  }
+  // Each buffer that grows with the input should be allocated once, so
+  // these counts stay the same however large the source is.
+  os << "Allocations of " << LARGE_ALLOCATION / 1024 << " KiB or more:";
+  for (int i = 0; i < PHASE_COUNT; i++)
+    os << (i == 0 ? " " : ", ") << phaseNames[i] << " "
+       << counters[i].large.load();
+  os << "\n" << std::left;
+}
+
+#else
+
+void enableAllocationTracking() {}
+
+void printAllocationStats(std::ostream &os) {
+  os << "\nAllocation counts need a build with COMPILER_ALLOC_STATS defined\n";
+}
+
+#endif
+
+PhaseScope::PhaseScope(AllocPhase phase) : previous(current_phase) {
+  current_phase = phase;
+}
+
+PhaseScope::~PhaseScope() { current_phase = previous; }
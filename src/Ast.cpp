@@ -0,0 +1,513 @@
+#include "Ast.h"
+#include "ConstantPool.h"
+#include "Interner.h"
+
+AstBuilder::AstBuilder(TokenSpan span) : eof(0, "", EOF_TOKEN, false) {
+  tokens.reserve(span.size());
+  for (const Token &token : span) {
+    if (token.type != EOF_TOKEN)
+      tokens.push_back(&token);
+  }
+  if (!tokens.empty()) {
+    eof.offset = tokens.back()->offset;
+    eof.file = tokens.back()->file;
+  }
+}
+
+const Token &AstBuilder::current() const {
+  return pos < tokens.size() ? *tokens[pos] : eof;
+}
+
+const Token &AstBuilder::peek(size_t n) const {
+  return pos + n < tokens.size() ? *tokens[pos + n] : eof;
+}
+
+void AstBuilder::next() {
+  if (pos < tokens.size())
+    pos++;
+}
+
+void AstBuilder::expect(TokenType type, const char *what) {
+  if (current().type != type)
+    fail(std::string("expected ") + what);
+  next();
+}
+
+void AstBuilder::fail(const std::string &message) const {
+  const Token &token = current();
+  throw CompileError(message + " at '" + token.text + "'", token.offset,
+                     token.file);
+}
+
+// One more level of binary or assignment nodes above whatever is parsed next.
+// Callers undo it once their node is complete.
+void AstBuilder::deepen() {
+  if (++height > MAX_HEIGHT)
+    fail("expression is more than " + std::to_string(MAX_HEIGHT) +
+         " operators deep");
+}
+
+std::unique_ptr<Expr> AstBuilder::node(ExprKind kind) const {
+  std::unique_ptr<Expr> expr(new Expr());
+  expr->kind = kind;
+  expr->offset = current().offset;
+  expr->file = current().file;
+  return expr;
+}
+
+bool AstBuilder::atType() const {
+  switch (current().type) {
+  case INTEGER:
+  case SINTEGER:
+  case CHARACTER:
+  case STRING:
+  case FLOAT:
+  case SFLOAT:
+  case VOID:
+  case STRUCT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+TypeRef AstBuilder::parseType() {
+  TypeRef type;
+  switch (current().type) {
+  case INTEGER:
+  case SINTEGER:
+    type.kind = TYPE_INT;
+    type.narrow = current().type == SINTEGER;
+    break;
+  case FLOAT:
+  case SFLOAT:
+    type.kind = TYPE_FLOAT;
+    type.narrow = current().type == SFLOAT;
+    break;
+  case CHARACTER:
+    type.kind = TYPE_CHAR;
+    break;
+  case STRING:
+    type.kind = TYPE_STRING;
+    break;
+  case VOID:
+    type.kind = TYPE_VOID;
+    break;
+  case STRUCT:
+    type.kind = TYPE_STRUCT;
+    break;
+  default:
+    fail("expected a type");
+  }
+  next();
+  return type;
+}
+
+Program AstBuilder::build() {
+  Program program;
+  while (current().type != EOF_TOKEN) {
+    if (current().type == INCLUSION) {
+      // The included tokens are already spliced in front of the directive.
+      next();
+      next();
+      expect(SEMICOLON, "';'");
+      continue;
+    }
+    TypeRef type = parseType();
+    if (type.kind == TYPE_STRUCT) {
+      const Token &name = current();
+      expect(IDENTIFIER, "a struct name");
+      if (current().type == LEFT_BRACE) {
+        parseStruct(program, name);
+        continue;
+      }
+      type.structName = name.symbol;
+    }
+    const Token &name = current();
+    if (name.type != IDENTIFIER)
+      fail("expected a name");
+    if (peek().type == LEFT_PAREN) {
+      uint32_t symbol = name.symbol;
+      next();
+      program.functions.push_back(parseFunction(type, symbol));
+    } else {
+      program.globals.push_back(parseVarRest(type));
+    }
+  }
+  return program;
+}
+
+void AstBuilder::parseStruct(Program &program, const Token &name) {
+  StructDecl decl;
+  decl.name = name.symbol;
+  decl.offset = name.offset;
+  decl.file = name.file;
+  expect(LEFT_BRACE, "'{'");
+  while (atType()) {
+    TypeRef type = parseType();
+    if (type.kind == TYPE_STRUCT) {
+      type.structName = current().symbol;
+      expect(IDENTIFIER, "a struct name");
+    }
+    decl.fields.push_back(parseVarRest(type));
+  }
+  expect(RIGHT_BRACE, "'}'");
+  expect(SEMICOLON, "';'");
+  program.structs.push_back(std::move(decl));
+}
+
+// Everything after the type: [*]name [= init] [[size]] ;
+VarDecl AstBuilder::parseVarRest(TypeRef type) {
+  VarDecl decl;
+  if (current().type == STAR) {
+    type.pointer = true;
+    next();
+  }
+  decl.type = type;
+  decl.offset = current().offset;
+  decl.file = current().file;
+  decl.name = current().symbol;
+  expect(IDENTIFIER, "a variable name");
+  if (current().type == ASSIGNMENT_OP) {
+    next();
+    decl.init = parseExpression();
+  }
+  if (current().type == LEFT_BRACKET) {
+    next();
+    if (current().type != CONSTANT)
+      fail("expected an array size");
+    Constant size = ConstantPool::current().get(current().constant);
+    if (size.kind != LITERAL_IMW)
+      fail("array size must be an integer");
+    if (size.intValue <= 0)
+      fail("array size must be positive");
+    if (size.intValue > UINT32_MAX)
+      fail("array size is too large");
+    decl.arraySize = static_cast<uint32_t>(size.intValue);
+    next();
+    expect(RIGHT_BRACKET, "']'");
+  }
+  expect(SEMICOLON, "';'");
+  return decl;
+}
+
+FunctionDecl AstBuilder::parseFunction(TypeRef type, uint32_t name) {
+  FunctionDecl decl;
+  decl.returnType = type;
+  decl.name = name;
+  decl.offset = current().offset;
+  decl.file = current().file;
+  expect(LEFT_PAREN, "'('");
+  if (current().type == VOID && peek().type == RIGHT_PAREN) {
+    next();
+  } else if (atType()) {
+    while (true) {
+      VarDecl param;
+      param.type = parseType();
+      if (param.type.kind == TYPE_STRUCT) {
+        param.type.structName = current().symbol;
+        expect(IDENTIFIER, "a struct name");
+      }
+      param.offset = current().offset;
+      param.file = current().file;
+      param.name = current().symbol;
+      expect(IDENTIFIER, "a parameter name");
+      decl.params.push_back(std::move(param));
+      if (current().type != COMMA)
+        break;
+      next();
+    }
+  }
+  expect(RIGHT_PAREN, "')'");
+  decl.body = parseBlock();
+  return decl;
+}
+
+std::unique_ptr<Stmt> AstBuilder::parseBlock() {
+  std::unique_ptr<Stmt> block(new Stmt());
+  block->kind = STMT_BLOCK;
+  block->offset = current().offset;
+  block->file = current().file;
+  expect(LEFT_BRACE, "'{'");
+  while (current().type != RIGHT_BRACE) {
+    if (current().type == EOF_TOKEN)
+      fail("expected '}'");
+    if (atType())
+      block->body.push_back(parseVarStatement());
+    else
+      block->body.push_back(parseStatement());
+  }
+  next();
+  return block;
+}
+
+std::unique_ptr<Stmt> AstBuilder::parseVarStatement() {
+  std::unique_ptr<Stmt> stmt(new Stmt());
+  stmt->kind = STMT_VAR;
+  stmt->offset = current().offset;
+  stmt->file = current().file;
+  TypeRef type = parseType();
+  if (type.kind == TYPE_STRUCT) {
+    type.structName = current().symbol;
+    expect(IDENTIFIER, "a struct name");
+  }
+  stmt->var = parseVarRest(type);
+  return stmt;
+}
+
+std::unique_ptr<Stmt> AstBuilder::parseStatement() {
+  std::unique_ptr<Stmt> stmt(new Stmt());
+  stmt->offset = current().offset;
+  stmt->file = current().file;
+  const Token &token = current();
+  switch (token.type) {
+  case CONDITION:
+  case OTHERWISE:
+    stmt->kind = STMT_IF;
+    next();
+    expect(LEFT_PAREN, "'('");
+    stmt->expr = parseExpression();
+    expect(RIGHT_PAREN, "')'");
+    stmt->body.push_back(parseStatement());
+    if (current().type == OTHERWISE) {
+      next();
+      stmt->body.push_back(parseStatement());
+    }
+    return stmt;
+  case LOOP:
+  case REITERATE:
+    if (token.type == REITERATE) {
+      stmt->kind = STMT_FOR;
+      next();
+      expect(LEFT_PAREN, "'('");
+      if (atType()) {
+        stmt->body.push_back(parseVarStatement());
+      } else {
+        std::unique_ptr<Stmt> init(new Stmt());
+        init->kind = STMT_EXPR;
+        init->offset = current().offset;
+        init->file = current().file;
+        init->expr = parseExpression();
+        expect(SEMICOLON, "';'");
+        stmt->body.push_back(std::move(init));
+      }
+      stmt->expr = parseExpression();
+      expect(SEMICOLON, "';'");
+      stmt->step = parseExpression();
+      expect(RIGHT_PAREN, "')'");
+    } else {
+      stmt->kind = STMT_WHILE;
+      next();
+      expect(LEFT_PAREN, "'('");
+      stmt->expr = parseExpression();
+      expect(RIGHT_PAREN, "')'");
+    }
+    stmt->body.push_back(parseStatement());
+    return stmt;
+  case RETURN:
+    stmt->kind = STMT_RETURN;
+    next();
+    if (current().type != SEMICOLON)
+      stmt->expr = parseExpression();
+    expect(SEMICOLON, "';'");
+    return stmt;
+  case BREAK:
+    stmt->kind = STMT_BREAK;
+    next();
+    expect(SEMICOLON, "';'");
+    return stmt;
+  case SEMICOLON:
+    stmt->kind = STMT_BLOCK;
+    next();
+    return stmt;
+  default:
+    if (current().type == LEFT_BRACE)
+      return parseBlock();
+    stmt->kind = STMT_EXPR;
+    stmt->expr = parseExpression();
+    expect(SEMICOLON, "';'");
+    return stmt;
+  }
+}
+
+// Same backtracking as the parser: an identifier starts an assignment only if
+// the access path after it is followed by '='.
+std::unique_ptr<Expr> AstBuilder::parseExpression() {
+  if (current().type == IDENTIFIER) {
+    size_t start = pos;
+    std::unique_ptr<Expr> target = parseAccess();
+    if (current().type == ASSIGNMENT_OP) {
+      std::unique_ptr<Expr> assign = node(EXPR_ASSIGN);
+      next();
+      deepen();
+      assign->children.push_back(std::move(target));
+      assign->children.push_back(parseExpression());
+      height--;
+      return assign;
+    }
+    pos = start;
+  }
+  return parseSimpleExpression();
+}
+
+std::unique_ptr<Expr> AstBuilder::parseSimpleExpression() {
+  std::unique_ptr<Expr> lhs = parseAdditive();
+  if (current().type == RELATIONAL_OP || current().type == LOGIC_OP) {
+    std::unique_ptr<Expr> binary = node(EXPR_BINARY);
+    binary->text = current().text;
+    next();
+    deepen();
+    binary->children.push_back(std::move(lhs));
+    binary->children.push_back(parseAdditive());
+    height--;
+    return binary;
+  }
+  return lhs;
+}
+
+std::unique_ptr<Expr> AstBuilder::parseAdditive() {
+  std::unique_ptr<Expr> lhs = parseTerm();
+  unsigned int levels = 0;
+  while (isAddOpToken(current().type)) {
+    std::unique_ptr<Expr> binary = node(EXPR_BINARY);
+    binary->text = current().text;
+    next();
+    deepen();
+    levels++;
+    binary->children.push_back(std::move(lhs));
+    binary->children.push_back(parseTerm());
+    lhs = std::move(binary);
+  }
+  height -= levels;
+  return lhs;
+}
+
+std::unique_ptr<Expr> AstBuilder::parseTerm() {
+  std::unique_ptr<Expr> lhs = parseFactor();
+  unsigned int levels = 0;
+  while (isMulOpToken(current().type)) {
+    std::unique_ptr<Expr> binary = node(EXPR_BINARY);
+    binary->text = current().text;
+    next();
+    deepen();
+    levels++;
+    binary->children.push_back(std::move(lhs));
+    binary->children.push_back(parseFactor());
+    lhs = std::move(binary);
+  }
+  height -= levels;
+  return lhs;
+}
+
+// The lexer has already decoded the value into the constant pool.
+std::unique_ptr<Expr> AstBuilder::parseConstant(bool negate) {
+  if (current().constant == 0)
+    fail("number out of range");
+  Constant constant = ConstantPool::current().get(current().constant);
+  std::unique_ptr<Expr> expr;
+  if (constant.kind == LITERAL_IMWF) {
+    expr = node(EXPR_FLOAT);
+    expr->floatValue = negate ? -constant.floatValue : constant.floatValue;
+  } else {
+    expr = node(EXPR_INT);
+    // Wraps instead of overflowing for the most negative value.
+    expr->intValue = negate ? static_cast<int64_t>(
+                                  0 - static_cast<uint64_t>(constant.intValue))
+                            : constant.intValue;
+  }
+  next();
+  return expr;
+}
+
+std::unique_ptr<Expr> AstBuilder::parseFactor() {
+  const Token &token = current();
+  switch (token.type) {
+  case CONSTANT:
+    return parseConstant(false);
+  case PLUS:
+  case MINUS: {
+    bool negate = token.type == MINUS;
+    next();
+    if (current().type != CONSTANT)
+      fail("expected a number");
+    return parseConstant(negate);
+  }
+  case STRING_LITERAL: {
+    std::unique_ptr<Expr> expr = node(EXPR_STRING);
+    expr->text = token.text.substr(1, token.text.size() - 2);
+    next();
+    return expr;
+  }
+  case CHARACTER_LITERAL: {
+    std::unique_ptr<Expr> expr = node(EXPR_INT);
+    expr->intValue = token.text.size() > 2
+                         ? static_cast<unsigned char>(token.text[1])
+                         : 0;
+    next();
+    return expr;
+  }
+  case IDENTIFIER: {
+    std::unique_ptr<Expr> access = parseAccess();
+    if (current().type != LEFT_PAREN)
+      return access;
+    if (access->kind != EXPR_VARIABLE)
+      fail("only named functions can be called");
+    access->kind = EXPR_CALL;
+    next();
+    if (current().type != RIGHT_PAREN) {
+      while (true) {
+        access->children.push_back(parseExpression());
+        if (current().type != COMMA)
+          break;
+        next();
+      }
+    }
+    expect(RIGHT_PAREN, "')'");
+    return access;
+  }
+  default:
+    if (current().type == LEFT_PAREN) {
+      next();
+      std::unique_ptr<Expr> inner = parseExpression();
+      expect(RIGHT_PAREN, "')'");
+      return inner;
+    }
+    fail("unsupported expression");
+  }
+}
+
+// name, followed by any mix of ->field and [index]. Each one is a level of
+// the tree too.
+std::unique_ptr<Expr> AstBuilder::parseAccess() {
+  std::unique_ptr<Expr> expr = node(EXPR_VARIABLE);
+  expr->symbol = current().symbol;
+  expect(IDENTIFIER, "a name");
+  unsigned int levels = 0;
+  while (true) {
+    if (current().type == ACCESS_OP || current().type == LEFT_BRACKET) {
+      deepen();
+      levels++;
+    }
+    if (current().type == ACCESS_OP) {
+      next();
+      std::unique_ptr<Expr> field = node(EXPR_FIELD);
+      field->symbol = current().symbol;
+      expect(IDENTIFIER, "a member name");
+      field->children.push_back(std::move(expr));
+      expr = std::move(field);
+    } else if (current().type == LEFT_BRACKET) {
+      std::unique_ptr<Expr> index = node(EXPR_INDEX);
+      next();
+      index->children.push_back(std::move(expr));
+      if (current().type == CONSTANT)
+        index->children.push_back(parseConstant(false));
+      else
+        index->children.push_back(parseAccess());
+      expect(RIGHT_BRACKET, "']'");
+      expr = std::move(index);
+    } else {
+      height -= levels;
+      return expr;
+    }
+  }
+}
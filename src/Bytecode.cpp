@@ -0,0 +1,667 @@
+#include "Bytecode.h"
+#include "Interner.h"
+#include <cstring>
+
+void BytecodeCompiler::fail(const std::string &message, uint32_t offset,
+                            uint16_t file) const {
+  throw CompileError(message, offset, file);
+}
+
+static std::string nameOf(uint32_t symbol) {
+  return std::string(Interner::current().text(symbol));
+}
+
+BytecodeCompiler::Shape BytecodeCompiler::shapeOf(const TypeRef &type,
+                                                  uint32_t arraySize,
+                                                  uint32_t offset,
+                                                  uint16_t file) const {
+  if (type.pointer)
+    fail("pointers are not supported", offset, file);
+  Shape shape;
+  switch (type.kind) {
+  case TYPE_INT:
+  case TYPE_CHAR:
+    shape.type = VAL_INT;
+    break;
+  case TYPE_FLOAT:
+    shape.type = VAL_FLOAT;
+    break;
+  case TYPE_STRING:
+    shape.type = VAL_REF;
+    shape.element = VAL_INT;
+    break;
+  case TYPE_STRUCT:
+    structInfo(type.structName, offset, file);
+    shape.type = VAL_REF;
+    shape.structName = type.structName;
+    break;
+  case TYPE_VOID:
+    break;
+  }
+  if (arraySize > 0) {
+    if (shape.type == VAL_VOID)
+      fail("array of NOReturn", offset, file);
+    shape.element = shape.type;
+    shape.type = VAL_REF;
+  }
+  return shape;
+}
+
+const BytecodeCompiler::StructInfo &
+BytecodeCompiler::structInfo(uint32_t name, uint32_t offset,
+                             uint16_t file) const {
+  auto it = structs.find(name);
+  if (it == structs.end())
+    fail("unknown struct '" + nameOf(name) + "'", offset, file);
+  return it->second;
+}
+
+uint8_t BytecodeCompiler::reserve(uint32_t offset, uint16_t file) {
+  if (top >= NO_REG)
+    fail("function needs more than 255 registers", offset, file);
+  if (top + 1 > function->registers)
+    function->registers = static_cast<uint16_t>(top + 1);
+  return static_cast<uint8_t>(top++);
+}
+
+size_t BytecodeCompiler::emit(Opcode op, unsigned int a, unsigned int b,
+                              unsigned int c) {
+  function->code.push_back(Instruction{op, static_cast<uint8_t>(a),
+                                       static_cast<uint8_t>(b),
+                                       static_cast<uint8_t>(c)});
+  return function->code.size() - 1;
+}
+
+size_t BytecodeCompiler::emitBx(Opcode op, unsigned int a, unsigned int bx) {
+  return emit(op, a, bx & 0xff, bx >> 8);
+}
+
+void BytecodeCompiler::patch(size_t at, size_t target) {
+  if (target > 0xffff)
+    fail("function is too large", decl->offset, decl->file);
+  function->code[at].b = target & 0xff;
+  function->code[at].c = static_cast<uint8_t>(target >> 8);
+}
+
+uint16_t BytecodeCompiler::addConstant(Value value, bool isFloat) {
+  if (out.constants.size() > 0xffff)
+    fail("too many constants", decl ? decl->offset : 0,
+         decl ? decl->file : 0);
+  out.constants.push_back(value);
+  out.floatConstants.push_back(isFloat);
+  return static_cast<uint16_t>(out.constants.size() - 1);
+}
+
+uint16_t BytecodeCompiler::intConstant(int64_t value) {
+  auto it = intConstants.find(value);
+  if (it != intConstants.end())
+    return it->second;
+  Value constant;
+  constant.i = value;
+  uint16_t index = addConstant(constant);
+  intConstants.emplace(value, index);
+  return index;
+}
+
+uint16_t BytecodeCompiler::floatConstant(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  auto it = floatConstants.find(bits);
+  if (it != floatConstants.end())
+    return it->second;
+  Value constant;
+  constant.f = value;
+  uint16_t index = addConstant(constant, true);
+  floatConstants.emplace(bits, index);
+  return index;
+}
+
+Bytecode BytecodeCompiler::compile(const Program &program) {
+  out = Bytecode();
+  functions.clear();
+  structs.clear();
+  globals.clear();
+  intConstants.clear();
+  floatConstants.clear();
+  for (const StructDecl &decl : program.structs) {
+    StructInfo info;
+    info.decl = &decl;
+    for (const VarDecl &field : decl.fields) {
+      if (info.fields.size() > 0xff)
+        fail("struct has more than 256 members", field.offset, field.file);
+      info.fields.emplace(field.name, static_cast<uint8_t>(info.fields.size()));
+    }
+    structs.emplace(decl.name, std::move(info));
+  }
+  for (const VarDecl &var : program.globals) {
+    if (out.globals == 0xffff)
+      fail("too many globals", var.offset, var.file);
+    globals[var.name] = Global{out.globals++,
+                               shapeOf(var.type, var.arraySize, var.offset,
+                                       var.file)};
+  }
+  for (const FunctionDecl &decl : program.functions) {
+    if (out.functions.size() >= 0xffff)
+      fail("too many functions", decl.offset, decl.file);
+    uint16_t index = static_cast<uint16_t>(out.functions.size());
+    if (!functions.emplace(decl.name, FunctionInfo{index, &decl}).second)
+      fail("function '" + nameOf(decl.name) + "' is defined twice",
+           decl.offset, decl.file);
+    out.functions.emplace_back();
+    out.functions.back().name = decl.name;
+  }
+  for (const FunctionDecl &decl : program.functions)
+    compileFunction(decl, functions[decl.name].index);
+  compileInit(program);
+
+  auto main = functions.find(Interner::current().intern("main"));
+  if (main == functions.end())
+    throw CompileError("no main function", 0, 0);
+  if (!main->second.decl->params.empty())
+    fail("main takes no parameters", main->second.decl->offset,
+         main->second.decl->file);
+  out.main = main->second.index;
+  return std::move(out);
+}
+
+void BytecodeCompiler::compileInit(const Program &program) {
+  out.functions.emplace_back();
+  function = &out.functions.back();
+  decl = nullptr;
+  top = 0;
+  for (const VarDecl &var : program.globals) {
+    const Global &global = globals[var.name];
+    if (global.shape.type != VAL_REF ||
+        (var.arraySize == 0 && global.shape.structName == 0))
+      continue;
+    uint8_t reg = reserve(var.offset, var.file);
+    allocate(global.shape, var.arraySize, reg, var.offset, var.file);
+    emitBx(OP_SETG, reg, global.slot);
+    top = 0;
+  }
+  emit(OP_RETV, 0);
+  out.init = static_cast<int>(out.functions.size() - 1);
+}
+
+// Arrays get their slots, structs get theirs plus their nested structs.
+// Series variables start out null, like pointers.
+void BytecodeCompiler::allocate(const Shape &shape, uint32_t arraySize,
+                                uint8_t reg, uint32_t offset, uint16_t file) {
+  if (arraySize > 0) {
+    if (arraySize > 0xffff)
+      fail("array is too large", offset, file);
+    emitBx(OP_NEW, reg, arraySize);
+    return;
+  }
+  if (shape.structName == 0)
+    return;
+  if (nesting > 64)
+    fail("struct contains itself", offset, file);
+  const StructInfo &info = structInfo(shape.structName, offset, file);
+  emitBx(OP_NEW, reg, static_cast<unsigned int>(info.decl->fields.size()));
+  nesting++;
+  for (const VarDecl &field : info.decl->fields) {
+    Shape fieldShape = shapeOf(field.type, field.arraySize, field.offset,
+                               field.file);
+    if (field.arraySize == 0 && fieldShape.structName == 0)
+      continue;
+    unsigned int saved = top;
+    uint8_t member = reserve(offset, file);
+    allocate(fieldShape, field.arraySize, member, field.offset, field.file);
+    emit(OP_SETF, reg, info.fields.at(field.name), member);
+    top = saved;
+  }
+  nesting--;
+}
+
+void BytecodeCompiler::compileFunction(const FunctionDecl &decl,
+                                       uint16_t index) {
+  function = &out.functions[index];
+  this->decl = &decl;
+  locals.clear();
+  breaks.clear();
+  top = 0;
+  if (decl.params.size() > 0xff)
+    fail("too many parameters", decl.offset, decl.file);
+  function->params = static_cast<uint8_t>(decl.params.size());
+  function->floatResult = decl.returnType.kind == TYPE_FLOAT;
+  for (const VarDecl &param : decl.params) {
+    Shape shape = shapeOf(param.type, 0, param.offset, param.file);
+    if (shape.type == VAL_VOID)
+      fail("parameter of type NOReturn", param.offset, param.file);
+    locals.push_back(Local{param.name, reserve(param.offset, param.file),
+                           shape});
+    function->floatParams.push_back(shape.type == VAL_FLOAT);
+  }
+  compileStatement(*decl.body);
+  emit(OP_RETV, 0);
+  if (function->code.size() > 0xffff)
+    fail("function is too large", decl.offset, decl.file);
+}
+
+const BytecodeCompiler::Local *
+BytecodeCompiler::findLocal(uint32_t name) const {
+  for (auto it = locals.rbegin(); it != locals.rend(); ++it) {
+    if (it->name == name)
+      return &*it;
+  }
+  return nullptr;
+}
+
+void BytecodeCompiler::declareLocal(const VarDecl &var) {
+  Shape shape = shapeOf(var.type, var.arraySize, var.offset, var.file);
+  if (shape.type == VAL_VOID)
+    fail("variable of type NOReturn", var.offset, var.file);
+  uint8_t reg = reserve(var.offset, var.file);
+  if (var.init) {
+    Shape value = compileExpr(*var.init, reg);
+    coerce(value, shape.type, reg, true, *var.init);
+  } else if (var.arraySize > 0 || shape.structName != 0) {
+    allocate(shape, var.arraySize, reg, var.offset, var.file);
+  } else {
+    // Zero, 0.0 and null share the same bits.
+    emitBx(OP_LOADK, reg, intConstant(0));
+  }
+  // Visible only after its initializer.
+  locals.push_back(Local{var.name, reg, shape});
+  top = reg + 1u;
+}
+
+void BytecodeCompiler::compileStatement(const Stmt &stmt) {
+  unsigned int saved = top;
+  switch (stmt.kind) {
+  case STMT_BLOCK: {
+    size_t count = locals.size();
+    for (const auto &child : stmt.body)
+      compileStatement(*child);
+    locals.resize(count);
+    break;
+  }
+  case STMT_VAR:
+    declareLocal(stmt.var);
+    return;
+  case STMT_EXPR:
+    if (stmt.expr->kind == EXPR_ASSIGN) {
+      compileAssign(*stmt.expr, NO_REG);
+    } else {
+      compileExpr(*stmt.expr, reserve(stmt.offset, stmt.file));
+    }
+    break;
+  case STMT_IF: {
+    std::vector<size_t> skip;
+    compileCondition(*stmt.expr, false, skip);
+    top = saved;
+    compileStatement(*stmt.body[0]);
+    if (stmt.body.size() > 1) {
+      size_t end = emit(OP_JMP, 0);
+      for (size_t jump : skip)
+        patch(jump, function->code.size());
+      compileStatement(*stmt.body[1]);
+      patch(end, function->code.size());
+    } else {
+      for (size_t jump : skip)
+        patch(jump, function->code.size());
+    }
+    break;
+  }
+  case STMT_WHILE:
+  case STMT_FOR: {
+    // Condition at the bottom: one conditional jump per iteration.
+    size_t count = locals.size();
+    if (stmt.kind == STMT_FOR)
+      compileStatement(*stmt.body[0]);
+    size_t entry = emit(OP_JMP, 0);
+    size_t start = function->code.size();
+    breaks.emplace_back();
+    compileStatement(*stmt.body.back());
+    if (stmt.step) {
+      unsigned int before = top;
+      if (stmt.step->kind == EXPR_ASSIGN)
+        compileAssign(*stmt.step, NO_REG);
+      else
+        compileExpr(*stmt.step, reserve(stmt.offset, stmt.file));
+      top = before;
+    }
+    patch(entry, function->code.size());
+    std::vector<size_t> repeat;
+    compileCondition(*stmt.expr, true, repeat);
+    for (size_t jump : repeat)
+      patch(jump, start);
+    for (size_t jump : breaks.back())
+      patch(jump, function->code.size());
+    breaks.pop_back();
+    locals.resize(count);
+    break;
+  }
+  case STMT_RETURN:
+    if (!stmt.expr) {
+      emit(OP_RETV, 0);
+    } else {
+      uint8_t reg;
+      Shape value = compileOperand(*stmt.expr, reg);
+      Shape result = shapeOf(decl->returnType, 0, stmt.offset, stmt.file);
+      if (result.type == VAL_VOID) {
+        emit(OP_RETV, 0);
+      } else {
+        emit(OP_RET, coerce(value, result.type, reg, false, *stmt.expr));
+      }
+    }
+    break;
+  case STMT_BREAK:
+    if (breaks.empty())
+      fail("break outside of a loop", stmt.offset, stmt.file);
+    breaks.back().push_back(emit(OP_JMP, 0));
+    break;
+  }
+  top = saved;
+}
+
+void BytecodeCompiler::compileCondition(const Expr &expr, bool jumpIf,
+                                        std::vector<size_t> &jumps) {
+  if (expr.kind == EXPR_BINARY && (expr.text == "&&" || expr.text == "||")) {
+    bool isAnd = expr.text == "&&";
+    if (isAnd != jumpIf) {
+      // a && b jumps when false as soon as either side is false; a || b
+      // jumps when true as soon as either side is true.
+      compileCondition(*expr.children[0], jumpIf, jumps);
+      compileCondition(*expr.children[1], jumpIf, jumps);
+    } else {
+      std::vector<size_t> skip;
+      compileCondition(*expr.children[0], !jumpIf, skip);
+      compileCondition(*expr.children[1], jumpIf, jumps);
+      for (size_t jump : skip)
+        patch(jump, function->code.size());
+    }
+    return;
+  }
+  unsigned int saved = top;
+  uint8_t reg;
+  Shape shape = compileOperand(expr, reg);
+  if (shape.type == VAL_FLOAT) {
+    uint8_t zero = reserve(expr.offset, expr.file);
+    emitBx(OP_LOADK, zero, floatConstant(0.0));
+    emit(OP_NEF, zero, reg, zero);
+    reg = zero;
+  } else if (shape.type == VAL_VOID) {
+    fail("condition has no value", expr.offset, expr.file);
+  }
+  jumps.push_back(emitBx(jumpIf ? OP_JMPT : OP_JMPF, reg, 0));
+  top = saved;
+}
+
+uint8_t BytecodeCompiler::coerce(Shape &shape, ValueType to, uint8_t reg,
+                                 bool inPlace, const Expr &at) {
+  if (shape.type == to)
+    return reg;
+  if ((shape.type != VAL_INT && shape.type != VAL_FLOAT) ||
+      (to != VAL_INT && to != VAL_FLOAT))
+    fail("type mismatch", at.offset, at.file);
+  uint8_t dst = inPlace ? reg : reserve(at.offset, at.file);
+  emit(to == VAL_FLOAT ? OP_ITOF : OP_FTOI, dst, reg);
+  shape.type = to;
+  return dst;
+}
+
+BytecodeCompiler::Shape BytecodeCompiler::compileOperand(const Expr &expr,
+                                                         uint8_t &reg) {
+  if (expr.kind == EXPR_VARIABLE) {
+    if (const Local *local = findLocal(expr.symbol)) {
+      reg = local->reg;
+      return local->shape;
+    }
+  }
+  reg = reserve(expr.offset, expr.file);
+  return compileExpr(expr, reg);
+}
+
+BytecodeCompiler::Shape BytecodeCompiler::compileExpr(const Expr &expr,
+                                                      uint8_t target) {
+  Shape shape;
+  switch (expr.kind) {
+  case EXPR_INT:
+    emitBx(OP_LOADK, target, intConstant(expr.intValue));
+    shape.type = VAL_INT;
+    return shape;
+  case EXPR_FLOAT:
+    emitBx(OP_LOADK, target, floatConstant(expr.floatValue));
+    shape.type = VAL_FLOAT;
+    return shape;
+  case EXPR_STRING: {
+    Value placeholder;
+    placeholder.i = 0;
+    uint16_t constant = addConstant(placeholder);
+    out.strings.push_back({constant, expr.text});
+    emitBx(OP_LOADK, target, constant);
+    shape.type = VAL_REF;
+    shape.element = VAL_INT;
+    return shape;
+  }
+  case EXPR_VARIABLE: {
+    if (const Local *local = findLocal(expr.symbol)) {
+      if (local->reg != target)
+        emit(OP_MOVE, target, local->reg);
+      return local->shape;
+    }
+    auto global = globals.find(expr.symbol);
+    if (global == globals.end())
+      fail("undeclared '" + nameOf(expr.symbol) + "'", expr.offset,
+           expr.file);
+    emitBx(OP_GETG, target, global->second.slot);
+    return global->second.shape;
+  }
+  case EXPR_FIELD: {
+    uint8_t base;
+    Shape object = compileOperand(*expr.children[0], base);
+    if (object.type != VAL_REF || object.structName == 0 ||
+        object.element != VAL_VOID)
+      fail("'->' needs a Loli value", expr.offset, expr.file);
+    const StructInfo &info = structInfo(object.structName, expr.offset,
+                                        expr.file);
+    auto field = info.fields.find(expr.symbol);
+    if (field == info.fields.end())
+      fail("no member '" + nameOf(expr.symbol) + "'", expr.offset, expr.file);
+    const VarDecl &member = info.decl->fields[field->second];
+    emit(OP_GETF, target, base, field->second);
+    return shapeOf(member.type, member.arraySize, member.offset, member.file);
+  }
+  case EXPR_INDEX: {
+    uint8_t base;
+    uint8_t index;
+    Shape array = compileOperand(*expr.children[0], base);
+    if (array.type != VAL_REF || array.element == VAL_VOID)
+      fail("only arrays and Series can be indexed", expr.offset, expr.file);
+    Shape position = compileOperand(*expr.children[1], index);
+    index = coerce(position, VAL_INT, index, false, *expr.children[1]);
+    emit(OP_GETX, target, base, index);
+    shape.type = array.element;
+    shape.structName = array.structName;
+    return shape;
+  }
+  case EXPR_CALL:
+    return compileCall(expr, target);
+  case EXPR_BINARY:
+    return compileBinary(expr, target);
+  case EXPR_ASSIGN:
+    return compileAssign(expr, target);
+  }
+  return shape;
+}
+
+BytecodeCompiler::Shape BytecodeCompiler::compileAssign(const Expr &expr,
+                                                        uint8_t target) {
+  const Expr &lhs = *expr.children[0];
+  const Expr &rhs = *expr.children[1];
+  Shape shape;
+  uint8_t value;
+  if (lhs.kind == EXPR_VARIABLE) {
+    if (const Local *local = findLocal(lhs.symbol)) {
+      // Straight into the variable's register: x = x + 1 is one ADDI.
+      Shape result = compileExpr(rhs, local->reg);
+      if (result.type == VAL_REF || local->shape.type == VAL_REF) {
+        if (result.type != local->shape.type)
+          fail("type mismatch", expr.offset, expr.file);
+      } else {
+        coerce(result, local->shape.type, local->reg, true, rhs);
+      }
+      if (target != NO_REG)
+        emit(OP_MOVE, target, local->reg);
+      return local->shape;
+    }
+    auto global = globals.find(lhs.symbol);
+    if (global == globals.end())
+      fail("undeclared '" + nameOf(lhs.symbol) + "'", lhs.offset, lhs.file);
+    shape = global->second.shape;
+    Shape result = compileOperand(rhs, value);
+    if (result.type == VAL_REF || shape.type == VAL_REF) {
+      if (result.type != shape.type)
+        fail("type mismatch", expr.offset, expr.file);
+    } else {
+      value = coerce(result, shape.type, value, false, rhs);
+    }
+    emitBx(OP_SETG, value, global->second.slot);
+  } else if (lhs.kind == EXPR_FIELD || lhs.kind == EXPR_INDEX) {
+    uint8_t base;
+    Shape container = compileOperand(*lhs.children[0], base);
+    uint8_t key = 0;
+    if (lhs.kind == EXPR_FIELD) {
+      if (container.type != VAL_REF || container.structName == 0 ||
+          container.element != VAL_VOID)
+        fail("'->' needs a Loli value", lhs.offset, lhs.file);
+      const StructInfo &info = structInfo(container.structName, lhs.offset,
+                                          lhs.file);
+      auto field = info.fields.find(lhs.symbol);
+      if (field == info.fields.end())
+        fail("no member '" + nameOf(lhs.symbol) + "'", lhs.offset, lhs.file);
+      const VarDecl &member = info.decl->fields[field->second];
+      shape = shapeOf(member.type, member.arraySize, member.offset,
+                      member.file);
+      key = field->second;
+    } else {
+      if (container.type != VAL_REF || container.element == VAL_VOID)
+        fail("only arrays and Series can be indexed", lhs.offset, lhs.file);
+      Shape position = compileOperand(*lhs.children[1], key);
+      key = coerce(position, VAL_INT, key, false, *lhs.children[1]);
+      shape.type = container.element;
+      shape.structName = container.structName;
+    }
+    Shape result = compileOperand(rhs, value);
+    if (result.type == VAL_REF || shape.type == VAL_REF) {
+      if (result.type != shape.type)
+        fail("type mismatch", expr.offset, expr.file);
+    } else {
+      value = coerce(result, shape.type, value, false, rhs);
+    }
+    emit(lhs.kind == EXPR_FIELD ? OP_SETF : OP_SETX, base, key, value);
+  } else {
+    fail("cannot assign to this expression", expr.offset, expr.file);
+  }
+  if (target != NO_REG && target != value)
+    emit(OP_MOVE, target, value);
+  return shape;
+}
+
+BytecodeCompiler::Shape BytecodeCompiler::compileBinary(const Expr &expr,
+                                                        uint8_t target) {
+  const std::string &op = expr.text;
+  Shape shape;
+  if (op == "&&" || op == "||") {
+    std::vector<size_t> isFalse;
+    compileCondition(expr, false, isFalse);
+    emitBx(OP_LOADK, target, intConstant(1));
+    size_t end = emit(OP_JMP, 0);
+    for (size_t jump : isFalse)
+      patch(jump, function->code.size());
+    emitBx(OP_LOADK, target, intConstant(0));
+    patch(end, function->code.size());
+    shape.type = VAL_INT;
+    return shape;
+  }
+  uint8_t lhs;
+  uint8_t rhs;
+  Shape left = compileOperand(*expr.children[0], lhs);
+  Shape right = compileOperand(*expr.children[1], rhs);
+  bool refs = left.type == VAL_REF && right.type == VAL_REF &&
+              (op == "==" || op == "!=");
+  if (!refs) {
+    if ((left.type != VAL_INT && left.type != VAL_FLOAT) ||
+        (right.type != VAL_INT && right.type != VAL_FLOAT))
+      fail("operator '" + op + "' needs numbers", expr.offset, expr.file);
+    if (left.type != right.type) {
+      lhs = coerce(left, VAL_FLOAT, lhs, false, *expr.children[0]);
+      rhs = coerce(right, VAL_FLOAT, rhs, false, *expr.children[1]);
+    }
+  }
+  bool isFloat = left.type == VAL_FLOAT;
+  shape.type = isFloat ? VAL_FLOAT : VAL_INT;
+  Opcode code;
+  bool swap = false;
+  if (op == "+") {
+    code = isFloat ? OP_ADDF : OP_ADDI;
+  } else if (op == "-") {
+    code = isFloat ? OP_SUBF : OP_SUBI;
+  } else if (op == "*") {
+    code = isFloat ? OP_MULF : OP_MULI;
+  } else if (op == "/") {
+    code = isFloat ? OP_DIVF : OP_DIVI;
+  } else {
+    shape.type = VAL_INT;
+    if (op == "<" || op == ">") {
+      code = isFloat ? OP_LTF : OP_LTI;
+      swap = op == ">";
+    } else if (op == "<=" || op == ">=") {
+      code = isFloat ? OP_LEF : OP_LEI;
+      swap = op == ">=";
+    } else if (op == "==") {
+      code = isFloat ? OP_EQF : OP_EQI;
+    } else if (op == "!=") {
+      code = isFloat ? OP_NEF : OP_NEI;
+    } else {
+      fail("operator '" + op + "' is not supported", expr.offset, expr.file);
+    }
+  }
+  if (swap)
+    emit(code, target, rhs, lhs);
+  else
+    emit(code, target, lhs, rhs);
+  return shape;
+}
+
+BytecodeCompiler::Shape BytecodeCompiler::compileCall(const Expr &expr,
+                                                      uint8_t target) {
+  auto it = functions.find(expr.symbol);
+  if (it == functions.end())
+    fail("call to undefined function '" + nameOf(expr.symbol) + "'",
+         expr.offset, expr.file);
+  const FunctionDecl &callee = *it->second.decl;
+  if (callee.params.size() != expr.children.size())
+    fail("'" + nameOf(expr.symbol) + "' takes " +
+             std::to_string(callee.params.size()) + " arguments",
+         expr.offset, expr.file);
+  // Arguments go to consecutive registers above everything live; they become
+  // the callee's first registers.
+  unsigned int base = top;
+  for (size_t i = 0; i < expr.children.size(); i++) {
+    const Expr &arg = *expr.children[i];
+    const VarDecl &param = callee.params[i];
+    uint8_t reg = reserve(arg.offset, arg.file);
+    Shape value = compileExpr(arg, reg);
+    Shape wanted = shapeOf(param.type, 0, param.offset, param.file);
+    if (value.type == VAL_REF || wanted.type == VAL_REF) {
+      if (value.type != wanted.type)
+        fail("type mismatch in argument " + std::to_string(i + 1),
+             arg.offset, arg.file);
+    } else {
+      coerce(value, wanted.type, reg, true, arg);
+    }
+    top = reg + 1u;
+  }
+  // The result comes back in the first argument's register.
+  if (expr.children.empty())
+    reserve(expr.offset, expr.file);
+  if (base >= NO_REG)
+    fail("function needs more than 255 registers", expr.offset, expr.file);
+  emitBx(OP_CALL, base, it->second.index);
+  if (base != target)
+    emit(OP_MOVE, target, base);
+  return shapeOf(callee.returnType, 0, callee.offset, callee.file);
+}
@@ -0,0 +1,180 @@
+#include "CallGraph.h"
+#include "Interner.h"
+#include <algorithm>
+
+CallGraph::CallGraph(const Program &program)
+    : edges(program.functions.size()), entry(program.functions.size()) {
+  uint32_t main = Interner::current().intern("main");
+  for (uint32_t i = 0; i < program.functions.size(); i++) {
+    this->index.emplace(program.functions[i].name, i);
+    if (program.functions[i].name == main)
+      this->entry = i;
+  }
+  for (size_t i = 0; i < program.functions.size(); i++) {
+    std::vector<uint32_t> &calls = this->edges[i];
+    if (program.functions[i].body)
+      this->addCalls(*program.functions[i].body, calls);
+    std::sort(calls.begin(), calls.end());
+    calls.erase(std::unique(calls.begin(), calls.end()), calls.end());
+  }
+}
+
+const std::vector<uint32_t> &CallGraph::callees(size_t function) const {
+  return this->edges[function];
+}
+
+std::vector<bool> CallGraph::reachable() const {
+  if (this->entry == this->edges.size())
+    return std::vector<bool>(this->edges.size(), true);
+  std::vector<bool> seen(this->edges.size(), false);
+  std::vector<uint32_t> work{static_cast<uint32_t>(this->entry)};
+  seen[this->entry] = true;
+  while (!work.empty()) {
+    uint32_t function = work.back();
+    work.pop_back();
+    for (uint32_t callee : this->edges[function]) {
+      if (!seen[callee]) {
+        seen[callee] = true;
+        work.push_back(callee);
+      }
+    }
+  }
+  return seen;
+}
+
+void CallGraph::addCalls(const Expr &expr,
+                         std::vector<uint32_t> &calls) const {
+  if (expr.kind == EXPR_CALL) {
+    auto found = this->index.find(expr.symbol);
+    if (found != this->index.end())
+      calls.push_back(found->second);
+  }
+  for (const std::unique_ptr<Expr> &child : expr.children)
+    this->addCalls(*child, calls);
+}
+
+void CallGraph::addCalls(const Stmt &stmt,
+                         std::vector<uint32_t> &calls) const {
+  if (stmt.expr)
+    this->addCalls(*stmt.expr, calls);
+  if (stmt.step)
+    this->addCalls(*stmt.step, calls);
+  if (stmt.var.init)
+    this->addCalls(*stmt.var.init, calls);
+  for (const std::unique_ptr<Stmt> &child : stmt.body)
+    this->addCalls(*child, calls);
+}
+
+void DeadCodeEliminator::markType(const TypeRef &type) {
+  if (type.kind != TYPE_STRUCT)
+    return;
+  auto found = this->index.find(type.structName);
+  if (found == this->index.end() || this->liveStructs[found->second])
+    return;
+  this->liveStructs[found->second] = true;
+  this->pending.push_back(found->second);
+}
+
+void DeadCodeEliminator::markStmt(const Stmt &stmt) {
+  if (stmt.kind == STMT_VAR)
+    this->markType(stmt.var.type);
+  for (const std::unique_ptr<Stmt> &child : stmt.body)
+    this->markStmt(*child);
+}
+
+DeadCodeStats DeadCodeEliminator::eliminate(Program &program) {
+  DeadCodeStats stats;
+  std::vector<bool> liveFunctions = CallGraph(program).reachable();
+
+  this->liveStructs.assign(program.structs.size(), false);
+  this->index.clear();
+  this->pending.clear();
+  for (uint32_t i = 0; i < program.structs.size(); i++)
+    this->index.emplace(program.structs[i].name, i);
+  for (const VarDecl &global : program.globals)
+    this->markType(global.type);
+  for (size_t i = 0; i < program.functions.size(); i++) {
+    if (!liveFunctions[i])
+      continue;
+    const FunctionDecl &function = program.functions[i];
+    this->markType(function.returnType);
+    for (const VarDecl &param : function.params)
+      this->markType(param.type);
+    if (function.body)
+      this->markStmt(*function.body);
+  }
+  while (!this->pending.empty()) {
+    uint32_t live = this->pending.back();
+    this->pending.pop_back();
+    for (const VarDecl &field : program.structs[live].fields)
+      this->markType(field.type);
+  }
+
+  auto fileStats = [&](uint16_t file) -> DeadCodeFile & {
+    if (stats.files.size() <= file)
+      stats.files.resize(file + 1u);
+    stats.files[file].file = file;
+    return stats.files[file];
+  };
+  std::vector<FunctionDecl> functions;
+  for (size_t i = 0; i < program.functions.size(); i++) {
+    FunctionDecl &function = program.functions[i];
+    DeadCodeFile &file = fileStats(function.file);
+    file.functions++;
+    if (liveFunctions[i]) {
+      functions.push_back(std::move(function));
+    } else {
+      file.deadFunctions.push_back(function.name);
+      stats.functions++;
+    }
+  }
+  program.functions = std::move(functions);
+  std::vector<StructDecl> structs;
+  for (size_t i = 0; i < program.structs.size(); i++) {
+    StructDecl &decl = program.structs[i];
+    DeadCodeFile &file = fileStats(decl.file);
+    file.structs++;
+    if (this->liveStructs[i]) {
+      structs.push_back(std::move(decl));
+    } else {
+      file.deadStructs.push_back(decl.name);
+      stats.structs++;
+    }
+  }
+  program.structs = std::move(structs);
+  stats.files.erase(std::remove_if(stats.files.begin(), stats.files.end(),
+                                   [](const DeadCodeFile &file) {
+                                     return file.functions == 0 &&
+                                            file.structs == 0;
+                                   }),
+                    stats.files.end());
+  return stats;
+}
+
+static void printNames(const std::vector<uint32_t> &names, size_t declared,
+                       const char *what, std::ostream &os) {
+  os << names.size() << " of " << declared << " " << what << " (";
+  for (size_t i = 0; i < names.size(); i++)
+    os << (i == 0 ? "" : ", ") << Interner::current().text(names[i]);
+  os << ")";
+}
+
+void printDeadCode(const DeadCodeStats &stats, const SourceMap &sources,
+                   std::ostream &os) {
+  os << "Removed " << stats.functions << " unreachable functions and "
+     << stats.structs << " unused structs\n";
+  for (const DeadCodeFile &file : stats.files) {
+    if (file.deadFunctions.empty() && file.deadStructs.empty())
+      continue;
+    std::string name = sources.name(file.file);
+    os << "  " << (name.empty() ? "file " + std::to_string(file.file) : name)
+       << ": ";
+    if (!file.deadFunctions.empty())
+      printNames(file.deadFunctions, file.functions, "functions", os);
+    if (!file.deadFunctions.empty() && !file.deadStructs.empty())
+      os << ", ";
+    if (!file.deadStructs.empty())
+      printNames(file.deadStructs, file.structs, "structs", os);
+    os << "\n";
+  }
+}
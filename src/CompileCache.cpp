@@ -0,0 +1,230 @@
+#include "CompileCache.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static const char CACHE_MAGIC[] = "CMPCACHE1";
+
+// XXH64, see https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static uint64_t read64(const char *p) {
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t read32(const char *p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t xxRound(uint64_t acc, uint64_t input) {
+  acc += input * PRIME2;
+  acc = rotl(acc, 31);
+  return acc * PRIME1;
+}
+
+static uint64_t mergeRound(uint64_t acc, uint64_t val) {
+  acc ^= xxRound(0, val);
+  return acc * PRIME1 + PRIME4;
+}
+
+uint64_t CompileCache::hash(const std::string &data, uint64_t seed) {
+  const char *p = data.data();
+  const char *end = p + data.size();
+  uint64_t h;
+  if (data.size() >= 32) {
+    uint64_t v1 = seed + PRIME1 + PRIME2;
+    uint64_t v2 = seed + PRIME2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME1;
+    const char *limit = end - 32;
+    do {
+      v1 = xxRound(v1, read64(p));
+      v2 = xxRound(v2, read64(p + 8));
+      v3 = xxRound(v3, read64(p + 16));
+      v4 = xxRound(v4, read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = mergeRound(h, v1);
+    h = mergeRound(h, v2);
+    h = mergeRound(h, v3);
+    h = mergeRound(h, v4);
+  } else {
+    h = seed + PRIME5;
+  }
+  h += data.size();
+  for (; p + 8 <= end; p += 8) {
+    h ^= xxRound(0, read64(p));
+    h = rotl(h, 27) * PRIME1 + PRIME4;
+  }
+  if (p + 4 <= end) {
+    h ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+    h = rotl(h, 23) * PRIME2 + PRIME3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    h ^= static_cast<uint64_t>(static_cast<unsigned char>(*p)) * PRIME5;
+    h = rotl(h, 11) * PRIME1;
+  }
+  h ^= h >> 33;
+  h *= PRIME2;
+  h ^= h >> 29;
+  h *= PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+// The build is identified by the bytes of the running executable, so any
+// rebuild, even one that leaves every source but Compiler.cpp alone, starts
+// from a fresh set of keys. Where the executable cannot be read the version
+// string stands in for it.
+uint64_t CompileCache::buildHash(const std::string &version) {
+  std::ifstream exe("/proc/self/exe", std::ios::binary);
+  std::string image;
+  if (exe.is_open()) {
+    std::ostringstream bytes;
+    bytes << exe.rdbuf();
+    image = bytes.str();
+  }
+  return hash(image.empty() ? version : image);
+}
+
+CompileCache::CompileCache(const std::string &directory, uintmax_t maxBytes)
+    : directory(directory), maxBytes(maxBytes) {
+  std::error_code ec;
+  fs::create_directories(this->directory, ec);
+  this->removeStaleTemporaries();
+}
+
+// A temporary is named KEY.cache.tmp.PID.THREAD.N. One whose process no
+// longer exists was left behind by a writer that died before its rename.
+void CompileCache::removeStaleTemporaries() {
+  std::error_code ec;
+  for (fs::directory_iterator it(directory, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    std::string name = it->path().filename().string();
+    size_t mark = name.find(".cache.tmp.");
+    if (mark == std::string::npos)
+      continue;
+    long pid = std::strtol(name.c_str() + mark + 11, nullptr, 10);
+    if (pid > 0 && (kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH))
+      continue;
+    std::error_code removeError;
+    fs::remove(it->path(), removeError);
+  }
+}
+
+fs::path CompileCache::entryPath(uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.cache",
+                static_cast<unsigned long long>(key));
+  return directory / name;
+}
+
+bool CompileCache::load(uint64_t key, std::string &output, bool &passed) {
+  fs::path path = entryPath(key);
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return false;
+  std::string magic;
+  int pass = 0;
+  size_t size = 0;
+  if (!(file >> magic >> pass >> size) || magic != CACHE_MAGIC ||
+      file.get() != '\n')
+    return false;
+  output.resize(size);
+  if (size > 0 && !file.read(&output[0], size))
+    return false;
+  passed = pass != 0;
+  std::error_code ec;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  return true;
+}
+
+void CompileCache::store(uint64_t key, const std::string &output,
+                         bool passed) {
+  static std::atomic<unsigned int> counter{0};
+  fs::path path = entryPath(key);
+  std::ostringstream tmpName;
+  tmpName << path.filename().string() << ".tmp." << getpid() << "."
+          << std::hash<std::thread::id>()(std::this_thread::get_id()) << "."
+          << counter++;
+  fs::path tmp = directory / tmpName.str();
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+      return;
+    file << CACHE_MAGIC << " " << (passed ? 1 : 0) << " " << output.size()
+         << "\n";
+    file.write(output.data(), output.size());
+    if (!file.good()) {
+      file.close();
+      std::error_code ec;
+      fs::remove(tmp, ec);
+      return;
+    }
+  }
+  std::error_code ec;
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    fs::remove(tmp, ec);
+    return;
+  }
+  evict();
+}
+
+// Other workers may evict the same files at the same time, so every
+// filesystem error here just means someone else got there first.
+void CompileCache::evict() {
+  struct Entry {
+    fs::path path;
+    fs::file_time_type used;
+    uintmax_t size;
+  };
+  std::vector<Entry> entries;
+  uintmax_t total = 0;
+  std::error_code ec;
+  for (fs::directory_iterator it(directory, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (it->path().extension() != ".cache")
+      continue;
+    std::error_code entryError;
+    uintmax_t size = it->file_size(entryError);
+    fs::file_time_type used = it->last_write_time(entryError);
+    if (entryError)
+      continue;
+    entries.push_back({it->path(), used, size});
+    total += size;
+  }
+  if (total <= maxBytes)
+    return;
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.used < b.used; });
+  for (const Entry &entry : entries) {
+    if (total <= maxBytes)
+      break;
+    if (fs::remove(entry.path, ec))
+      total -= entry.size;
+  }
+}
@@ -1,56 +1,405 @@
 #include "Compiler.h"
+#include "AllocStats.h"
+#include "Ast.h"
+#include "Bytecode.h"
+#include "CallGraph.h"
+#include "CompileCache.h"
+#include "ConstantPool.h"
+#include "IR.h"
+#include "Interner.h"
+#include "Layout.h"
+#include "Optimizer.h"
+#include "Prelude.h"
+#include "TokenRing.h"
+#include "VM.h"
+#include "X86Emitter.h"
+#include <chrono>
 #include <iomanip>
 #include <iostream>
+#include <thread>
+#include <unordered_set>
 
-Compiler::Compiler(std::string filename, std::string resultsname) {
-  this->sourceCode = readFile(filename);
-  this->out = ofstream(resultsname);
-  this->lexer = Lexer(sourceCode);
-  this->parser = Parser();
+static std::string readSource(const std::string &filename) {
+  PhaseScope phase(PHASE_READ);
+  return readFile(filename);
 }
 
+Compiler::Compiler(std::string filename, std::string resultsname,
+                   CompilerOptions options)
+    : lexer(readSource(filename)), out(resultsname), resultsName(resultsname),
+      options(options) {
+  this->lexer.setFileName(filename);
+  this->lexer.setMaxErrors(options.maxErrors);
+  this->lexer.setUnicodeIdentifiers(options.unicodeIdentifiers);
+  this->sources = this->lexer.getSources();
+}
+
+Compiler::Compiler(TokenBuffer tokens, std::vector<Trivia> trivia,
+                   std::shared_ptr<const SourceMap> sources,
+                   std::string resultsname, CompilerOptions options)
+    : tokens(std::move(tokens)), trivia(std::move(trivia)),
+      sources(std::move(sources)), prelexed(true), out(resultsname),
+      resultsName(resultsname), options(options) {}
+
+void Compiler::setConsole(std::ostream &stream) { this->console = &stream; }
+
 int Compiler::calcLexerErrorCount() {
   int err_count = 0;
-  for (auto &&i : this->tokens) {
+  for (const Token &i : TokenSpan(*this->tokens)) {
     err_count += (i.error) ? 1 : 0;
   }
+  for (const Trivia &comment : this->trivia) {
+    err_count += comment.token.error ? 1 : 0;
+  }
   return err_count;
 }
 
 void Compiler::printLexerTokens() {
-  std::cout << left << std::setw(8) << "Line" << "| " << std::setw(15)
+  *this->console << left << std::setw(8) << "Line" << "| " << std::setw(15)
             << "Lexeme" << "| "
             << "Token Type\n";
-  std::cout << string(50, '-') << "\n";
+  *this->console << string(50, '-') << "\n";
   this->out << left << std::setw(8) << "Line" << "| " << std::setw(15)
             << "Lexeme" << "| "
             << "Token Type\n";
   this->out << string(50, '-') << "\n";
 
+  const SourceMap &sources = *this->sources;
   int errorCount = 0;
-  for (const auto &token : tokens) {
+  auto print = [&](const Token &token) {
     string errorNote = token.error ? " (Error)" : "";
-    std::cout << left << std::setw(8) << token.line << "| " << std::setw(15)
+    uint32_t line = sources.line(token.file, token.offset);
+    *this->console << left << std::setw(8) << line << "| " << std::setw(15)
               << token.text << "| " << tokenTypeToString(token.type)
               << errorNote << "\n";
-    out << left << std::setw(8) << token.line << "| " << std::setw(15)
+    out << left << std::setw(8) << line << "| " << std::setw(15)
         << token.text << "| " << tokenTypeToString(token.type) << errorNote
         << "\n";
     if (token.error)
       errorCount++;
+  };
+  // Each comment goes before the token that followed it in the source.
+  TokenSpan tokens(*this->tokens);
+  size_t next = 0;
+  for (size_t i = 0; i < tokens.size(); i++) {
+    for (; next < this->trivia.size() && this->trivia[next].before <= i; next++)
+      print(this->trivia[next].token);
+    print(tokens[i]);
   }
+  for (; next < this->trivia.size(); next++)
+    print(this->trivia[next].token);
 
-  cout << "\nTotal Number of lexical errors: " << errorCount << "\n";
+  *this->console << "\nTotal Number of lexical errors: " << errorCount << "\n";
   out << "\nTotal Number of lexical errors: " << errorCount << "\n";
 }
 
+// The parser consumes batches while the lexer is still producing them. The
+// token table can only be printed once everything has been lexed, and the
+// parser report is buffered anyway, so the output is the same as in the
+// sequential mode.
+template <typename Sink>
+void Compiler::runPipelined(BasicParser<Sink> &parser) {
+  TokenRing ring;
+  std::thread producer([&]() {
+    PhaseScope phase(PHASE_LEX);
+    try {
+      this->lexer.setStream(&ring);
+      this->lexer.tokenize();
+      ring.close();
+    } catch (...) {
+      ring.close(std::current_exception());
+    }
+  });
+  try {
+    PhaseScope phase(PHASE_PARSE);
+    parser.setTokenStream(ring, this->lexer.expectedTokens());
+    parser.parse();
+    if (parser.wasAborted()) {
+      ring.cancel();
+    }
+    parser.drainTokenStream();
+  } catch (...) {
+    ring.cancel();
+    producer.join();
+    throw;
+  }
+  producer.join();
+  if (ring.error()) {
+    std::rethrow_exception(ring.error());
+  }
+  this->tokens = parser.releaseTokens();
+  this->trivia = this->lexer.releaseTrivia();
+}
+
+// Hashes everything the output depends on: the compiler build, the options
+// that change the report, this source and every file it pulls in.
+uint64_t Compiler::cacheKey() {
+  static const uint64_t build = CompileCache::buildHash(COMPILER_VERSION);
+  std::string config = std::to_string(this->options.maxErrors) +
+                       (this->options.unicodeIdentifiers ? " unicode" : "");
+  uint64_t key = CompileCache::hash(config, build);
+  key = CompileCache::hash(this->lexer.getSource(), key);
+  std::vector<std::string> pending = this->lexer.scanIncludes();
+  std::unordered_set<std::string> seen;
+  while (!pending.empty()) {
+    std::string path = pending.back();
+    pending.pop_back();
+    if (!seen.insert(path).second)
+      continue;
+    Lexer included(readInclude(path));
+    key = CompileCache::hash(path, key);
+    key = CompileCache::hash(included.getSource(), key);
+    for (const std::string &next : included.scanIncludes())
+      pending.push_back(next);
+  }
+  return key;
+}
+
 bool Compiler::compile() {
-  this->tokens = this->lexer.tokenize();
-  this->printLexerTokens();
-  this->parser.setTokens(this->tokens);
-  this->parser.parse(this->out);
-  this->parser.printParserOutput(this->out);
+  if (this->options.run || this->options.dumpIr || this->options.timePasses ||
+      this->options.layout || this->options.reorderFields ||
+      !this->options.nativeOutput.empty()) {
+    if (!this->run()) {
+      *this->console << "\nSkipping the backend: the program has errors\n";
+      return false;
+    }
+    return this->backend();
+  }
+  if (this->options.cacheDir.empty() ||
+      this->options.report != FORMAT_TEXT || this->prelexed)
+    return this->run();
+
+  CompileCache cache(this->options.cacheDir, this->options.cacheMaxBytes);
+  uint64_t key = this->cacheKey();
+  std::string output;
+  bool passed = false;
+  if (cache.load(key, output, passed)) {
+    *this->console << output;
+    this->out << output;
+    this->out.close();
+    return passed;
+  }
+  passed = this->run();
+  cache.store(key, readFile(this->resultsName), passed);
+  return passed;
+}
+
+bool Compiler::run() {
+  switch (this->options.report) {
+  case FORMAT_NDJSON:
+    return this->runWith(NdjsonSink(this->console));
+  case FORMAT_NONE:
+    return this->runWith(NullSink());
+  default:
+    return this->runWith(TextSink());
+  }
+}
+
+template <typename Sink> bool Compiler::runWith(Sink sink) {
+  BasicParser<Sink> parser(std::move(sink));
+  parser.setMaxErrors(this->options.maxErrors);
+  parser.setSources(this->sources);
+  bool table = this->options.report == FORMAT_TEXT;
+  if (this->options.pipelined && !this->prelexed) {
+    this->runPipelined(parser);
+    if (table) {
+      PhaseScope phase(PHASE_REPORT);
+      this->printLexerTokens();
+    }
+  } else {
+    if (!this->prelexed) {
+      PhaseScope phase(PHASE_LEX);
+      this->tokens =
+          std::make_shared<const vector<Token>>(this->lexer.tokenize());
+      this->trivia = this->lexer.releaseTrivia();
+    }
+    if (table) {
+      PhaseScope phase(PHASE_REPORT);
+      this->printLexerTokens();
+    }
+    PhaseScope phase(PHASE_PARSE);
+    parser.setTokens(this->tokens);
+    parser.parse();
+  }
+  PhaseScope phase(PHASE_REPORT);
+  parser.printParserOutput(*this->console, this->out);
   this->out.close();
-  return (this->parser.getErrorCount() == 0 &&
+  return (parser.getErrorCount() == 0 &&
+          parser.getSemanticErrorCount() == 0 &&
           this->calcLexerErrorCount() == 0);
-}
\ No newline at end of file
+}
+
+namespace {
+
+// Wall-clock time of each backend pass, for --time-passes.
+class PassTimer {
+public:
+  void lap(const char *name, std::string note = std::string()) {
+    auto now = std::chrono::steady_clock::now();
+    passes.push_back({name, std::chrono::duration<double>(now - start).count(),
+                      std::move(note)});
+    start = now;
+  }
+
+  void print(std::ostream &os) const {
+    double total = 0;
+    os << "\nPass timings:\n" << std::fixed << std::setprecision(3);
+    for (const Pass &pass : passes) {
+      os << "  " << std::left << std::setw(14) << pass.name << std::right
+         << std::setw(10) << pass.seconds * 1000 << " ms";
+      if (!pass.note.empty())
+        os << "  (" << pass.note << ")";
+      os << "\n";
+      total += pass.seconds;
+    }
+    os << "  " << std::left << std::setw(14) << "total" << std::right
+       << std::setw(10) << total * 1000 << " ms\n"
+       << std::defaultfloat;
+  }
+
+private:
+  struct Pass {
+    const char *name;
+    double seconds;
+    std::string note;
+  };
+  std::vector<Pass> passes;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+};
+
+} // namespace
+
+// Builds the tree and lowers it to bytecode, then dumps the IR and runs main
+// as asked. Only called for programs without lexical, syntax or semantic
+// errors.
+bool Compiler::backend() {
+  const SourceMap &sources = *this->sources;
+  PassTimer timer;
+  try {
+    Program program = AstBuilder(TokenSpan(*this->tokens)).build();
+    timer.lap("build AST");
+    *this->console << "\n";
+    if (this->options.optimize) {
+      DeadCodeStats dead = DeadCodeEliminator().eliminate(program);
+      timer.lap("dead code");
+      printDeadCode(dead, sources, *this->console);
+      OptimizeStats optimized = AstOptimizer().optimize(program);
+      timer.lap("optimize");
+      *this->console << "Folded " << optimized.folded
+                << " constant expressions, removed " << optimized.branches
+                << " constant branches and " << optimized.unreachable
+                << " unreachable statements (" << optimized.nodes
+                << " nodes eliminated)\n";
+    }
+    if (this->options.layout || this->options.reorderFields) {
+      LayoutEngine layouts(program);
+      timer.lap("layout");
+      if (this->options.layout)
+        layouts.print(*this->console);
+      if (this->options.reorderFields)
+        layouts.apply(program);
+    }
+    Bytecode bytecode = BytecodeCompiler().compile(program);
+    timer.lap("bytecode");
+    const std::string &native = this->options.nativeOutput;
+    if (this->options.dumpIr || this->options.timePasses || !native.empty()) {
+      IrModule module = lowerToIr(bytecode);
+      size_t blocks = 0;
+      for (const IrFunction &function : module.functions)
+        blocks += function.blocks.size();
+      timer.lap("lower to IR", std::to_string(blocks) + " blocks");
+      size_t visits = 0;
+      for (IrFunction &function : module.functions)
+        visits += computeLiveness(function);
+      timer.lap("liveness", std::to_string(visits) + " block visits");
+      if (this->options.dumpIr) {
+        dumpIr(module, *this->console);
+        timer.lap("dump IR");
+      }
+      if (!native.empty()) {
+        std::string assembly = native + ".s";
+        {
+          std::ofstream file(assembly);
+          X86Emitter(module).emit(file);
+        }
+        timer.lap("emit x86-64");
+        std::string error;
+        if (!assembleAndLink(assembly, native, error)) {
+          *this->console << "Native build failed: " << error << "\n";
+          return false;
+        }
+        timer.lap("assemble+link");
+        *this->console << "Wrote " << assembly << " and linked " << native
+                  << "\n";
+      }
+    }
+    if (this->options.run) {
+      VM vm(bytecode);
+      auto start = std::chrono::steady_clock::now();
+      Value result = vm.run();
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      timer.lap("run");
+      *this->console << "Program returned ";
+      if (bytecode.functions[bytecode.main].floatResult)
+        *this->console << result.f << "\n";
+      else
+        *this->console << result.i << "\n";
+      double seconds = elapsed.count();
+      *this->console << "Executed " << vm.getInstructionCount()
+                << " instructions in " << std::fixed << std::setprecision(3)
+                << seconds * 1000 << " ms";
+      if (seconds > 0) {
+        *this->console << " (" << std::setprecision(1)
+                  << vm.getInstructionCount() / seconds / 1e6
+                  << " million per second)";
+      }
+      *this->console << std::defaultfloat << "\n";
+    }
+    if (this->options.timePasses)
+      timer.print(*this->console);
+    return true;
+  } catch (const CompileError &error) {
+    uint32_t line = 0;
+    uint32_t column = 0;
+    sources.position(error.file, error.offset, line, column);
+    *this->console << "\nLine : " << line << ":" << column
+              << " Backend Error: " << error.what() << "\n";
+  } catch (const RuntimeError &error) {
+    *this->console << "\nRuntime Error: " << error.what() << "\n";
+  }
+  return false;
+}
+
+// Counts what the identifier lexemes cost as per-token strings. Tokens keep
+// their text for the printed table, so this is held on top of the interner.
+void Compiler::collectStats(CompileStats &stats) const {
+  if (!this->tokens)
+    return;
+  for (const Token &token : TokenSpan(*this->tokens)) {
+    if (token.constant != 0)
+      stats.constants++;
+    if (token.type != IDENTIFIER)
+      continue;
+    stats.identifiers++;
+    stats.identifierBytes += sizeof(std::string);
+    if (token.text.capacity() > std::string().capacity())
+      stats.identifierBytes += token.text.capacity() + 1;
+  }
+}
+
+void printStats(const CompileStats &stats) {
+  const Interner &interner = Interner::current();
+  std::cout << "\nIdentifier occurrences: " << stats.identifiers << "\n";
+  std::cout << "Distinct symbols: " << interner.symbolCount() << " ("
+            << interner.lookupCount() << " lookups)\n";
+  std::cout << "Identifier bytes in token strings: " << stats.identifierBytes
+            << "\n";
+  std::cout << "Interner bytes: " << interner.memoryBytes() << " ("
+            << interner.arenaBytes() << " of names)\n";
+  const ConstantPool &pool = ConstantPool::current();
+  std::cout << "Numeric literals: " << stats.constants << ", "
+            << pool.constantCount() << " distinct in the constant pool\n";
+  printAllocationStats(std::cout);
+}
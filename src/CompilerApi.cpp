@@ -0,0 +1,137 @@
+#include "CompilerApi.h"
+#include "CompilerContext.h"
+
+struct cmp_context {
+  CompilerContext context;
+  cmp_include_resolver resolver = nullptr;
+  void *user = nullptr;
+};
+
+// tokenTypeToString builds a new string each time; C callers get pointers
+// into this table instead, which lives as long as the process.
+static const char *typeName(TokenType type) {
+  static const std::vector<std::string> names = [] {
+    std::vector<std::string> names;
+    for (int type = 0; type <= EOF_TOKEN; type++)
+      names.push_back(tokenTypeToString(static_cast<TokenType>(type)));
+    return names;
+  }();
+  return names[type].c_str();
+}
+
+static void fillToken(const cmp_context *context, const Token &source,
+                      cmp_token *token) {
+  token->text = source.text.data();
+  token->size = source.text.size();
+  token->type = typeName(source.type);
+  context->context.position(source, token->line, token->column);
+  token->file = source.file;
+  token->error = source.error ? 1 : 0;
+}
+
+extern "C" {
+
+cmp_context *cmp_context_new(unsigned int max_errors,
+                             int unicode_identifiers) {
+  CompilerOptions options;
+  options.maxErrors = max_errors;
+  options.unicodeIdentifiers = unicode_identifiers != 0;
+  try {
+    return new cmp_context{CompilerContext(options)};
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void cmp_context_free(cmp_context *context) { delete context; }
+
+void cmp_context_set_include_resolver(cmp_context *context,
+                                      cmp_include_resolver resolver,
+                                      void *user) {
+  context->resolver = resolver;
+  context->user = user;
+  context->context.setIncludeResolver(
+      [context](const std::string &path, std::string &contents) {
+        const char *data = nullptr;
+        size_t size = 0;
+        if (context->resolver == nullptr ||
+            !context->resolver(context->user, path.c_str(), &data, &size))
+          return false;
+        contents.assign(data, size);
+        return true;
+      });
+}
+
+int cmp_compile(cmp_context *context, const char *source, size_t size) {
+  try {
+    return context->context.compile(std::string(source, size)) ? 1 : 0;
+  } catch (...) {
+    context->context.reset();
+    return -1;
+  }
+}
+
+void cmp_context_reset(cmp_context *context) { context->context.reset(); }
+
+size_t cmp_token_count(const cmp_context *context) {
+  return context->context.getTokens().size();
+}
+
+int cmp_token_get(const cmp_context *context, size_t index, cmp_token *token) {
+  const std::vector<Token> &tokens = context->context.getTokens();
+  if (index >= tokens.size())
+    return 0;
+  fillToken(context, tokens[index], token);
+  return 1;
+}
+
+size_t cmp_comment_count(const cmp_context *context) {
+  return context->context.getTrivia().size();
+}
+
+int cmp_comment_get(const cmp_context *context, size_t index,
+                    cmp_token *token, size_t *before) {
+  const std::vector<Trivia> &trivia = context->context.getTrivia();
+  if (index >= trivia.size())
+    return 0;
+  fillToken(context, trivia[index].token, token);
+  *before = trivia[index].before;
+  return 1;
+}
+
+size_t cmp_diagnostic_count(const cmp_context *context) {
+  return context->context.getDiagnostics().size();
+}
+
+int cmp_diagnostic_get(const cmp_context *context, size_t index,
+                       cmp_diagnostic *diagnostic) {
+  const std::vector<Diagnostic> &diagnostics =
+      context->context.getDiagnostics();
+  if (index >= diagnostics.size())
+    return 0;
+  const Diagnostic &source = diagnostics[index];
+  diagnostic->kind = static_cast<cmp_report_kind>(source.kind);
+  diagnostic->line = source.line;
+  diagnostic->column = source.column;
+  diagnostic->message = source.message.c_str();
+  diagnostic->file = source.file;
+  return 1;
+}
+
+const char *cmp_file_name(const cmp_context *context, uint16_t file) {
+  const std::vector<std::string> &names = context->context.getFileNames();
+  return file < names.size() ? names[file].c_str() : nullptr;
+}
+
+unsigned int cmp_lexical_error_count(const cmp_context *context) {
+  return context->context.getLexicalErrorCount();
+}
+
+unsigned int cmp_error_count(const cmp_context *context) {
+  return context->context.getErrorCount();
+}
+
+unsigned int cmp_semantic_error_count(const cmp_context *context) {
+  return context->context.getSemanticErrorCount();
+}
+}
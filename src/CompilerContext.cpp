@@ -0,0 +1,88 @@
+#include "CompilerContext.h"
+#include "AllocStats.h"
+
+CompilerContext::CompilerContext(CompilerOptions options)
+    : options(options), sources(std::make_shared<SourceMap>()),
+      tokens(std::make_shared<std::vector<Token>>()) {
+  this->parser.setMaxErrors(options.maxErrors);
+  this->parser.setSources(this->sources);
+  this->resolver = [](const std::string &, std::string &) { return false; };
+}
+
+void CompilerContext::setIncludeResolver(Lexer::IncludeResolver resolver) {
+  if (resolver)
+    this->resolver = std::move(resolver);
+}
+
+bool CompilerContext::compile(std::string source) {
+  this->reset();
+  Interner::Scope symbols(this->interner);
+  ConstantPool::Scope literals(this->constants);
+  {
+    PhaseScope phase(PHASE_LEX);
+    Lexer lexer(std::move(source), this->sources);
+    lexer.setMaxErrors(this->options.maxErrors);
+    lexer.setUnicodeIdentifiers(this->options.unicodeIdentifiers);
+    lexer.setIncludeResolver(this->resolver);
+    lexer.tokenize(*this->tokens, this->trivia);
+    this->lexicalErrors = static_cast<unsigned int>(lexer.getErrorCount());
+  }
+  this->fileNames.resize(this->sources->size());
+  for (size_t file = 0; file < this->fileNames.size(); file++)
+    this->fileNames[file] = this->sources->name(static_cast<uint16_t>(file));
+
+  PhaseScope phase(PHASE_PARSE);
+  this->parser.setTokens(this->tokens);
+  this->parser.parse();
+  const StructuredSink &sink = this->parser.getSink();
+  this->diagnostics.assign(sink.getDiagnostics().begin(),
+                           sink.getDiagnostics().end());
+  this->errors = sink.getErrorCount();
+  this->semanticErrors = sink.getSemanticErrorCount();
+  return this->lexicalErrors == 0 && this->errors == 0 &&
+         this->semanticErrors == 0;
+}
+
+void CompilerContext::reset() {
+  this->interner.clear();
+  this->constants.clear();
+  this->sources->clear();
+  this->tokens->clear();
+  this->trivia.clear();
+  this->diagnostics.clear();
+  this->fileNames.clear();
+  this->lexicalErrors = 0;
+  this->errors = 0;
+  this->semanticErrors = 0;
+}
+
+const std::vector<Token> &CompilerContext::getTokens() const {
+  return *this->tokens;
+}
+
+const std::vector<Trivia> &CompilerContext::getTrivia() const {
+  return this->trivia;
+}
+
+const std::vector<Diagnostic> &CompilerContext::getDiagnostics() const {
+  return this->diagnostics;
+}
+
+const std::vector<std::string> &CompilerContext::getFileNames() const {
+  return this->fileNames;
+}
+
+unsigned int CompilerContext::getLexicalErrorCount() const {
+  return this->lexicalErrors;
+}
+
+unsigned int CompilerContext::getErrorCount() const { return this->errors; }
+
+unsigned int CompilerContext::getSemanticErrorCount() const {
+  return this->semanticErrors;
+}
+
+void CompilerContext::position(const Token &token, uint32_t &line,
+                               uint32_t &column) const {
+  this->sources->position(token.file, token.offset, line, column);
+}
@@ -0,0 +1,76 @@
+#include "ConstantPool.h"
+#include <cstring>
+
+static ConstantPool &processPool() {
+  static ConstantPool instance;
+  return instance;
+}
+
+static thread_local ConstantPool *scoped_pool = nullptr;
+
+ConstantPool &ConstantPool::current() {
+  return scoped_pool != nullptr ? *scoped_pool : processPool();
+}
+
+ConstantPool::Scope::Scope(ConstantPool &pool) : previous(scoped_pool) {
+  scoped_pool = &pool;
+}
+
+ConstantPool::Scope::~Scope() { scoped_pool = previous; }
+
+ConstantPool::ConstantPool() { constants.push_back(Constant()); }
+
+void ConstantPool::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  constants.resize(1);
+  ints.clear();
+  floats.clear();
+  lookups = 0;
+}
+
+uint32_t ConstantPool::addInt(int64_t value) {
+  Constant constant;
+  constant.kind = LITERAL_IMW;
+  constant.intValue = value;
+  constant.floatValue = static_cast<double>(value);
+  return add(ints, static_cast<uint64_t>(value), constant);
+}
+
+uint32_t ConstantPool::addFloat(double value) {
+  Constant constant;
+  constant.kind = LITERAL_IMWF;
+  // intValue stays 0: converting a NaN, an infinity or a value past the
+  // range of int64_t is undefined, and nothing reads it for an IMwf.
+  constant.floatValue = value;
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return add(floats, bits, constant);
+}
+
+uint32_t ConstantPool::add(std::unordered_map<uint64_t, uint32_t> &ids,
+                           uint64_t bits, const Constant &constant) {
+  std::lock_guard<std::mutex> lock(mutex);
+  lookups++;
+  auto inserted =
+      ids.emplace(bits, static_cast<uint32_t>(constants.size()));
+  if (inserted.second)
+    constants.push_back(constant);
+  return inserted.first->second;
+}
+
+Constant ConstantPool::get(uint32_t id) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (id >= constants.size())
+    return Constant();
+  return constants[id];
+}
+
+size_t ConstantPool::constantCount() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return constants.size() - 1;
+}
+
+size_t ConstantPool::lookupCount() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return lookups;
+}
@@ -0,0 +1,516 @@
+#include "IR.h"
+#include "Interner.h"
+#include <unordered_map>
+
+bool BitSet::assignTransfer(const BitSet &use, const BitSet &out,
+                            const BitSet &def) {
+  bool changed = false;
+  for (size_t i = 0; i < words.size(); i++) {
+    uint64_t value = use.words[i] | (out.words[i] & ~def.words[i]);
+    changed |= value != words[i];
+    words[i] = value;
+  }
+  return changed;
+}
+
+void BitSet::unite(const BitSet &other) {
+  for (size_t i = 0; i < words.size(); i++)
+    words[i] |= other.words[i];
+}
+
+size_t BitSet::count() const {
+  size_t bits = 0;
+  for (uint64_t word : words)
+    bits += __builtin_popcountll(word);
+  return bits;
+}
+
+static const uint32_t NO_BLOCK = UINT32_MAX;
+
+static bool isJump(uint8_t op) {
+  return op == OP_JMP || op == OP_JMPF || op == OP_JMPT;
+}
+
+static bool endsBlock(uint8_t op) {
+  return isJump(op) || op == OP_RET || op == OP_RETV;
+}
+
+static IrInstr lowerInstruction(const Bytecode &bytecode,
+                                const Instruction &in, IrFunction &function) {
+  IrInstr instr;
+  switch (in.op) {
+  case OP_MOVE:
+    instr.op = IR_COPY;
+    instr.dst = in.a;
+    instr.a = in.b;
+    break;
+  case OP_LOADK:
+    instr.op = IR_CONST;
+    instr.dst = in.a;
+    instr.imm = in.bx();
+    instr.isFloat = bytecode.floatConstants[in.bx()];
+    break;
+  case OP_GETG:
+    instr.op = IR_GETG;
+    instr.dst = in.a;
+    instr.imm = in.bx();
+    break;
+  case OP_SETG:
+    instr.op = IR_SETG;
+    instr.a = in.a;
+    instr.imm = in.bx();
+    break;
+  case OP_ADDI:
+  case OP_SUBI:
+  case OP_MULI:
+  case OP_DIVI:
+    instr.op = static_cast<IrOp>(IR_ADD + (in.op - OP_ADDI));
+    instr.dst = in.a;
+    instr.a = in.b;
+    instr.b = in.c;
+    break;
+  case OP_ADDF:
+  case OP_SUBF:
+  case OP_MULF:
+  case OP_DIVF:
+    instr.op = static_cast<IrOp>(IR_ADD + (in.op - OP_ADDF));
+    instr.isFloat = true;
+    instr.dst = in.a;
+    instr.a = in.b;
+    instr.b = in.c;
+    break;
+  case OP_LTI:
+  case OP_LEI:
+  case OP_EQI:
+  case OP_NEI:
+    instr.op = static_cast<IrOp>(IR_LT + (in.op - OP_LTI));
+    instr.dst = in.a;
+    instr.a = in.b;
+    instr.b = in.c;
+    break;
+  case OP_LTF:
+  case OP_LEF:
+  case OP_EQF:
+  case OP_NEF:
+    instr.op = static_cast<IrOp>(IR_LT + (in.op - OP_LTF));
+    instr.isFloat = true;
+    instr.dst = in.a;
+    instr.a = in.b;
+    instr.b = in.c;
+    break;
+  case OP_ITOF:
+  case OP_FTOI:
+    instr.op = in.op == OP_ITOF ? IR_ITOF : IR_FTOI;
+    instr.dst = in.a;
+    instr.a = in.b;
+    break;
+  case OP_NEW:
+    instr.op = IR_NEW;
+    instr.dst = in.a;
+    instr.imm = in.bx();
+    break;
+  case OP_GETX:
+    instr.op = IR_GETX;
+    instr.dst = in.a;
+    instr.a = in.b;
+    instr.b = in.c;
+    break;
+  case OP_SETX:
+    instr.op = IR_SETX;
+    instr.a = in.a;
+    instr.b = in.b;
+    instr.c = in.c;
+    break;
+  case OP_GETF:
+    instr.op = IR_GETF;
+    instr.dst = in.a;
+    instr.a = in.b;
+    instr.imm = in.c;
+    break;
+  case OP_SETF:
+    instr.op = IR_SETF;
+    instr.a = in.a;
+    instr.imm = in.b;
+    instr.b = in.c;
+    break;
+  default: {
+    // Arguments sit in consecutive registers starting at the result's.
+    instr.op = IR_CALL;
+    instr.dst = in.a;
+    instr.imm = in.bx();
+    instr.argStart = static_cast<uint32_t>(function.args.size());
+    instr.argCount = bytecode.functions[in.bx()].params;
+    for (uint32_t i = 0; i < instr.argCount; i++)
+      function.args.push_back(in.a + i);
+    break;
+  }
+  }
+  return instr;
+}
+
+static IrFunction lowerFunction(const Bytecode &bytecode,
+                                const Function &source) {
+  IrFunction function;
+  function.name = source.name;
+  function.params = source.params;
+  function.registers = source.registers;
+  function.floatResult = source.floatResult;
+  function.floatParams = source.floatParams;
+
+  const std::vector<Instruction> &code = source.code;
+  size_t size = code.size();
+  std::vector<char> leader(size, 0);
+  // A jump to the end of the code, or code that runs off it, gets an empty
+  // block that returns 0 as RETV would.
+  bool endBlock = size == 0 || !endsBlock(code[size - 1].op);
+  for (size_t pc = 0; pc < size; pc++) {
+    if (isJump(code[pc].op)) {
+      if (code[pc].bx() < size)
+        leader[code[pc].bx()] = 1;
+      else
+        endBlock = true;
+    }
+    if (endsBlock(code[pc].op) && pc + 1 < size)
+      leader[pc + 1] = 1;
+  }
+  std::vector<uint32_t> blockOf(size + 1, NO_BLOCK);
+  std::vector<uint32_t> starts;
+  for (size_t pc = 0; pc < size; pc++) {
+    if (pc == 0 || leader[pc]) {
+      blockOf[pc] = static_cast<uint32_t>(starts.size());
+      starts.push_back(static_cast<uint32_t>(pc));
+    }
+  }
+  if (endBlock) {
+    blockOf[size] = static_cast<uint32_t>(starts.size());
+    starts.push_back(static_cast<uint32_t>(size));
+  }
+
+  std::vector<IrBlock> blocks(starts.size());
+  for (size_t b = 0; b < starts.size(); b++) {
+    IrBlock &block = blocks[b];
+    size_t end = b + 1 < starts.size() ? starts[b + 1] : size;
+    size_t pc = starts[b];
+    for (; pc < end && !endsBlock(code[pc].op); pc++)
+      block.code.push_back(lowerInstruction(bytecode, code[pc], function));
+    uint32_t next = b + 1 < starts.size() ? static_cast<uint32_t>(b + 1)
+                                          : NO_BLOCK;
+    if (pc == end) {
+      if (next == NO_BLOCK) {
+        block.term.kind = TERM_RETURN;
+      } else {
+        block.term.kind = TERM_JUMP;
+        block.succs.push_back(next);
+      }
+      continue;
+    }
+    const Instruction &last = code[pc];
+    switch (last.op) {
+    case OP_JMP:
+      block.term.kind = TERM_JUMP;
+      block.succs.push_back(blockOf[last.bx()]);
+      break;
+    case OP_JMPF:
+      block.term.kind = TERM_BRANCH;
+      block.term.cond = last.a;
+      block.succs.push_back(next);
+      block.succs.push_back(blockOf[last.bx()]);
+      break;
+    case OP_JMPT:
+      block.term.kind = TERM_BRANCH;
+      block.term.cond = last.a;
+      block.succs.push_back(blockOf[last.bx()]);
+      block.succs.push_back(next);
+      break;
+    case OP_RET:
+      block.term.kind = TERM_RETURN;
+      block.term.value = last.a;
+      break;
+    default:
+      block.term.kind = TERM_RETURN;
+      break;
+    }
+  }
+
+  // Drop blocks nothing reaches, such as the RETV after a final Turnback,
+  // keeping the rest in code order so fall-through edges stay adjacent.
+  std::vector<uint32_t> renumber(blocks.size(), NO_BLOCK);
+  std::vector<uint32_t> stack{0};
+  renumber[0] = 0;
+  while (!stack.empty()) {
+    uint32_t b = stack.back();
+    stack.pop_back();
+    for (uint32_t succ : blocks[b].succs) {
+      if (renumber[succ] == NO_BLOCK) {
+        renumber[succ] = 0;
+        stack.push_back(succ);
+      }
+    }
+  }
+  uint32_t kept = 0;
+  for (uint32_t &index : renumber)
+    if (index != NO_BLOCK)
+      index = kept++;
+  function.blocks.reserve(kept);
+  for (size_t b = 0; b < blocks.size(); b++) {
+    if (renumber[b] == NO_BLOCK)
+      continue;
+    for (uint32_t &succ : blocks[b].succs)
+      succ = renumber[succ];
+    function.blocks.push_back(std::move(blocks[b]));
+  }
+  for (uint32_t b = 0; b < function.blocks.size(); b++)
+    for (uint32_t succ : function.blocks[b].succs)
+      function.blocks[succ].preds.push_back(b);
+  return function;
+}
+
+IrModule lowerToIr(const Bytecode &bytecode) {
+  IrModule module;
+  module.bytecode = &bytecode;
+  module.functions.reserve(bytecode.functions.size());
+  for (const Function &function : bytecode.functions)
+    module.functions.push_back(lowerFunction(bytecode, function));
+  return module;
+}
+
+size_t computeLiveness(IrFunction &function) {
+  size_t registers = function.registers;
+  for (IrBlock &block : function.blocks) {
+    block.use = BitSet(registers);
+    block.def = BitSet(registers);
+    block.liveIn = BitSet(registers);
+    block.liveOut = BitSet(registers);
+    auto read = [&block](uint32_t reg) {
+      if (reg != IrInstr::NO_VALUE && !block.def.test(reg))
+        block.use.set(reg);
+    };
+    for (const IrInstr &instr : block.code) {
+      read(instr.a);
+      read(instr.b);
+      read(instr.c);
+      for (uint32_t i = 0; i < instr.argCount; i++)
+        read(function.args[instr.argStart + i]);
+      if (instr.dst != IrInstr::NO_VALUE)
+        block.def.set(instr.dst);
+    }
+    read(block.term.cond);
+    read(block.term.value);
+  }
+
+  // Post-order from the entry; pushing it reversed makes the first pass pop
+  // successors before their predecessors.
+  size_t count = function.blocks.size();
+  std::vector<uint32_t> order;
+  order.reserve(count);
+  std::vector<char> seen(count, 0);
+  std::vector<std::pair<uint32_t, size_t>> path;
+  if (count > 0) {
+    path.push_back({0, 0});
+    seen[0] = 1;
+  }
+  while (!path.empty()) {
+    auto &top = path.back();
+    const IrBlock &block = function.blocks[top.first];
+    if (top.second < block.succs.size()) {
+      uint32_t succ = block.succs[top.second++];
+      if (!seen[succ]) {
+        seen[succ] = 1;
+        path.push_back({succ, 0});
+      }
+    } else {
+      order.push_back(top.first);
+      path.pop_back();
+    }
+  }
+
+  std::vector<uint32_t> worklist(order.rbegin(), order.rend());
+  std::vector<char> queued(count, 1);
+  size_t visits = 0;
+  while (!worklist.empty()) {
+    uint32_t b = worklist.back();
+    worklist.pop_back();
+    queued[b] = 0;
+    visits++;
+    IrBlock &block = function.blocks[b];
+    // Live sets only grow, so the old live-out can be kept.
+    for (uint32_t succ : block.succs)
+      block.liveOut.unite(function.blocks[succ].liveIn);
+    if (!block.liveIn.assignTransfer(block.use, block.liveOut, block.def))
+      continue;
+    for (uint32_t pred : block.preds) {
+      if (!queued[pred]) {
+        queued[pred] = 1;
+        worklist.push_back(pred);
+      }
+    }
+  }
+  return visits;
+}
+
+static const char *opName(IrOp op) {
+  switch (op) {
+  case IR_CONST:
+    return "const";
+  case IR_COPY:
+    return "copy";
+  case IR_ADD:
+    return "add";
+  case IR_SUB:
+    return "sub";
+  case IR_MUL:
+    return "mul";
+  case IR_DIV:
+    return "div";
+  case IR_LT:
+    return "lt";
+  case IR_LE:
+    return "le";
+  case IR_EQ:
+    return "eq";
+  case IR_NE:
+    return "ne";
+  case IR_ITOF:
+    return "itof";
+  case IR_FTOI:
+    return "ftoi";
+  case IR_GETG:
+    return "getg";
+  case IR_SETG:
+    return "setg";
+  case IR_NEW:
+    return "new";
+  case IR_GETX:
+    return "getx";
+  case IR_SETX:
+    return "setx";
+  case IR_GETF:
+    return "getf";
+  case IR_SETF:
+    return "setf";
+  default:
+    return "call";
+  }
+}
+
+static void dumpSet(const BitSet &set, uint32_t registers, std::ostream &out) {
+  bool any = false;
+  for (uint32_t reg = 0; reg < registers; reg++) {
+    if (set.test(reg)) {
+      out << " r" << reg;
+      any = true;
+    }
+  }
+  if (!any)
+    out << " -";
+}
+
+static void dumpInstr(const IrModule &module, const IrFunction &function,
+                      const IrInstr &instr,
+                      const std::unordered_map<uint32_t, const std::string *>
+                          &strings,
+                      std::ostream &out) {
+  out << "    ";
+  if (instr.dst != IrInstr::NO_VALUE)
+    out << "r" << instr.dst << " = ";
+  out << opName(instr.op);
+  if (instr.isFloat)
+    out << "f";
+  switch (instr.op) {
+  case IR_CONST: {
+    auto string = strings.find(instr.imm);
+    Value value = module.bytecode->constants[instr.imm];
+    if (string != strings.end())
+      out << " \"" << *string->second << "\"";
+    else if (instr.isFloat)
+      out << " " << value.f;
+    else
+      out << " " << value.i;
+    break;
+  }
+  case IR_GETG:
+    out << " g" << instr.imm;
+    break;
+  case IR_SETG:
+    out << " g" << instr.imm << ", r" << instr.a;
+    break;
+  case IR_NEW:
+    out << " " << instr.imm;
+    break;
+  case IR_GETX:
+    out << " r" << instr.a << "[r" << instr.b << "]";
+    break;
+  case IR_SETX:
+    out << " r" << instr.a << "[r" << instr.b << "], r" << instr.c;
+    break;
+  case IR_GETF:
+    out << " r" << instr.a << "." << instr.imm;
+    break;
+  case IR_SETF:
+    out << " r" << instr.a << "." << instr.imm << ", r" << instr.b;
+    break;
+  case IR_CALL:
+    out << " "
+        << Interner::current().text(
+               module.bytecode->functions[instr.imm].name)
+        << "(";
+    for (uint32_t i = 0; i < instr.argCount; i++)
+      out << (i ? ", r" : "r") << function.args[instr.argStart + i];
+    out << ")";
+    break;
+  default:
+    out << " r" << instr.a;
+    if (instr.b != IrInstr::NO_VALUE)
+      out << ", r" << instr.b;
+    break;
+  }
+  out << "\n";
+}
+
+void dumpIr(const IrModule &module, std::ostream &out) {
+  std::unordered_map<uint32_t, const std::string *> strings;
+  for (const Bytecode::StringConstant &string : module.bytecode->strings)
+    strings.emplace(string.constant, &string.text);
+  for (size_t f = 0; f < module.functions.size(); f++) {
+    const IrFunction &function = module.functions[f];
+    out << "\nfunction ";
+    if (static_cast<int>(f) == module.bytecode->init)
+      out << "<init>";
+    else
+      out << Interner::current().text(function.name);
+    out << " ("
+        << function.params << " params, " << function.registers
+        << " registers, " << function.blocks.size() << " blocks)\n";
+    for (size_t b = 0; b < function.blocks.size(); b++) {
+      const IrBlock &block = function.blocks[b];
+      out << "  b" << b << ":  preds";
+      if (block.preds.empty())
+        out << " -";
+      for (uint32_t pred : block.preds)
+        out << " b" << pred;
+      out << "  live-in";
+      dumpSet(block.liveIn, function.registers, out);
+      out << "\n";
+      for (const IrInstr &instr : block.code)
+        dumpInstr(module, function, instr, strings, out);
+      out << "    ";
+      switch (block.term.kind) {
+      case TERM_JUMP:
+        out << "jump b" << block.succs[0];
+        break;
+      case TERM_BRANCH:
+        out << "branch r" << block.term.cond << " ? b" << block.succs[0]
+            << " : b" << block.succs[1];
+        break;
+      default:
+        out << "return";
+        if (block.term.value != IrInstr::NO_VALUE)
+          out << " r" << block.term.value;
+        break;
+      }
+      out << "  live-out";
+      dumpSet(block.liveOut, function.registers, out);
+      out << "\n";
+    }
+  }
+}
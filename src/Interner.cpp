@@ -0,0 +1,140 @@
+#include "Interner.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+static const char *const keywordNames[] = {
+    "IfTrue",     "Otherwise", "Imw",      "SIMw",    "Chj",  "Series",
+    "IMwf",       "SIMwf",     "NOReturn", "RepeatWhen",      "Reiterate",
+    "Turnback",   "OutLoop",   "Stop",     "Loli",    "include", "int"};
+
+static Interner &processInterner() {
+  static Interner instance;
+  return instance;
+}
+
+static thread_local Interner *scoped_interner = nullptr;
+
+Interner &Interner::current() {
+  return scoped_interner != nullptr ? *scoped_interner : processInterner();
+}
+
+Interner::Scope::Scope(Interner &table) : previous(scoped_interner) {
+  scoped_interner = &table;
+}
+
+Interner::Scope::~Scope() { scoped_interner = previous; }
+
+Interner::Interner()
+    : slots(1024, 0), chunk(nullptr), chunk_used(CHUNK_SIZE), next_chunk(0),
+      arena_bytes(0), large_bytes(0), lookups(0) {
+  clear();
+}
+
+void Interner::clear() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::fill(slots.begin(), slots.end(), 0);
+    // Slot value 0 means empty, so ID 0 is reserved for "no symbol".
+    entries.assign(1, Entry{nullptr, 0, 0});
+    large.clear();
+    chunk = nullptr;
+    chunk_used = CHUNK_SIZE;
+    next_chunk = 0;
+    arena_bytes = 0;
+    large_bytes = 0;
+    lookups = 0;
+  }
+  for (const char *name : keywordNames) {
+    intern(name);
+  }
+}
+
+uint32_t Interner::intern(std::string_view text) {
+  uint32_t hash =
+      static_cast<uint32_t>(std::hash<std::string_view>()(text));
+  std::lock_guard<std::mutex> lock(mutex);
+  lookups++;
+  size_t mask = slots.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    uint32_t id = slots[i];
+    if (id == 0) {
+      id = static_cast<uint32_t>(entries.size());
+      entries.push_back(
+          Entry{store(text), static_cast<uint32_t>(text.size()), hash});
+      slots[i] = id;
+      if (entries.size() * 2 > slots.size()) {
+        grow();
+      }
+      return id;
+    }
+    const Entry &entry = entries[id];
+    if (entry.hash == hash && entry.size == text.size() &&
+        std::memcmp(entry.data, text.data(), text.size()) == 0) {
+      return id;
+    }
+  }
+}
+
+std::string_view Interner::text(uint32_t id) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (id == 0 || id >= entries.size()) {
+    return std::string_view();
+  }
+  return std::string_view(entries[id].data, entries[id].size);
+}
+
+const char *Interner::store(std::string_view text) {
+  arena_bytes += text.size();
+  if (text.size() > CHUNK_SIZE / 4) {
+    large.emplace_back(new char[text.size()]);
+    large_bytes += text.size();
+    std::memcpy(large.back().get(), text.data(), text.size());
+    return large.back().get();
+  }
+  if (chunk_used + text.size() > CHUNK_SIZE) {
+    if (next_chunk == chunks.size())
+      chunks.emplace_back(new char[CHUNK_SIZE]);
+    chunk = chunks[next_chunk++].get();
+    chunk_used = 0;
+  }
+  char *dest = chunk + chunk_used;
+  std::memcpy(dest, text.data(), text.size());
+  chunk_used += text.size();
+  return dest;
+}
+
+void Interner::grow() {
+  std::vector<uint32_t> bigger(slots.size() * 2, 0);
+  size_t mask = bigger.size() - 1;
+  for (uint32_t id = 1; id < entries.size(); id++) {
+    size_t i = entries[id].hash & mask;
+    while (bigger[i] != 0) {
+      i = (i + 1) & mask;
+    }
+    bigger[i] = id;
+  }
+  slots.swap(bigger);
+}
+
+size_t Interner::symbolCount() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return entries.size() - 1;
+}
+
+size_t Interner::arenaBytes() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return arena_bytes;
+}
+
+size_t Interner::memoryBytes() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return slots.capacity() * sizeof(uint32_t) +
+         entries.capacity() * sizeof(Entry) + chunks.size() * CHUNK_SIZE +
+         large_bytes;
+}
+
+size_t Interner::lookupCount() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return lookups;
+}
@@ -0,0 +1,342 @@
+#include "Layout.h"
+#include "Interner.h"
+#include <algorithm>
+#include <iomanip>
+
+static std::string nameOf(uint32_t symbol) {
+  return std::string(Interner::current().text(symbol));
+}
+
+static uint64_t roundUp(uint64_t value, uint64_t align) {
+  return (value + align - 1) / align * align;
+}
+
+static std::string bytes(uint64_t count) {
+  return std::to_string(count) + (count == 1 ? " byte" : " bytes");
+}
+
+LayoutEngine::LayoutEngine(const Program &program) : program(program) {
+  for (size_t i = 0; i < program.structs.size(); i++)
+    this->index.emplace(program.structs[i].name, i);
+  for (const FunctionDecl &function : program.functions)
+    this->returns.emplace(function.name, function.returnType);
+  for (const VarDecl &global : program.globals)
+    this->globals[global.name] = Var{global.type, global.arraySize};
+
+  this->layouts.resize(program.structs.size());
+  this->laying.assign(program.structs.size(), false);
+  for (const StructDecl &decl : program.structs)
+    this->layout(decl.name, decl.offset, decl.file);
+
+  for (const FunctionDecl &function : program.functions) {
+    this->scopes.assign(1, {});
+    for (const VarDecl &param : function.params)
+      this->scopes.back()[param.name] = Var{param.type, param.arraySize};
+    if (function.body)
+      this->countStmt(*function.body);
+  }
+  this->scopes.clear();
+
+  for (StructLayout &layout : this->layouts)
+    this->suggest(layout);
+}
+
+const std::vector<StructLayout> &LayoutEngine::getLayouts() const {
+  return this->layouts;
+}
+
+// Nested structs are laid out on first use; one that contains itself, even
+// through others, has no finite size.
+const StructLayout &LayoutEngine::layout(uint32_t name, uint32_t offset,
+                                         uint16_t file) {
+  auto found = this->index.find(name);
+  if (found == this->index.end())
+    throw CompileError("unknown struct '" + nameOf(name) + "'", offset, file);
+  size_t i = found->second;
+  if (this->layouts[i].name != 0)
+    return this->layouts[i];
+  if (this->laying[i])
+    throw CompileError("struct '" + nameOf(name) + "' contains itself",
+                       offset, file);
+  this->laying[i] = true;
+  StructLayout result;
+  uint64_t used = 0;
+  for (const VarDecl &decl : this->program.structs[i].fields) {
+    FieldLayout field;
+    field.name = decl.name;
+    this->sizeOf(decl.type, decl.arraySize, decl.offset, decl.file, field.size,
+                 field.align);
+    field.offset = roundUp(result.size, field.align);
+    result.size = field.offset + field.size;
+    result.align = std::max(result.align, field.align);
+    used += field.size;
+    result.fields.push_back(field);
+  }
+  result.size = roundUp(result.size, result.align);
+  result.padding = result.size - used;
+  result.name = name;
+  this->laying[i] = false;
+  this->layouts[i] = std::move(result);
+  return this->layouts[i];
+}
+
+void LayoutEngine::sizeOf(const TypeRef &type, uint32_t arraySize,
+                          uint32_t offset, uint16_t file, uint64_t &size,
+                          uint64_t &align) {
+  if (type.pointer) {
+    size = align = 8;
+  } else {
+    switch (type.kind) {
+    case TYPE_INT:
+    case TYPE_FLOAT:
+      size = align = type.narrow ? 4 : 8;
+      break;
+    case TYPE_CHAR:
+      size = align = 1;
+      break;
+    case TYPE_STRING:
+      size = align = 8;
+      break;
+    case TYPE_STRUCT: {
+      const StructLayout &nested = this->layout(type.structName, offset, file);
+      size = nested.size;
+      align = nested.align;
+      break;
+    }
+    case TYPE_VOID:
+      size = 0;
+      align = 1;
+      break;
+    }
+  }
+  if (arraySize > 0) {
+    if (size > UINT64_MAX / arraySize)
+      throw CompileError("struct is too large", offset, file);
+    size *= arraySize;
+  }
+}
+
+static uint64_t sizeInOrder(const StructLayout &layout,
+                            const std::vector<uint32_t> &order) {
+  uint64_t size = 0;
+  for (uint32_t i : order)
+    size = roundUp(size, layout.fields[i].align) + layout.fields[i].size;
+  return roundUp(size, layout.align);
+}
+
+// Hot fields go first so they share cache lines, unless splitting them off
+// costs padding; then falling alignment with the hot ones first in each
+// alignment still leaves none.
+void LayoutEngine::suggest(StructLayout &layout) const {
+  uint64_t hottest = 0;
+  for (const FieldLayout &field : layout.fields)
+    hottest = std::max(hottest, field.accesses);
+  auto hot = [&](uint32_t i) {
+    return hottest > 0 && layout.fields[i].accesses * 8 >= hottest;
+  };
+  auto alignFirst = [&](uint32_t a, uint32_t b) {
+    if (layout.fields[a].align != layout.fields[b].align)
+      return layout.fields[a].align > layout.fields[b].align;
+    return hot(a) && !hot(b);
+  };
+  auto hotFirst = [&](uint32_t a, uint32_t b) {
+    if (hot(a) != hot(b))
+      return hot(a);
+    return layout.fields[a].align > layout.fields[b].align;
+  };
+  std::vector<uint32_t> order;
+  layout.hotFields = 0;
+  for (uint32_t i = 0; i < layout.fields.size(); i++) {
+    order.push_back(i);
+    if (hot(i))
+      layout.hotFields++;
+  }
+  std::vector<uint32_t> split = order;
+  std::stable_sort(order.begin(), order.end(), alignFirst);
+  std::stable_sort(split.begin(), split.end(), hotFirst);
+  uint64_t packed = sizeInOrder(layout, order);
+  if (layout.hotFields < layout.fields.size() &&
+      sizeInOrder(layout, split) <= packed) {
+    layout.suggested = std::move(split);
+  } else {
+    layout.suggested = std::move(order);
+    layout.hotFields = 0;
+  }
+  layout.suggestedSize = sizeInOrder(layout, layout.suggested);
+}
+
+const LayoutEngine::Var *LayoutEngine::findVar(uint32_t name) const {
+  for (auto scope = this->scopes.rbegin(); scope != this->scopes.rend();
+       ++scope) {
+    auto found = scope->find(name);
+    if (found != scope->end())
+      return &found->second;
+  }
+  auto global = this->globals.find(name);
+  return global == this->globals.end() ? nullptr : &global->second;
+}
+
+void LayoutEngine::countStmt(const Stmt &stmt) {
+  Var ignored;
+  switch (stmt.kind) {
+  case STMT_EXPR:
+  case STMT_RETURN:
+    if (stmt.expr)
+      this->countExpr(*stmt.expr, ignored);
+    break;
+  case STMT_VAR:
+    if (stmt.var.init)
+      this->countExpr(*stmt.var.init, ignored);
+    this->scopes.back()[stmt.var.name] =
+        Var{stmt.var.type, stmt.var.arraySize};
+    break;
+  case STMT_BLOCK:
+    this->scopes.emplace_back();
+    for (const std::unique_ptr<Stmt> &child : stmt.body)
+      this->countStmt(*child);
+    this->scopes.pop_back();
+    break;
+  case STMT_IF:
+    this->countExpr(*stmt.expr, ignored);
+    for (const std::unique_ptr<Stmt> &child : stmt.body)
+      this->countStmt(*child);
+    break;
+  case STMT_WHILE:
+  case STMT_FOR: {
+    // The init of a for loop runs once, in the loop's own scope.
+    this->scopes.emplace_back();
+    size_t first = 0;
+    if (stmt.kind == STMT_FOR && !stmt.body.empty()) {
+      this->countStmt(*stmt.body[0]);
+      first = 1;
+    }
+    uint64_t saved = this->weight;
+    if (++this->loops <= MAX_LOOP_DEPTH)
+      this->weight *= LOOP_WEIGHT;
+    if (stmt.expr)
+      this->countExpr(*stmt.expr, ignored);
+    if (stmt.step)
+      this->countExpr(*stmt.step, ignored);
+    for (size_t i = first; i < stmt.body.size(); i++)
+      this->countStmt(*stmt.body[i]);
+    this->loops--;
+    this->weight = saved;
+    this->scopes.pop_back();
+    break;
+  }
+  case STMT_BREAK:
+    break;
+  }
+}
+
+// Counts the '->' uses in the expression and returns whether its type is
+// known, in `type`. Only as much typing as finding the struct of a '->'
+// needs is done here; the bytecode compiler checks the rest.
+bool LayoutEngine::countExpr(const Expr &expr, Var &type) {
+  Var base;
+  Var ignored;
+  switch (expr.kind) {
+  case EXPR_VARIABLE:
+    if (const Var *var = this->findVar(expr.symbol)) {
+      type = *var;
+      return true;
+    }
+    return false;
+  case EXPR_FIELD: {
+    if (!this->countExpr(*expr.children[0], base) ||
+        base.type.kind != TYPE_STRUCT || base.arraySize != 0)
+      return false;
+    auto found = this->index.find(base.type.structName);
+    if (found == this->index.end())
+      return false;
+    const StructDecl &decl = this->program.structs[found->second];
+    for (size_t i = 0; i < decl.fields.size(); i++) {
+      if (decl.fields[i].name != expr.symbol)
+        continue;
+      this->layouts[found->second].fields[i].accesses += this->weight;
+      type = Var{decl.fields[i].type, decl.fields[i].arraySize};
+      return true;
+    }
+    return false;
+  }
+  case EXPR_INDEX: {
+    bool known = this->countExpr(*expr.children[0], base);
+    this->countExpr(*expr.children[1], ignored);
+    if (!known)
+      return false;
+    if (base.arraySize > 0) {
+      type = Var{base.type, 0};
+      return true;
+    }
+    if (base.type.kind == TYPE_STRING) {
+      type = Var{};
+      type.type.kind = TYPE_CHAR;
+      return true;
+    }
+    return false;
+  }
+  case EXPR_ASSIGN: {
+    bool known = this->countExpr(*expr.children[0], type);
+    this->countExpr(*expr.children[1], ignored);
+    return known;
+  }
+  case EXPR_CALL: {
+    for (const std::unique_ptr<Expr> &child : expr.children)
+      this->countExpr(*child, ignored);
+    auto found = this->returns.find(expr.symbol);
+    if (found == this->returns.end())
+      return false;
+    type = Var{found->second, 0};
+    return true;
+  }
+  default:
+    for (const std::unique_ptr<Expr> &child : expr.children)
+      this->countExpr(*child, ignored);
+    return false;
+  }
+}
+
+void LayoutEngine::print(std::ostream &os) const {
+  if (this->layouts.empty())
+    return;
+  os << "\nStruct layouts:\n";
+  for (const StructLayout &layout : this->layouts) {
+    os << "Loli " << nameOf(layout.name) << ": " << bytes(layout.size)
+       << ", align " << layout.align << ", " << bytes(layout.padding)
+       << " of padding\n";
+    for (const FieldLayout &field : layout.fields) {
+      os << "  " << std::left << std::setw(6) << field.offset << std::setw(16)
+         << nameOf(field.name) << std::setw(10) << bytes(field.size)
+         << field.accesses << (field.accesses == 1 ? " use" : " uses")
+         << std::right << "\n";
+    }
+    bool reordered = false;
+    for (uint32_t i = 0; i < layout.suggested.size(); i++)
+      reordered = reordered || layout.suggested[i] != i;
+    if (!reordered)
+      continue;
+    os << "  Suggested order:";
+    for (size_t i = 0; i < layout.suggested.size(); i++) {
+      bool split = i > 0 && i == layout.hotFields;
+      os << (i == 0 ? " " : split ? " | " : ", ")
+         << nameOf(layout.fields[layout.suggested[i]].name);
+    }
+    os << "\n    " << bytes(layout.suggestedSize);
+    if (layout.suggestedSize < layout.size)
+      os << ", saves " << bytes(layout.size - layout.suggestedSize);
+    if (layout.hotFields > 0)
+      os << ", hot fields before the '|'";
+    os << "\n";
+  }
+}
+
+void LayoutEngine::apply(Program &program) const {
+  for (size_t i = 0; i < program.structs.size(); i++) {
+    std::vector<VarDecl> &fields = program.structs[i].fields;
+    std::vector<VarDecl> ordered;
+    ordered.reserve(fields.size());
+    for (uint32_t field : this->layouts[i].suggested)
+      ordered.push_back(std::move(fields[field]));
+    fields = std::move(ordered);
+  }
+}
@@ -0,0 +1,232 @@
+#include "Optimizer.h"
+
+OptimizeStats AstOptimizer::optimize(Program &program) {
+  stats = OptimizeStats();
+  for (FunctionDecl &function : program.functions)
+    optimizeStmt(function.body);
+  return stats;
+}
+
+bool AstOptimizer::isConstant(const Expr &expr) {
+  return expr.kind == EXPR_INT || expr.kind == EXPR_FLOAT;
+}
+
+bool AstOptimizer::isTrue(const Expr &expr) {
+  return expr.kind == EXPR_INT ? expr.intValue != 0 : expr.floatValue != 0;
+}
+
+size_t AstOptimizer::countNodes(const Expr *expr) {
+  if (expr == nullptr)
+    return 0;
+  size_t count = 1;
+  for (const auto &child : expr->children)
+    count += countNodes(child.get());
+  return count;
+}
+
+size_t AstOptimizer::countNodes(const Stmt *stmt) {
+  if (stmt == nullptr)
+    return 0;
+  size_t count = 1 + countNodes(stmt->expr.get()) +
+                 countNodes(stmt->step.get()) +
+                 countNodes(stmt->var.init.get());
+  for (const auto &child : stmt->body)
+    count += countNodes(child.get());
+  return count;
+}
+
+void AstOptimizer::foldExpr(std::unique_ptr<Expr> &expr) {
+  for (auto &child : expr->children)
+    foldExpr(child);
+  if (expr->kind == EXPR_BINARY && foldBinary(expr))
+    stats.folded++;
+}
+
+static std::unique_ptr<Expr> constantLike(const Expr &at, ExprKind kind) {
+  std::unique_ptr<Expr> result(new Expr());
+  result->kind = kind;
+  result->offset = at.offset;
+  result->file = at.file;
+  return result;
+}
+
+// Integer arithmetic goes through uint64_t so it wraps exactly like the VM.
+bool AstOptimizer::foldBinary(std::unique_ptr<Expr> &expr) {
+  const std::string &op = expr->text;
+  const Expr &lhs = *expr->children[0];
+  const Expr &rhs = *expr->children[1];
+  std::unique_ptr<Expr> result;
+  if (op == "&&" || op == "||") {
+    // The right side is never evaluated once the left decides, so it can go
+    // even if it has side effects.
+    if (!isConstant(lhs))
+      return false;
+    bool decided = op == "&&" ? !isTrue(lhs) : isTrue(lhs);
+    if (!decided && !isConstant(rhs))
+      return false;
+    result = constantLike(*expr, EXPR_INT);
+    result->intValue = decided ? op == "||" : isTrue(rhs);
+  } else {
+    if (!isConstant(lhs) || !isConstant(rhs))
+      return false;
+    bool compare = op == "<" || op == ">" || op == "<=" || op == ">=" ||
+                   op == "==" || op == "!=";
+    if (lhs.kind == EXPR_INT && rhs.kind == EXPR_INT) {
+      int64_t a = lhs.intValue;
+      int64_t b = rhs.intValue;
+      uint64_t ua = static_cast<uint64_t>(a);
+      uint64_t ub = static_cast<uint64_t>(b);
+      int64_t value;
+      if (op == "+")
+        value = static_cast<int64_t>(ua + ub);
+      else if (op == "-")
+        value = static_cast<int64_t>(ua - ub);
+      else if (op == "*")
+        value = static_cast<int64_t>(ua * ub);
+      else if (op == "/" && b == -1)
+        value = static_cast<int64_t>(0 - ua);
+      else if (op == "/" && b != 0)
+        value = a / b;
+      else if (op == "<")
+        value = a < b;
+      else if (op == ">")
+        value = a > b;
+      else if (op == "<=")
+        value = a <= b;
+      else if (op == ">=")
+        value = a >= b;
+      else if (op == "==")
+        value = a == b;
+      else if (op == "!=")
+        value = a != b;
+      else
+        return false;
+      result = constantLike(*expr, EXPR_INT);
+      result->intValue = value;
+    } else {
+      double a = lhs.kind == EXPR_INT ? static_cast<double>(lhs.intValue)
+                                      : lhs.floatValue;
+      double b = rhs.kind == EXPR_INT ? static_cast<double>(rhs.intValue)
+                                      : rhs.floatValue;
+      if (compare) {
+        result = constantLike(*expr, EXPR_INT);
+        if (op == "<")
+          result->intValue = a < b;
+        else if (op == ">")
+          result->intValue = a > b;
+        else if (op == "<=")
+          result->intValue = a <= b;
+        else if (op == ">=")
+          result->intValue = a >= b;
+        else if (op == "==")
+          result->intValue = a == b;
+        else
+          result->intValue = a != b;
+      } else {
+        result = constantLike(*expr, EXPR_FLOAT);
+        if (op == "+")
+          result->floatValue = a + b;
+        else if (op == "-")
+          result->floatValue = a - b;
+        else if (op == "*")
+          result->floatValue = a * b;
+        else if (op == "/")
+          result->floatValue = a / b;
+        else
+          return false;
+      }
+    }
+  }
+  stats.nodes += countNodes(expr.get()) - 1;
+  expr = std::move(result);
+  return true;
+}
+
+void AstOptimizer::optimizeStmt(std::unique_ptr<Stmt> &stmt) {
+  if (stmt->expr)
+    foldExpr(stmt->expr);
+  if (stmt->step)
+    foldExpr(stmt->step);
+  if (stmt->var.init)
+    foldExpr(stmt->var.init);
+  for (auto &child : stmt->body)
+    optimizeStmt(child);
+
+  std::unique_ptr<Stmt> replacement;
+  switch (stmt->kind) {
+  case STMT_BLOCK:
+    pruneBlock(*stmt);
+    return;
+  case STMT_IF:
+    if (!isConstant(*stmt->expr))
+      return;
+    if (isTrue(*stmt->expr))
+      replacement = std::move(stmt->body[0]);
+    else if (stmt->body.size() > 1)
+      replacement = std::move(stmt->body[1]);
+    break;
+  case STMT_WHILE:
+  case STMT_FOR:
+    if (!isConstant(*stmt->expr) || isTrue(*stmt->expr))
+      return;
+    // A loop that never runs still runs its initializer.
+    if (stmt->kind == STMT_FOR) {
+      replacement.reset(new Stmt());
+      replacement->kind = STMT_BLOCK;
+      replacement->offset = stmt->offset;
+      replacement->file = stmt->file;
+      replacement->body.push_back(std::move(stmt->body[0]));
+    }
+    break;
+  default:
+    return;
+  }
+  if (!replacement) {
+    replacement.reset(new Stmt());
+    replacement->kind = STMT_BLOCK;
+    replacement->offset = stmt->offset;
+    replacement->file = stmt->file;
+  }
+  stats.branches++;
+  stats.nodes += countNodes(stmt.get()) - countNodes(replacement.get());
+  stmt = std::move(replacement);
+}
+
+// Drops statements that can never run and blocks left empty by the other
+// rewrites.
+void AstOptimizer::pruneBlock(Stmt &block) {
+  std::vector<std::unique_ptr<Stmt>> kept;
+  kept.reserve(block.body.size());
+  for (size_t i = 0; i < block.body.size(); i++) {
+    std::unique_ptr<Stmt> &child = block.body[i];
+    if (child->kind == STMT_BLOCK && child->body.empty()) {
+      stats.nodes++;
+      continue;
+    }
+    kept.push_back(std::move(child));
+    if (terminates(*kept.back())) {
+      for (size_t j = i + 1; j < block.body.size(); j++) {
+        stats.unreachable++;
+        stats.nodes += countNodes(block.body[j].get());
+      }
+      break;
+    }
+  }
+  block.body = std::move(kept);
+}
+
+// True when control never reaches the statement after this one.
+bool AstOptimizer::terminates(const Stmt &stmt) {
+  switch (stmt.kind) {
+  case STMT_RETURN:
+  case STMT_BREAK:
+    return true;
+  case STMT_BLOCK:
+    return !stmt.body.empty() && terminates(*stmt.body.back());
+  case STMT_IF:
+    return stmt.body.size() > 1 && terminates(*stmt.body[0]) &&
+           terminates(*stmt.body[1]);
+  default:
+    return false;
+  }
+}
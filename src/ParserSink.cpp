@@ -0,0 +1,160 @@
+#include "ParserSink.h"
+#include <algorithm>
+#include <cstdio>
+
+void StructuredSink::begin() {
+  diagnostics.clear();
+  errors = 0;
+  semanticErrors = 0;
+}
+
+void StructuredSink::report(ReportKind kind, uint16_t file,
+                            const std::string &, uint32_t line,
+                            uint32_t column, const std::string &message) {
+  diagnostics.push_back({kind, file, line, column, message});
+}
+
+void StructuredSink::finish(unsigned int errors, unsigned int semanticErrors) {
+  this->errors = errors;
+  this->semanticErrors = semanticErrors;
+}
+
+const std::vector<Diagnostic> &StructuredSink::getDiagnostics() const {
+  return diagnostics;
+}
+
+unsigned int StructuredSink::getErrorCount() const { return errors; }
+
+unsigned int StructuredSink::getSemanticErrorCount() const {
+  return semanticErrors;
+}
+
+void TextSink::begin() {
+  lines.clear();
+  fileRanks.clear();
+  pathRanks.clear();
+  errors = 0;
+  semanticErrors = 0;
+}
+
+void TextSink::report(ReportKind kind, uint16_t file, const std::string &path,
+                      uint32_t line, uint32_t column,
+                      const std::string &message) {
+  if (kind == REPORT_NOTE && line == 0) {
+    lines.push_back({0, 0, 0, message});
+    return;
+  }
+  if (file >= fileRanks.size())
+    fileRanks.resize(file + 1, 0);
+  if (fileRanks[file] == 0) {
+    uint32_t next = static_cast<uint32_t>(pathRanks.size()) + 1;
+    fileRanks[file] = pathRanks.emplace(path, next).first->second;
+  }
+  std::string text = "Line : ";
+  if (!path.empty())
+    text += path + ":";
+  text += std::to_string(line) + ":" + std::to_string(column);
+  switch (kind) {
+  case REPORT_RULE:
+    text += " Matched Rule used: ";
+    break;
+  case REPORT_SYNTAX_ERROR:
+    text += " Not Matched Error: ";
+    break;
+  case REPORT_SEMANTIC_ERROR:
+    text += " Semantic Error: ";
+    break;
+  case REPORT_NOTE:
+    text += " ";
+    break;
+  }
+  lines.push_back({fileRanks[file], line, column, text + message});
+}
+
+// Reports are made in token order, except for checks that can only run at
+// the end, such as calls to functions defined later. A stable sort on the
+// file and the position in it puts those back in place and keeps everything
+// else as it was.
+void TextSink::finish(unsigned int errors, unsigned int semanticErrors) {
+  this->errors = errors;
+  this->semanticErrors = semanticErrors;
+  std::stable_sort(lines.begin(), lines.end(),
+                   [](const Line &a, const Line &b) {
+                     if ((a.line == 0) != (b.line == 0))
+                       return b.line == 0;
+                     if (a.fileRank != b.fileRank)
+                       return a.fileRank < b.fileRank;
+                     if (a.line != b.line)
+                       return a.line < b.line;
+                     return a.column < b.column;
+                   });
+}
+
+void TextSink::print(std::ostream &out) const {
+  out << "\nParser Results:\n\n" << std::string(50, '-') << "\n";
+  for (const Line &line : lines)
+    out << line.text << "\n";
+  out << "Total NO of errors: " << errors << "\n";
+  out << "Total NO of semantic errors: " << semanticErrors << std::endl;
+}
+
+static const char *const kindNames[] = {"rule", "syntax-error",
+                                        "semantic-error", "note"};
+
+static void writeJsonString(std::ostream &out, const std::string &text) {
+  out << '"';
+  for (char c : text) {
+    switch (c) {
+    case '"':
+      out << "\\\"";
+      break;
+    case '\\':
+      out << "\\\\";
+      break;
+    case '\n':
+      out << "\\n";
+      break;
+    case '\t':
+      out << "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        out << escaped;
+      } else {
+        out << c;
+      }
+    }
+  }
+  out << '"';
+}
+
+NdjsonSink::NdjsonSink(std::ostream *out) : out(out) {}
+
+void NdjsonSink::setStream(std::ostream *out) { this->out = out; }
+
+void NdjsonSink::report(ReportKind kind, uint16_t, const std::string &path,
+                        uint32_t line, uint32_t column,
+                        const std::string &message) {
+  if (out == nullptr)
+    return;
+  *out << "{\"kind\":\"" << kindNames[kind] << "\",";
+  if (!path.empty()) {
+    *out << "\"file\":";
+    writeJsonString(*out, path);
+    *out << ",";
+  }
+  *out << "\"line\":" << line
+       << ",\"column\":" << column << ",\"message\":";
+  writeJsonString(*out, message);
+  *out << "}\n";
+}
+
+void NdjsonSink::finish(unsigned int errors, unsigned int semanticErrors) {
+  if (out == nullptr)
+    return;
+  *out << "{\"kind\":\"summary\",\"errors\":" << errors
+       << ",\"semanticErrors\":" << semanticErrors << "}\n";
+  out->flush();
+}
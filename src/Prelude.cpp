@@ -0,0 +1,163 @@
+#include "Prelude.h"
+#include "helpers.h"
+#include "lexer.h"
+#include <algorithm>
+#include <iterator>
+
+static constexpr std::string_view MATH_SOURCE = R"(/^ Integer helpers
+Imw abs(Imw n) {
+    IfTrue (n < 0) {
+        Turnback 0 - n;
+    }
+    Turnback n;
+}
+
+Imw max(Imw a, Imw b) {
+    IfTrue (a > b) {
+        Turnback a;
+    }
+    Turnback b;
+}
+
+Imw min(Imw a, Imw b) {
+    IfTrue (a < b) {
+        Turnback a;
+    }
+    Turnback b;
+}
+
+Imw clamp(Imw n, Imw low, Imw high) {
+    Turnback max(low, min(n, high));
+}
+
+Imw power(Imw base, Imw exponent) {
+    Imw result = 1;
+    RepeatWhen (exponent > 0) {
+        result = result * base;
+        exponent = exponent - 1;
+    }
+    Turnback result;
+}
+
+Imw gcd(Imw a, Imw b) {
+    RepeatWhen (b != 0) {
+        Imw rest = a - a / b * b;
+        a = b;
+        b = rest;
+    }
+    Turnback abs(a);
+}
+)";
+
+static constexpr std::string_view FMATH_SOURCE = R"(/^ Float helpers
+IMwf fabs(IMwf x) {
+    IfTrue (x < 0.0) {
+        Turnback 0.0 - x;
+    }
+    Turnback x;
+}
+
+IMwf fmax(IMwf a, IMwf b) {
+    IfTrue (a > b) {
+        Turnback a;
+    }
+    Turnback b;
+}
+
+IMwf fmin(IMwf a, IMwf b) {
+    IfTrue (a < b) {
+        Turnback a;
+    }
+    Turnback b;
+}
+
+IMwf lerp(IMwf from, IMwf to, IMwf t) {
+    Turnback from + (to - from) * t;
+}
+)";
+
+static constexpr auto MATH_TOKENS =
+    constTokenize<constTokenCount(MATH_SOURCE)>(MATH_SOURCE);
+static constexpr auto FMATH_TOKENS =
+    constTokenize<constTokenCount(FMATH_SOURCE)>(FMATH_SOURCE);
+
+// Preludes are spliced in without going through lexFile, so they cannot
+// include anything, and they must lex cleanly.
+template <size_t N>
+constexpr bool validPrelude(const std::array<ConstToken, N> &tokens) {
+  for (const ConstToken &token : tokens) {
+    if (token.error || token.type == INCLUSION)
+      return false;
+  }
+  return true;
+}
+
+static_assert(validPrelude(MATH_TOKENS), "prelude\\math.txt does not lex");
+static_assert(validPrelude(FMATH_TOKENS), "prelude\\fmath.txt does not lex");
+
+static const Prelude PRELUDES[] = {
+    {"prelude\\math.txt", MATH_SOURCE, MATH_TOKENS.data(), MATH_TOKENS.size()},
+    {"prelude\\fmath.txt", FMATH_SOURCE, FMATH_TOKENS.data(),
+     FMATH_TOKENS.size()}};
+
+const Prelude *findPrelude(std::string_view path) {
+  for (const Prelude &prelude : PRELUDES) {
+    if (prelude.path == path)
+      return &prelude;
+  }
+  return nullptr;
+}
+
+const Prelude *preludesBegin() { return std::begin(PRELUDES); }
+
+const Prelude *preludesEnd() { return std::end(PRELUDES); }
+
+std::string readInclude(const std::string &path) {
+  if (const Prelude *prelude = findPrelude(path))
+    return std::string(prelude->source);
+  return readFile(path);
+}
+
+// The compiled-in tokens have the comments in line, where the runtime lexer
+// keeps them apart as trivia, so the two runtime lists are merged back into
+// source order first.
+bool checkPreludes(std::ostream &os) {
+  bool agree = true;
+  for (const Prelude &prelude : PRELUDES) {
+    Lexer lexer{std::string(prelude.source)};
+    std::vector<Token> code = lexer.tokenize();
+    std::vector<Trivia> trivia = lexer.releaseTrivia();
+    code.pop_back();
+    std::vector<Token> tokens;
+    tokens.reserve(code.size() + trivia.size());
+    size_t next = 0;
+    for (size_t i = 0; i <= code.size(); i++) {
+      for (; next < trivia.size() && trivia[next].before == i; next++)
+        tokens.push_back(trivia[next].token);
+      if (i < code.size())
+        tokens.push_back(code[i]);
+    }
+    size_t count = std::max(tokens.size(), prelude.tokenCount);
+    size_t differences = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (i < tokens.size() && i < prelude.tokenCount) {
+        const Token &runtime = tokens[i];
+        const ConstToken &built = prelude.tokens[i];
+        if (runtime.type == built.type && runtime.offset == built.offset &&
+            runtime.text.size() == built.length &&
+            runtime.error == built.error)
+          continue;
+      }
+      if (differences++ == 0)
+        os << prelude.path << ": token " << i << " differs";
+    }
+    if (differences > 0) {
+      os << " (" << differences << " tokens in all)\n";
+      agree = false;
+    } else {
+      os << prelude.path << ": " << code.size() << " tokens and "
+         << trivia.size() << " comment tokens agree\n";
+    }
+  }
+  return agree;
+}
@@ -0,0 +1,419 @@
+#include "Project.h"
+#include "AllocStats.h"
+#include "Prelude.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+Project::Project(std::vector<std::string> paths, CompilerOptions options)
+    : options(options), sources(std::make_shared<SourceMap>()) {
+  // Results files are named as in batch mode.
+  for (const std::string &path : paths) {
+    Entry entry;
+    entry.unit = this->addUnit(path);
+    entry.resultsName =
+        paths.size() == 1 ? "result.txt" : path + ".result.txt";
+    this->entries.push_back(std::move(entry));
+  }
+}
+
+// Reads the file and registers it in the shared source map; its includes are
+// found later by scanIncludes().
+uint32_t Project::addUnit(const std::string &path) {
+  auto found = this->index.find(path);
+  if (found != this->index.end())
+    return found->second;
+  uint32_t id = static_cast<uint32_t>(this->units.size());
+  this->index.emplace(path, id);
+  Unit unit;
+  unit.path = path;
+  {
+    PhaseScope phase(PHASE_READ);
+    unit.lexer.reset(new Lexer(readInclude(path), this->sources));
+  }
+  unit.lexer->setFileName(path);
+  unit.lexer->setMaxErrors(this->options.maxErrors);
+  unit.lexer->setUnicodeIdentifiers(this->options.unicodeIdentifiers);
+  unit.size = static_cast<uint32_t>(unit.lexer->getSource().size());
+  unit.file = unit.lexer->getFile();
+  this->units.push_back(std::move(unit));
+  return id;
+}
+
+// Reads the include directives of one file, adding files not seen yet. While
+// watching, an include that cannot be opened is reported to `os` and left
+// out, instead of ending the process the way the first build does.
+void Project::scanIncludes(uint32_t unit, std::ostream *os) {
+  this->units[unit].includes.clear();
+  for (const std::string &path : this->units[unit].lexer->scanIncludes()) {
+    if (os != nullptr && this->index.count(path) == 0 &&
+        findPrelude(path) == nullptr && !std::ifstream(path).is_open()) {
+      *os << this->units[unit].path << ": cannot open include \"" << path
+          << "\"\n";
+      continue;
+    }
+    uint32_t include = this->addUnit(path);
+    this->units[unit].includes.push_back(include);
+  }
+}
+
+// Each entry's closure over the include graph, and a post-order of all files
+// so shared includes are lexed before the files that use them.
+void Project::link() {
+  this->order.clear();
+  for (Unit &unit : this->units)
+    unit.dependents.clear();
+  std::vector<bool> placed(this->units.size(), false);
+  for (uint32_t e = 0; e < this->entries.size(); e++) {
+    Entry &entry = this->entries[e];
+    entry.closure.clear();
+    std::vector<bool> seen(this->units.size(), false);
+    // Unit and the next of its includes to visit.
+    std::vector<std::pair<uint32_t, size_t>> stack;
+    stack.push_back({entry.unit, 0});
+    seen[entry.unit] = true;
+    while (!stack.empty()) {
+      uint32_t unit = stack.back().first;
+      size_t next = stack.back().second++;
+      const std::vector<uint32_t> &includes = this->units[unit].includes;
+      if (next < includes.size()) {
+        if (!seen[includes[next]]) {
+          seen[includes[next]] = true;
+          stack.push_back({includes[next], 0});
+        }
+        continue;
+      }
+      stack.pop_back();
+      entry.closure.push_back(unit);
+      this->units[unit].dependents.push_back(e);
+      if (!placed[unit]) {
+        placed[unit] = true;
+        this->order.push_back(unit);
+      }
+    }
+  }
+}
+
+void Project::lex(uint32_t unit) {
+  PhaseScope phase(PHASE_LEX);
+  Unit &source = this->units[unit];
+  source.tokens =
+      std::make_shared<const std::vector<Token>>(source.lexer->tokenizeSource());
+  source.trivia = source.lexer->releaseTrivia();
+  source.lexer.reset();
+}
+
+// Included files first, the last include first, then the file itself; an
+// include that is already open or too deep is skipped and its file token is
+// marked, exactly as Lexer::tokenize does it. So is one that could not be
+// opened while watching.
+void Project::splice(uint32_t unit, std::vector<Token> &tokens,
+                     std::vector<Trivia> &trivia, std::vector<bool> &active,
+                     unsigned int depth, size_t &lexes) {
+  lexes++;
+  const Unit &source = this->units[unit];
+  for (auto it = source.includes.rbegin(); it != source.includes.rend(); ++it) {
+    if (depth >= Lexer::MAX_INCLUDE_DEPTH || active[*it])
+      continue;
+    active[*it] = true;
+    this->splice(*it, tokens, trivia, active, depth + 1, lexes);
+    active[*it] = false;
+  }
+  size_t first = tokens.size();
+  tokens.insert(tokens.end(), source.tokens->begin(), source.tokens->end());
+  for (const Trivia &comment : source.trivia)
+    trivia.push_back(
+        {static_cast<uint32_t>(first + comment.before), comment.token});
+  for (size_t i = first + 1; i < tokens.size(); i++) {
+    if (tokens[i - 1].type != INCLUSION || tokens[i].type != STRING_LITERAL)
+      continue;
+    auto found = this->index.find(Lexer::includePath(tokens[i].text));
+    if (depth >= Lexer::MAX_INCLUDE_DEPTH || found == this->index.end() ||
+        active[found->second])
+      tokens[i].error = true;
+  }
+}
+
+void Project::compile(uint32_t e) {
+  Entry &entry = this->entries[e];
+  std::vector<Token> tokens;
+  size_t total = 1;
+  for (uint32_t unit : entry.closure)
+    total += this->units[unit].tokens->size();
+  tokens.reserve(total);
+  std::vector<Trivia> trivia;
+  std::vector<bool> active(this->units.size(), false);
+  entry.lexes = 0;
+  this->splice(entry.unit, tokens, trivia, active, 0, entry.lexes);
+  const Unit &root = this->units[entry.unit];
+  Token eofToken(root.size, "", EOF_TOKEN, false);
+  eofToken.file = root.file;
+  tokens.push_back(eofToken);
+
+  std::ostringstream console;
+  Compiler compiler(std::make_shared<const std::vector<Token>>(std::move(tokens)),
+                    std::move(trivia), this->sources, entry.resultsName,
+                    this->options);
+  compiler.setConsole(console);
+  entry.passed = compiler.compile();
+  compiler.collectStats(entry.stats);
+  entry.output = console.str();
+}
+
+bool Project::build(unsigned int threads) {
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t u = 0; u < this->units.size(); u++)
+    this->scanIncludes(static_cast<uint32_t>(u), nullptr);
+  this->link();
+  this->scanSeconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - begin)
+                          .count();
+  this->schedule(std::vector<bool>(this->units.size(), true), threads);
+
+  bool passed = true;
+  for (const Entry &entry : this->entries) {
+    std::cout << entry.output;
+    passed = entry.passed && passed;
+  }
+  return passed;
+}
+
+// Lexes the units marked in `relex` and compiles every entry that pulls one
+// of them in. Tasks below units.size() lex that unit, the rest compile an
+// entry.
+void Project::schedule(const std::vector<bool> &relex, unsigned int threads) {
+  auto begin = std::chrono::steady_clock::now();
+  auto seconds = [&]() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         begin)
+        .count();
+  };
+  const size_t unitCount = this->units.size();
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<size_t> ready;
+  for (uint32_t unit : this->order) {
+    if (relex[unit])
+      ready.push_back(unit);
+  }
+  size_t remaining = ready.size();
+  for (Entry &entry : this->entries) {
+    entry.waiting = 0;
+    for (uint32_t unit : entry.closure)
+      entry.waiting += relex[unit] ? 1 : 0;
+    remaining += entry.waiting != 0 ? 1 : 0;
+  }
+  std::exception_ptr failure;
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [&]() {
+        return !ready.empty() || remaining == 0 || failure;
+      });
+      if (ready.empty() || failure)
+        return;
+      size_t task = ready.front();
+      ready.pop_front();
+      lock.unlock();
+      double start = seconds();
+      std::exception_ptr error;
+      try {
+        if (task < unitCount)
+          this->lex(static_cast<uint32_t>(task));
+        else
+          this->compile(static_cast<uint32_t>(task - unitCount));
+      } catch (...) {
+        error = std::current_exception();
+      }
+      double finish = seconds();
+      lock.lock();
+      remaining--;
+      if (error && !failure)
+        failure = error;
+      if (task < unitCount) {
+        Unit &unit = this->units[task];
+        unit.start = start;
+        unit.finish = finish;
+        for (uint32_t e : unit.dependents) {
+          if (--this->entries[e].waiting == 0)
+            ready.push_back(unitCount + e);
+        }
+      } else {
+        Entry &entry = this->entries[task - unitCount];
+        entry.start = start;
+        entry.finish = finish;
+      }
+      wake.notify_all();
+    }
+  };
+
+  this->threadCount = std::max(
+      1u, std::min<unsigned int>(threads, static_cast<unsigned int>(remaining)));
+  std::vector<std::thread> pool;
+  for (unsigned int i = 0; i < this->threadCount; i++)
+    pool.emplace_back(worker);
+  for (std::thread &thread : pool)
+    thread.join();
+  if (failure)
+    std::rethrow_exception(failure);
+  this->wallSeconds = seconds();
+}
+
+// Lexical, syntax, semantic, backend and runtime errors, as the report
+// prints them.
+static std::vector<std::string> diagnostics(const std::string &output) {
+  std::vector<std::string> lines;
+  std::istringstream in(output);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.find(" Error: ") != std::string::npos ||
+        line.find("(Error)") != std::string::npos)
+      lines.push_back(line);
+  }
+  std::sort(lines.begin(), lines.end());
+  return lines;
+}
+
+bool Project::rebuild(const std::vector<std::string> &changed,
+                      unsigned int threads, std::ostream &os) {
+  std::vector<bool> relex(this->units.size(), false);
+  for (const std::string &path : changed) {
+    auto found = this->index.find(path);
+    if (found == this->index.end())
+      continue;
+    // Editors that save by renaming leave a short window with no file.
+    if (!std::ifstream(path).is_open()) {
+      os << path << ": cannot be read, keeping the last version\n";
+      continue;
+    }
+    Unit &unit = this->units[found->second];
+    {
+      PhaseScope phase(PHASE_READ);
+      unit.lexer.reset(new Lexer(readInclude(path), this->sources, unit.file));
+    }
+    unit.lexer->setMaxErrors(this->options.maxErrors);
+    unit.lexer->setUnicodeIdentifiers(this->options.unicodeIdentifiers);
+    unit.size = static_cast<uint32_t>(unit.lexer->getSource().size());
+    relex[found->second] = true;
+  }
+  size_t known = this->units.size();
+  for (size_t u = 0; u < this->units.size(); u++) {
+    if (u >= known || relex[u])
+      this->scanIncludes(static_cast<uint32_t>(u), &os);
+  }
+  relex.resize(this->units.size(), true);
+  this->link();
+
+  std::vector<std::string> before(this->entries.size());
+  std::vector<bool> affected(this->entries.size(), false);
+  for (size_t e = 0; e < this->entries.size(); e++) {
+    for (uint32_t unit : this->entries[e].closure)
+      affected[e] = affected[e] || relex[unit];
+    if (affected[e])
+      before[e] = std::move(this->entries[e].output);
+  }
+  this->schedule(relex, threads);
+
+  bool passed = true;
+  for (size_t e = 0; e < this->entries.size(); e++) {
+    const Entry &entry = this->entries[e];
+    passed = entry.passed && passed;
+    if (!affected[e])
+      continue;
+    std::vector<std::string> was = diagnostics(before[e]);
+    std::vector<std::string> now = diagnostics(entry.output);
+    std::vector<std::string> fixed;
+    std::vector<std::string> added;
+    std::set_difference(was.begin(), was.end(), now.begin(), now.end(),
+                        std::back_inserter(fixed));
+    std::set_difference(now.begin(), now.end(), was.begin(), was.end(),
+                        std::back_inserter(added));
+    os << this->units[entry.unit].path << ": "
+       << (entry.passed ? "ok" : "errors") << ", " << fixed.size()
+       << " fixed, " << added.size() << " new\n";
+    for (const std::string &line : fixed)
+      os << "  - " << line << "\n";
+    for (const std::string &line : added)
+      os << "  + " << line << "\n";
+  }
+  return passed;
+}
+
+std::vector<std::string> Project::files() const {
+  std::vector<std::string> paths;
+  for (const Unit &unit : this->units)
+    paths.push_back(unit.path);
+  return paths;
+}
+
+// An entry can start once the slowest file it pulls in is lexed, so the
+// longest lex plus compile over all entries bounds the wall time no matter
+// how many threads there are.
+void Project::printSchedule(std::ostream &os) const {
+  double work = 0;
+  size_t lexes = 0;
+  for (const Unit &unit : this->units)
+    work += unit.finish - unit.start;
+  for (const Entry &entry : this->entries) {
+    work += entry.finish - entry.start;
+    lexes += entry.lexes;
+  }
+
+  double critical = 0;
+  const Unit *slowest = nullptr;
+  const Entry *last = nullptr;
+  for (const Entry &entry : this->entries) {
+    const Unit *unit = &this->units[entry.closure.front()];
+    for (uint32_t u : entry.closure) {
+      if (this->units[u].finish - this->units[u].start >
+          unit->finish - unit->start)
+        unit = &this->units[u];
+    }
+    double length =
+        unit->finish - unit->start + entry.finish - entry.start;
+    if (last == nullptr || length > critical) {
+      critical = length;
+      slowest = unit;
+      last = &entry;
+    }
+  }
+
+  os << "\nProject: " << this->entries.size() << " entries, "
+     << this->units.size() << " files lexed once (" << lexes
+     << " lexes when compiled one by one)\n"
+     << std::fixed << std::setprecision(3);
+  os << "  scan          " << std::setw(10) << this->scanSeconds * 1000
+     << " ms\n";
+  os << "  wall          " << std::setw(10) << this->wallSeconds * 1000
+     << " ms on " << this->threadCount << " threads\n";
+  os << "  work          " << std::setw(10) << work * 1000 << " ms\n";
+  if (this->wallSeconds > 0)
+    os << "  parallelism   " << std::setw(10) << work / this->wallSeconds
+       << "\n";
+  if (last != nullptr) {
+    os << "  critical path " << std::setw(10) << critical * 1000
+       << " ms: lex " << slowest->path << " ("
+       << (slowest->finish - slowest->start) * 1000 << " ms) -> compile "
+       << this->units[last->unit].path << " ("
+       << (last->finish - last->start) * 1000 << " ms)\n";
+  }
+  os << std::defaultfloat;
+}
+
+void Project::collectStats(CompileStats &stats) const {
+  for (const Entry &entry : this->entries) {
+    stats.identifiers += entry.stats.identifiers;
+    stats.identifierBytes += entry.stats.identifierBytes;
+    stats.constants += entry.stats.constants;
+  }
+}
@@ -0,0 +1,126 @@
+#include "SourceMap.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// memchr is vectorised in every libc we build against, so these are fast
+// passes instead of a newline test on every byte in the lexer. The first
+// one counts, so the table is allocated once.
+LineIndex::LineIndex(const std::string &source) {
+  const char *begin = source.data();
+  const char *end = begin + source.size();
+  size_t lines = 1;
+  for (const char *p = begin;
+       (p = static_cast<const char *>(memchr(p, '\n', end - p))) != nullptr;
+       ++p) {
+    lines++;
+  }
+  starts.reserve(lines);
+  starts.push_back(0);
+  for (const char *p = begin;
+       (p = static_cast<const char *>(memchr(p, '\n', end - p))) != nullptr;
+       ++p) {
+    starts.push_back(static_cast<uint32_t>(p - begin + 1));
+  }
+}
+
+uint32_t LineIndex::line(uint32_t offset) const {
+  return static_cast<uint32_t>(
+      std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin());
+}
+
+uint32_t LineIndex::column(uint32_t offset) const {
+  return offset - starts[line(offset) - 1] + 1;
+}
+
+SourceMap::~SourceMap() { this->clear(); }
+
+uint16_t SourceMap::add(const std::string &source) {
+  std::unique_ptr<LineIndex> index(new LineIndex(source));
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t file = count.load(std::memory_order_relaxed);
+  if (file >= MAX_FILES)
+    throw std::length_error("more than " + std::to_string(MAX_FILES) +
+                            " source files in one compile");
+  Chunk *chunk = chunks[file >> CHUNK_BITS].load(std::memory_order_relaxed);
+  if (chunk == nullptr) {
+    chunk = new Chunk;
+    chunks[file >> CHUNK_BITS].store(chunk, std::memory_order_relaxed);
+  }
+  chunk->files[file & (CHUNK_SIZE - 1)].store(index.get(),
+                                              std::memory_order_relaxed);
+  owned.push_back(std::move(index));
+  names.emplace_back();
+  count.store(file + 1, std::memory_order_release);
+  return static_cast<uint16_t>(file);
+}
+
+bool SourceMap::full() const {
+  return count.load(std::memory_order_acquire) >= MAX_FILES;
+}
+
+size_t SourceMap::size() const {
+  return count.load(std::memory_order_acquire);
+}
+
+void SourceMap::replace(uint16_t file, const std::string &source) {
+  std::unique_ptr<LineIndex> index(new LineIndex(source));
+  std::lock_guard<std::mutex> lock(mutex);
+  if (file >= count.load(std::memory_order_relaxed))
+    return;
+  chunks[file >> CHUNK_BITS]
+      .load(std::memory_order_relaxed)
+      ->files[file & (CHUNK_SIZE - 1)]
+      .store(index.get(), std::memory_order_release);
+  owned[file] = std::move(index);
+}
+
+void SourceMap::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  count.store(0, std::memory_order_relaxed);
+  for (std::atomic<Chunk *> &chunk : chunks)
+    delete chunk.exchange(nullptr, std::memory_order_relaxed);
+  owned.clear();
+  names.clear();
+}
+
+void SourceMap::setName(uint16_t file, std::string name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (file < names.size())
+    names[file] = std::move(name);
+}
+
+std::string SourceMap::name(uint16_t file) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return file < names.size() ? names[file] : std::string();
+}
+
+const LineIndex *SourceMap::find(uint16_t file) const {
+  if (file >= count.load(std::memory_order_acquire))
+    return nullptr;
+  return chunks[file >> CHUNK_BITS]
+      .load(std::memory_order_relaxed)
+      ->files[file & (CHUNK_SIZE - 1)]
+      .load(std::memory_order_acquire);
+}
+
+uint32_t SourceMap::line(uint16_t file, uint32_t offset) const {
+  const LineIndex *index = find(file);
+  return index ? index->line(offset) : 0;
+}
+
+uint32_t SourceMap::column(uint16_t file, uint32_t offset) const {
+  const LineIndex *index = find(file);
+  return index ? index->column(offset) : 0;
+}
+
+void SourceMap::position(uint16_t file, uint32_t offset, uint32_t &line,
+                         uint32_t &column) const {
+  line = 0;
+  column = 0;
+  const LineIndex *index = find(file);
+  if (index == nullptr)
+    return;
+  line = index->line(offset);
+  column = index->column(offset);
+}
@@ -0,0 +1,66 @@
+#include "SymbolTable.h"
+
+// Index 0 of bindings is a sentinel, so 0 can mean "not bound" in the maps.
+SymbolTable::SymbolTable() : bindings(1) {}
+
+void SymbolTable::clear() {
+  bindings.resize(1);
+  scopes.clear();
+  innermost.clear();
+  members.clear();
+}
+
+void SymbolTable::pushScope() {
+  scopes.push_back(static_cast<uint32_t>(bindings.size()));
+}
+
+void SymbolTable::popScope() {
+  if (scopes.empty())
+    return;
+  uint32_t start = scopes.back();
+  scopes.pop_back();
+  while (bindings.size() > start) {
+    const Symbol &symbol = bindings.back();
+    innermost[symbol.name] = symbol.shadowed;
+    bindings.pop_back();
+  }
+}
+
+uint32_t SymbolTable::depth() const {
+  return static_cast<uint32_t>(scopes.size());
+}
+
+bool SymbolTable::declare(uint32_t name, SymbolKind kind, uint32_t type) {
+  uint32_t &slot = innermost[name];
+  if (slot != 0 && bindings[slot].depth == depth())
+    return false;
+  bindings.push_back(Symbol{name, type, kind, depth(), slot});
+  slot = static_cast<uint32_t>(bindings.size() - 1);
+  return true;
+}
+
+const Symbol *SymbolTable::lookup(uint32_t name) const {
+  const uint32_t *slot = innermost.find(name);
+  if (slot == nullptr || *slot == 0)
+    return nullptr;
+  return &bindings[*slot];
+}
+
+// Member types are stored shifted by one so that 0 keeps meaning "absent".
+bool SymbolTable::declareMember(uint32_t structName, uint32_t member,
+                                uint32_t type) {
+  uint32_t &slot =
+      members[(static_cast<uint64_t>(structName) << 32) | member];
+  if (slot != 0)
+    return false;
+  slot = type + 1;
+  return true;
+}
+
+int64_t SymbolTable::memberType(uint32_t structName, uint32_t member) const {
+  const uint32_t *slot =
+      members.find((static_cast<uint64_t>(structName) << 32) | member);
+  if (slot == nullptr || *slot == 0)
+    return -1;
+  return static_cast<int64_t>(*slot) - 1;
+}
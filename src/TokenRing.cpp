@@ -0,0 +1,58 @@
+#include "TokenRing.h"
+#include <thread>
+
+static void backoff(unsigned int &spins) {
+  if (++spins < 64)
+    return;
+  std::this_thread::yield();
+}
+
+TokenRing::TokenRing(size_t capacity)
+    : head(0), tail(0), closed(false), cancelled(false) {
+  size_t size = 2;
+  while (size < capacity)
+    size <<= 1;
+  slots.resize(size);
+  mask = size - 1;
+}
+
+bool TokenRing::push(std::vector<Token> &&batch) {
+  size_t t = tail.load(std::memory_order_relaxed);
+  unsigned int spins = 0;
+  while (t - head.load(std::memory_order_acquire) == slots.size()) {
+    if (cancelled.load(std::memory_order_acquire))
+      return false;
+    backoff(spins);
+  }
+  slots[t & mask] = std::move(batch);
+  tail.store(t + 1, std::memory_order_release);
+  return true;
+}
+
+bool TokenRing::pop(std::vector<Token> &batch) {
+  size_t h = head.load(std::memory_order_relaxed);
+  unsigned int spins = 0;
+  while (h == tail.load(std::memory_order_acquire)) {
+    if (closed.load(std::memory_order_acquire) &&
+        h == tail.load(std::memory_order_acquire))
+      return false;
+    backoff(spins);
+  }
+  batch = std::move(slots[h & mask]);
+  slots[h & mask].clear();
+  head.store(h + 1, std::memory_order_release);
+  return true;
+}
+
+// The error is written before the release store on `closed`, so a consumer
+// that observed the close also observes the error.
+void TokenRing::close(std::exception_ptr error) {
+  failure = error;
+  closed.store(true, std::memory_order_release);
+}
+
+void TokenRing::cancel() { cancelled.store(true, std::memory_order_release); }
+
+std::exception_ptr TokenRing::error() const {
+  return closed.load(std::memory_order_acquire) ? failure : nullptr;
+}
@@ -0,0 +1,193 @@
+#include "Utf8.h"
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+// The SSSE3 validator is built with a target attribute and picked at run
+// time, so it is used without -mssse3 on every x86 CPU that has it.
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define UTF8_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+static bool isContinuation(unsigned char byte) { return (byte & 0xC0) == 0x80; }
+
+size_t utf8SequenceLength(const char *data, size_t size) {
+  if (size == 0)
+    return 0;
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+  unsigned char lead = bytes[0];
+  if (lead < 0x80)
+    return 1;
+  size_t length;
+  // Range of the second byte, which is where overlong forms, surrogates and
+  // values past U+10FFFF show up.
+  unsigned char low = 0x80;
+  unsigned char high = 0xBF;
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    length = 2;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    length = 3;
+    if (lead == 0xE0)
+      low = 0xA0;
+    else if (lead == 0xED)
+      high = 0x9F;
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    length = 4;
+    if (lead == 0xF0)
+      low = 0x90;
+    else if (lead == 0xF4)
+      high = 0x8F;
+  } else {
+    return 0;
+  }
+  if (size < length || bytes[1] < low || bytes[1] > high)
+    return 0;
+  for (size_t i = 2; i < length; i++) {
+    if (!isContinuation(bytes[i]))
+      return 0;
+  }
+  return length;
+}
+
+// The scalar validator, from offset `i`, which must start a sequence.
+static size_t validPrefixFrom(const char *data, size_t size, size_t i) {
+  while (i < size) {
+#if defined(__SSE2__)
+    while (i + 16 <= size) {
+      __m128i chunk =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      if (_mm_movemask_epi8(chunk) != 0)
+        break;
+      i += 16;
+    }
+#endif
+    while (i + 8 <= size) {
+      uint64_t word;
+      std::memcpy(&word, data + i, sizeof(word));
+      if ((word & 0x8080808080808080ull) != 0)
+        break;
+      i += 8;
+    }
+    // Whatever stopped the fast path, one byte or sequence at a time until
+    // the next ASCII run.
+    while (i < size && static_cast<unsigned char>(data[i]) < 0x80)
+      i++;
+    while (i < size && static_cast<unsigned char>(data[i]) >= 0x80) {
+      size_t length = utf8SequenceLength(data + i, size - i);
+      if (length == 0)
+        return i;
+      i += length;
+    }
+  }
+  return size;
+}
+
+#if defined(UTF8_SSSE3)
+// Where the sequence that may run across offset `i` starts: the lead byte
+// among the three before it, or `i` itself.
+static size_t sequenceStart(const char *data, size_t i) {
+  for (size_t back = 1; back <= 3 && back <= i; back++) {
+    unsigned char byte = static_cast<unsigned char>(data[i - back]);
+    if (!isContinuation(byte))
+      return byte >= 0x80 ? i - back : i;
+  }
+  return i;
+}
+
+// Keiser and Lemire's lookup validator ("Validating UTF-8 In Less Than One
+// Instruction Per Byte"). Each byte is classified by the high nibble of the
+// byte before it, that byte's low nibble and its own high nibble; the three
+// table entries share a bit only where the pair is invalid. What the tables
+// cannot see, a third or fourth byte of a sequence, is checked by comparing
+// the bytes two and three back against E0 and F0. A block only says whether
+// it holds an error, so the scalar validator finds where, starting at the
+// sequence that ran into the block.
+__attribute__((target("ssse3"))) static size_t
+validUtf8PrefixSsse3(const char *data, size_t size) {
+  const char TOO_SHORT = 1 << 0;
+  const char TOO_LONG = 1 << 1;
+  const char OVERLONG_3 = 1 << 2;
+  const char TOO_LARGE = 1 << 3;
+  const char SURROGATE = 1 << 4;
+  const char OVERLONG_2 = 1 << 5;
+  const char TOO_LARGE_1000 = 1 << 6;
+  const char OVERLONG_4 = 1 << 6;
+  const char TWO_CONTS = static_cast<char>(1 << 7);
+  const char CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+  const __m128i byte1High = _mm_setr_epi8(
+      TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+      TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+      TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+      TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+  const __m128i byte1Low = _mm_setr_epi8(
+      CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY,
+      CARRY, CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000);
+  const __m128i byte2High = _mm_setr_epi8(
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+      TOO_SHORT, TOO_SHORT,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+          OVERLONG_4,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, TOO_SHORT,
+      TOO_SHORT, TOO_SHORT, TOO_SHORT);
+  // A block ending in the first bytes of a sequence leaves it to the next.
+  const __m128i lastComplete = _mm_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1),
+      static_cast<char>(0xC0 - 1));
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  const __m128i zero = _mm_setzero_si128();
+
+  __m128i previous = zero;
+  __m128i incomplete = zero;
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    __m128i error = incomplete;
+    if (_mm_movemask_epi8(input) != 0) {
+      __m128i prev1 = _mm_alignr_epi8(input, previous, 15);
+      __m128i special = _mm_and_si128(
+          _mm_and_si128(
+              _mm_shuffle_epi8(byte1High, _mm_and_si128(
+                                              _mm_srli_epi16(prev1, 4), nibble)),
+              _mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, nibble))),
+          _mm_shuffle_epi8(byte2High,
+                           _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+      __m128i third = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 14),
+                                    _mm_set1_epi8(0xE0 - 0x80));
+      __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 13),
+                                     _mm_set1_epi8(0xF0 - 0x80));
+      __m128i continuation =
+          _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(TWO_CONTS));
+      error = _mm_xor_si128(continuation, special);
+      incomplete = _mm_subs_epu8(input, lastComplete);
+    } else {
+      incomplete = zero;
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xFFFF)
+      return validPrefixFrom(data, size, sequenceStart(data, i));
+    previous = input;
+  }
+  return validPrefixFrom(data, size, sequenceStart(data, i));
+}
+#endif
+
+size_t validUtf8Prefix(const char *data, size_t size) {
+#if defined(UTF8_SSSE3)
+  static const bool ssse3 = __builtin_cpu_supports("ssse3");
+  if (ssse3)
+    return validUtf8PrefixSsse3(data, size);
+#endif
+  return validPrefixFrom(data, size, 0);
+}
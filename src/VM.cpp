@@ -0,0 +1,295 @@
+#include "VM.h"
+#include "Interner.h"
+#include <cmath>
+#include <limits>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+VM::VM(const Bytecode &bytecode)
+    : bytecode(bytecode), constants(bytecode.constants),
+      globals(bytecode.globals), stack(STACK_SLOTS) {
+  heap.reserve(1024);
+  heap.push_back(Value{0});
+  for (const Bytecode::StringConstant &text : bytecode.strings) {
+    int64_t ref = allocate(text.text.size());
+    for (size_t i = 0; i < text.text.size(); i++)
+      heap[ref + i].i = static_cast<unsigned char>(text.text[i]);
+    constants[text.constant].i = ref;
+  }
+}
+
+uint64_t VM::getInstructionCount() const { return executed; }
+
+Value VM::run() {
+  if (bytecode.init >= 0)
+    execute(bytecode.init);
+  return execute(bytecode.main);
+}
+
+void VM::fail(const std::string &message, const Function *function) const {
+  throw RuntimeError(message + " in '" +
+                     std::string(Interner::current().text(function->name)) +
+                     "'");
+}
+
+int64_t VM::allocate(size_t slots) {
+  if (heap.size() + slots + 1 > HEAP_LIMIT)
+    throw RuntimeError("out of memory");
+  Value length;
+  length.i = static_cast<int64_t>(slots);
+  heap.push_back(length);
+  int64_t ref = static_cast<int64_t>(heap.size());
+  heap.resize(heap.size() + slots, Value{0});
+  return ref;
+}
+
+// References can outlive the frame that allocated them, as with C locals, so
+// both the object's length and the heap bounds are checked.
+size_t VM::slot(int64_t ref, int64_t index,
+                const Function *function) const {
+  if (ref <= 0 || static_cast<uint64_t>(ref) >= heap.size())
+    fail("null reference", function);
+  if (index < 0 || index >= heap[ref - 1].i ||
+      static_cast<uint64_t>(ref + index) >= heap.size())
+    fail("index " + std::to_string(index) + " out of range", function);
+  return static_cast<size_t>(ref + index);
+}
+
+static int64_t wrap(uint64_t value) { return static_cast<int64_t>(value); }
+
+static int64_t toInt(double value) {
+  if (std::isnan(value))
+    return 0;
+  if (value >= 9.2233720368547758e18)
+    return std::numeric_limits<int64_t>::max();
+  if (value <= -9.2233720368547758e18)
+    return std::numeric_limits<int64_t>::min();
+  return static_cast<int64_t>(value);
+}
+
+Value VM::execute(int entry) {
+  std::vector<Frame> frames;
+  const Function *function = &bytecode.functions[entry];
+  const Instruction *pc = function->code.data();
+  Value *base = stack.data();
+  Value *const limit = stack.data() + stack.size();
+  size_t heapTop = heap.size();
+  // Globals allocated by the initializer have to survive it.
+  bool release = entry != bytecode.init;
+  uint64_t count = 0;
+  Instruction i;
+  Value result;
+
+#define R(x) base[x]
+
+#if VM_COMPUTED_GOTO
+  static void *const labels[] = {
+#define OPCODE_LABEL(name) &&op_##name,
+      OPCODES(OPCODE_LABEL)
+#undef OPCODE_LABEL
+  };
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    i = *pc++;                                                                 \
+    count++;                                                                   \
+    goto *labels[i.op];                                                        \
+  } while (0)
+#define CASE(name) op_##name:
+  DISPATCH();
+#else
+#define DISPATCH() continue
+#define CASE(name) case OP_##name:
+  for (;;) {
+    i = *pc++;
+    count++;
+    switch (i.op) {
+#endif
+
+  CASE(MOVE) {
+    R(i.a) = R(i.b);
+    DISPATCH();
+  }
+  CASE(LOADK) {
+    R(i.a) = constants[i.bx()];
+    DISPATCH();
+  }
+  CASE(GETG) {
+    R(i.a) = globals[i.bx()];
+    DISPATCH();
+  }
+  CASE(SETG) {
+    globals[i.bx()] = R(i.a);
+    DISPATCH();
+  }
+  CASE(ADDI) {
+    R(i.a).i = wrap(static_cast<uint64_t>(R(i.b).i) +
+                    static_cast<uint64_t>(R(i.c).i));
+    DISPATCH();
+  }
+  CASE(SUBI) {
+    R(i.a).i = wrap(static_cast<uint64_t>(R(i.b).i) -
+                    static_cast<uint64_t>(R(i.c).i));
+    DISPATCH();
+  }
+  CASE(MULI) {
+    R(i.a).i = wrap(static_cast<uint64_t>(R(i.b).i) *
+                    static_cast<uint64_t>(R(i.c).i));
+    DISPATCH();
+  }
+  CASE(DIVI) {
+    int64_t divisor = R(i.c).i;
+    if (divisor == 0)
+      fail("division by zero", function);
+    if (divisor == -1)
+      R(i.a).i = wrap(0 - static_cast<uint64_t>(R(i.b).i));
+    else
+      R(i.a).i = R(i.b).i / divisor;
+    DISPATCH();
+  }
+  CASE(ADDF) {
+    R(i.a).f = R(i.b).f + R(i.c).f;
+    DISPATCH();
+  }
+  CASE(SUBF) {
+    R(i.a).f = R(i.b).f - R(i.c).f;
+    DISPATCH();
+  }
+  CASE(MULF) {
+    R(i.a).f = R(i.b).f * R(i.c).f;
+    DISPATCH();
+  }
+  CASE(DIVF) {
+    R(i.a).f = R(i.b).f / R(i.c).f;
+    DISPATCH();
+  }
+  CASE(LTI) {
+    R(i.a).i = R(i.b).i < R(i.c).i;
+    DISPATCH();
+  }
+  CASE(LEI) {
+    R(i.a).i = R(i.b).i <= R(i.c).i;
+    DISPATCH();
+  }
+  CASE(EQI) {
+    R(i.a).i = R(i.b).i == R(i.c).i;
+    DISPATCH();
+  }
+  CASE(NEI) {
+    R(i.a).i = R(i.b).i != R(i.c).i;
+    DISPATCH();
+  }
+  CASE(LTF) {
+    R(i.a).i = R(i.b).f < R(i.c).f;
+    DISPATCH();
+  }
+  CASE(LEF) {
+    R(i.a).i = R(i.b).f <= R(i.c).f;
+    DISPATCH();
+  }
+  CASE(EQF) {
+    R(i.a).i = R(i.b).f == R(i.c).f;
+    DISPATCH();
+  }
+  CASE(NEF) {
+    R(i.a).i = R(i.b).f != R(i.c).f;
+    DISPATCH();
+  }
+  CASE(ITOF) {
+    R(i.a).f = static_cast<double>(R(i.b).i);
+    DISPATCH();
+  }
+  CASE(FTOI) {
+    R(i.a).i = toInt(R(i.b).f);
+    DISPATCH();
+  }
+  CASE(JMP) {
+    pc = function->code.data() + i.bx();
+    DISPATCH();
+  }
+  CASE(JMPF) {
+    if (R(i.a).i == 0)
+      pc = function->code.data() + i.bx();
+    DISPATCH();
+  }
+  CASE(JMPT) {
+    if (R(i.a).i != 0)
+      pc = function->code.data() + i.bx();
+    DISPATCH();
+  }
+  CASE(NEW) {
+    R(i.a).i = allocate(i.bx());
+    DISPATCH();
+  }
+  CASE(GETX) {
+    R(i.a) = heap[slot(R(i.b).i, R(i.c).i, function)];
+    DISPATCH();
+  }
+  CASE(SETX) {
+    heap[slot(R(i.a).i, R(i.b).i, function)] = R(i.c);
+    DISPATCH();
+  }
+  CASE(GETF) {
+    R(i.a) = heap[slot(R(i.b).i, i.c, function)];
+    DISPATCH();
+  }
+  CASE(SETF) {
+    heap[slot(R(i.a).i, i.b, function)] = R(i.c);
+    DISPATCH();
+  }
+  CASE(CALL) {
+    const Function *callee = &bytecode.functions[i.bx()];
+    Value *callee_base = base + i.a;
+    if (callee_base + callee->registers > limit ||
+        frames.size() >= MAX_FRAMES)
+      fail("stack overflow", callee);
+    frames.push_back(Frame{function, pc, base, heapTop});
+    function = callee;
+    pc = callee->code.data();
+    base = callee_base;
+    heapTop = heap.size();
+    DISPATCH();
+  }
+  CASE(RET) {
+    result = R(i.a);
+    goto leave;
+  }
+  CASE(RETV) {
+    result.i = 0;
+    goto leave;
+  }
+
+#if !VM_COMPUTED_GOTO
+    default:
+      fail("bad opcode", function);
+    }
+    continue;
+#endif
+
+leave:
+  // A frame's objects die with it, like C locals.
+  if (release)
+    heap.resize(heapTop);
+  if (frames.empty()) {
+    executed += count;
+    return result;
+  }
+  base[0] = result;
+  const Frame &caller = frames.back();
+  function = caller.function;
+  pc = caller.pc;
+  base = caller.base;
+  heapTop = caller.heapTop;
+  frames.pop_back();
+  DISPATCH();
+#if !VM_COMPUTED_GOTO
+  }
+#endif
+
+#undef R
+#undef DISPATCH
+#undef CASE
+}
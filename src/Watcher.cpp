@@ -0,0 +1,128 @@
+#include "Watcher.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#ifdef __linux__
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+Watcher::Watcher(Project &project, unsigned int threads)
+    : project(project), threads(threads) {}
+
+#ifdef __linux__
+
+static void splitPath(const std::string &path, std::string &directory,
+                      std::string &name) {
+  size_t slash = path.find_last_of('/');
+  if (slash == std::string::npos) {
+    directory = ".";
+    name = path;
+  } else {
+    directory = slash == 0 ? "/" : path.substr(0, slash);
+    name = path.substr(slash + 1);
+  }
+}
+
+// Adding a watch for a directory that already has one returns the same
+// descriptor, so this is simply redone after every rebuild to pick up new
+// includes.
+bool Watcher::watchFiles() {
+  this->files.clear();
+  for (const std::string &path : this->project.files()) {
+    std::string directory;
+    std::string name;
+    splitPath(path, directory, name);
+    int wd = inotify_add_watch(this->fd, directory.c_str(),
+                               IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+      std::cerr << "Error: Unable to watch \"" << directory << "\""
+                << std::endl;
+      return false;
+    }
+    this->directories[wd] = directory;
+    this->files[directory + "/" + name].push_back(path);
+  }
+  return true;
+}
+
+void Watcher::readEvents(std::vector<std::string> &changed) {
+  alignas(inotify_event) char buffer[4096];
+  while (true) {
+    ssize_t length = read(this->fd, buffer, sizeof(buffer));
+    if (length <= 0)
+      return;
+    const inotify_event *event;
+    for (char *p = buffer; p < buffer + length;
+         p += sizeof(inotify_event) + event->len) {
+      event = reinterpret_cast<const inotify_event *>(p);
+      if (event->len == 0)
+        continue;
+      auto directory = this->directories.find(event->wd);
+      if (directory == this->directories.end())
+        continue;
+      auto found = this->files.find(directory->second + "/" + event->name);
+      if (found == this->files.end())
+        continue;
+      for (const std::string &path : found->second) {
+        if (std::find(changed.begin(), changed.end(), path) == changed.end())
+          changed.push_back(path);
+      }
+    }
+  }
+}
+
+bool Watcher::run() {
+  this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (this->fd < 0) {
+    std::cerr << "Error: Unable to start inotify" << std::endl;
+    return false;
+  }
+  if (!this->watchFiles()) {
+    close(this->fd);
+    return false;
+  }
+  std::cout << "\nWatching " << this->files.size()
+            << " files, press Ctrl+C to stop" << std::endl;
+  pollfd events = {this->fd, POLLIN, 0};
+  while (true) {
+    if (poll(&events, 1, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    auto saved = std::chrono::steady_clock::now();
+    std::vector<std::string> changed;
+    this->readEvents(changed);
+    while (poll(&events, 1, DEBOUNCE_MS) > 0)
+      this->readEvents(changed);
+    if (changed.empty())
+      continue;
+
+    std::cout << "\n";
+    bool passed = this->project.rebuild(changed, this->threads, std::cout);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - saved;
+    std::cout << (passed ? "No errors" : "Errors remain") << ", rebuilt in "
+              << std::fixed << std::setprecision(3) << elapsed.count() * 1000
+              << " ms after the save" << std::defaultfloat << std::endl;
+    if (!this->watchFiles())
+      break;
+  }
+  close(this->fd);
+  return false;
+}
+
+#else
+
+bool Watcher::run() {
+  std::cerr << "Error: --watch needs inotify, which is only available on "
+               "Linux"
+            << std::endl;
+  return false;
+}
+
+#endif
@@ -0,0 +1,989 @@
+#include "X86Emitter.h"
+#include "Interner.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+const char *const registerNames[16] = {"rax", "rcx", "rdx", "rbx",
+                                       "rsp", "rbp", "rsi", "rdi",
+                                       "r8",  "r9",  "r10", "r11",
+                                       "r12", "r13", "r14", "r15"};
+
+// rax, rcx, rdx and r11 are kept free as scratch for every instruction.
+const int callerSaved[] = {6, 7, 8, 9, 10};
+const int calleeSaved[] = {3, 12, 13, 14, 15};
+const int intArguments[] = {7, 6, 2, 1, 8, 9};
+const unsigned int floatArguments = 8;
+
+// Objects live in a bump heap that every call releases on return, as in
+// the VM; its size matches the VM's heap limit.
+const size_t HEAP_BYTES = size_t(1) << 28;
+// Calls fail with "stack overflow" this far below the initial stack.
+const size_t STACK_RESERVE = 7 << 20;
+
+const char *const runtime = R"(
+__rt_write:
+  mov eax, 1
+  mov edi, 1
+  syscall
+  ret
+
+__rt_exit:
+  mov eax, 60
+  syscall
+
+# rsi: NUL-terminated string.
+__rt_puts:
+  mov rdx, rsi
+.Lrt_puts_scan:
+  cmp byte ptr [rdx], 0
+  je .Lrt_puts_write
+  inc rdx
+  jmp .Lrt_puts_scan
+.Lrt_puts_write:
+  sub rdx, rsi
+  jmp __rt_write
+
+# rax: integer to print in decimal.
+__rt_print_int:
+  sub rsp, 40
+  lea rsi, [rsp + 32]
+  mov r8, rax
+  test rax, rax
+  jns .Lrt_int_digits
+  neg rax
+.Lrt_int_digits:
+  mov r9, 10
+.Lrt_int_loop:
+  xor edx, edx
+  div r9
+  add dl, '0'
+  dec rsi
+  mov byte ptr [rsi], dl
+  test rax, rax
+  jnz .Lrt_int_loop
+  test r8, r8
+  jns .Lrt_int_write
+  dec rsi
+  mov byte ptr [rsi], '-'
+.Lrt_int_write:
+  lea rdx, [rsp + 32]
+  sub rdx, rsi
+  call __rt_write
+  add rsp, 40
+  ret
+
+# xmm0: float to print like printf's %g, six significant digits.
+__rt_print_float:
+  push rbx
+  sub rsp, 80
+  mov rdi, rsp
+  movq rax, xmm0
+  ucomisd xmm0, xmm0
+  jp .Lrt_float_nan
+  test rax, rax
+  jns .Lrt_float_positive
+  mov byte ptr [rdi], '-'
+  inc rdi
+  btr rax, 63
+  movq xmm0, rax
+.Lrt_float_positive:
+  movabs rcx, 0x7ff0000000000000
+  cmp rax, rcx
+  je .Lrt_float_inf
+  test rax, rax
+  jz .Lrt_float_zero
+  xor ebx, ebx
+  movsd xmm1, qword ptr [rip + .Lrt_ten]
+  movsd xmm2, qword ptr [rip + .Lrt_one]
+.Lrt_float_down:
+  ucomisd xmm0, xmm1
+  jb .Lrt_float_up
+  divsd xmm0, xmm1
+  inc ebx
+  jmp .Lrt_float_down
+.Lrt_float_up:
+  ucomisd xmm0, xmm2
+  jae .Lrt_float_scaled
+  mulsd xmm0, xmm1
+  dec ebx
+  jmp .Lrt_float_up
+.Lrt_float_scaled:
+  mulsd xmm0, qword ptr [rip + .Lrt_scale]
+  cvtsd2si rax, xmm0
+  cmp rax, 1000000
+  jb .Lrt_float_split
+  xor edx, edx
+  mov ecx, 10
+  div rcx
+  inc ebx
+.Lrt_float_split:
+  lea rsi, [rsp + 70]
+  mov ecx, 6
+  mov r8, 10
+.Lrt_float_digit:
+  xor edx, edx
+  div r8
+  add dl, '0'
+  dec rsi
+  mov byte ptr [rsi], dl
+  dec ecx
+  jnz .Lrt_float_digit
+  mov r9d, 6
+.Lrt_float_trim:
+  cmp r9d, 1
+  je .Lrt_float_format
+  cmp byte ptr [rsi + r9 - 1], '0'
+  jne .Lrt_float_format
+  dec r9d
+  jmp .Lrt_float_trim
+.Lrt_float_format:
+  cmp ebx, -4
+  jl .Lrt_float_exponent
+  cmp ebx, 6
+  jge .Lrt_float_exponent
+  test ebx, ebx
+  js .Lrt_float_small
+  xor ecx, ecx
+.Lrt_float_whole:
+  mov al, byte ptr [rsi + rcx]
+  mov byte ptr [rdi], al
+  inc rdi
+  inc ecx
+  cmp ecx, ebx
+  jle .Lrt_float_whole
+  cmp ecx, r9d
+  jge .Lrt_float_done
+  mov byte ptr [rdi], '.'
+  inc rdi
+.Lrt_float_fraction:
+  mov al, byte ptr [rsi + rcx]
+  mov byte ptr [rdi], al
+  inc rdi
+  inc ecx
+  cmp ecx, r9d
+  jl .Lrt_float_fraction
+  jmp .Lrt_float_done
+.Lrt_float_small:
+  mov byte ptr [rdi], '0'
+  mov byte ptr [rdi + 1], '.'
+  add rdi, 2
+  mov ecx, ebx
+  neg ecx
+  dec ecx
+.Lrt_float_zeros:
+  test ecx, ecx
+  jz .Lrt_float_small_digits
+  mov byte ptr [rdi], '0'
+  inc rdi
+  dec ecx
+  jmp .Lrt_float_zeros
+.Lrt_float_small_digits:
+  mov al, byte ptr [rsi + rcx]
+  mov byte ptr [rdi], al
+  inc rdi
+  inc ecx
+  cmp ecx, r9d
+  jl .Lrt_float_small_digits
+  jmp .Lrt_float_done
+.Lrt_float_exponent:
+  mov al, byte ptr [rsi]
+  mov byte ptr [rdi], al
+  inc rdi
+  mov ecx, 1
+  cmp ecx, r9d
+  jge .Lrt_float_e
+  mov byte ptr [rdi], '.'
+  inc rdi
+.Lrt_float_mantissa:
+  mov al, byte ptr [rsi + rcx]
+  mov byte ptr [rdi], al
+  inc rdi
+  inc ecx
+  cmp ecx, r9d
+  jl .Lrt_float_mantissa
+.Lrt_float_e:
+  mov byte ptr [rdi], 'e'
+  inc rdi
+  mov al, '+'
+  test ebx, ebx
+  jns .Lrt_float_sign
+  mov al, '-'
+  neg ebx
+.Lrt_float_sign:
+  mov byte ptr [rdi], al
+  inc rdi
+  mov eax, ebx
+  cmp eax, 100
+  jb .Lrt_float_two
+  xor edx, edx
+  mov ecx, 100
+  div ecx
+  add al, '0'
+  mov byte ptr [rdi], al
+  inc rdi
+  mov eax, edx
+.Lrt_float_two:
+  xor edx, edx
+  mov ecx, 10
+  div ecx
+  add al, '0'
+  mov byte ptr [rdi], al
+  add dl, '0'
+  mov byte ptr [rdi + 1], dl
+  add rdi, 2
+  jmp .Lrt_float_done
+.Lrt_float_nan:
+  mov dword ptr [rdi], 0x6e616e
+  add rdi, 3
+  jmp .Lrt_float_done
+.Lrt_float_inf:
+  mov dword ptr [rdi], 0x666e69
+  add rdi, 3
+  jmp .Lrt_float_done
+.Lrt_float_zero:
+  mov byte ptr [rdi], '0'
+  inc rdi
+.Lrt_float_done:
+  mov rsi, rsp
+  mov rdx, rdi
+  sub rdx, rsp
+  call __rt_write
+  add rsp, 80
+  pop rbx
+  ret
+
+# rax: slots. Returns the new object in rax; only rcx, rdx and r11 are
+# clobbered, so allocation can happen with registers live.
+__rt_new:
+  mov rdx, qword ptr [rip + __heap_top]
+  lea rcx, [rdx + rax*8 + 8]
+  lea r11, [rip + __heap_end]
+  cmp rcx, r11
+  ja __rt_out_of_memory
+  mov qword ptr [rip + __heap_top], rcx
+  mov qword ptr [rdx], rax
+  lea r11, [rdx + 8]
+.Lrt_new_zero:
+  cmp r11, rcx
+  jae .Lrt_new_done
+  mov qword ptr [r11], 0
+  add r11, 8
+  jmp .Lrt_new_zero
+.Lrt_new_done:
+  lea rax, [rdx + 8]
+  ret
+
+# rdi: message, rsi: function name.
+__rt_fail:
+  mov rbx, rsi
+  mov r12, rdi
+  lea rsi, [rip + .Lrt_error]
+  call __rt_puts
+  mov rsi, r12
+  call __rt_puts
+.Lrt_fail_where:
+  lea rsi, [rip + .Lrt_in]
+  call __rt_puts
+  mov rsi, rbx
+  call __rt_puts
+  lea rsi, [rip + .Lrt_quote]
+  call __rt_puts
+  mov edi, 1
+  jmp __rt_exit
+
+# rax: index, rsi: function name.
+__rt_index:
+  mov rbx, rsi
+  mov r12, rax
+  lea rsi, [rip + .Lrt_error]
+  call __rt_puts
+  lea rsi, [rip + .Lrt_index]
+  call __rt_puts
+  mov rax, r12
+  call __rt_print_int
+  lea rsi, [rip + .Lrt_range]
+  call __rt_puts
+  jmp .Lrt_fail_where
+
+__rt_null:
+  lea rdi, [rip + .Lrt_null]
+  jmp __rt_fail
+
+__rt_div:
+  lea rdi, [rip + .Lrt_div]
+  jmp __rt_fail
+
+__rt_stack:
+  lea rdi, [rip + .Lrt_stack]
+  jmp __rt_fail
+
+__rt_out_of_memory:
+  lea rsi, [rip + .Lrt_error]
+  call __rt_puts
+  lea rsi, [rip + .Lrt_memory]
+  call __rt_puts
+  mov edi, 1
+  jmp __rt_exit
+
+  .section .rodata
+  .align 8
+.Lrt_ten: .double 10.0
+.Lrt_one: .double 1.0
+.Lrt_scale: .double 100000.0
+.Lrt_returned: .asciz "Program returned "
+.Lrt_newline: .asciz "\n"
+.Lrt_error: .asciz "Runtime Error: "
+.Lrt_in: .asciz " in '"
+.Lrt_quote: .asciz "'\n"
+.Lrt_index: .asciz "index "
+.Lrt_range: .asciz " out of range"
+.Lrt_null: .asciz "null reference"
+.Lrt_div: .asciz "division by zero"
+.Lrt_stack: .asciz "stack overflow"
+.Lrt_memory: .asciz "out of memory\n"
+  .text
+)";
+
+bool isCompare(IrOp op) { return op >= IR_LT && op <= IR_NE; }
+
+const char *condition(IrOp op, bool inverse) {
+  switch (op) {
+  case IR_LT:
+    return inverse ? "ge" : "l";
+  case IR_LE:
+    return inverse ? "g" : "le";
+  case IR_EQ:
+    return inverse ? "ne" : "e";
+  default:
+    return inverse ? "e" : "ne";
+  }
+}
+
+std::string quoteShell(const std::string &text) {
+  std::string quoted = "'";
+  for (char c : text) {
+    if (c == '\'')
+      quoted += "'\\''";
+    else
+      quoted += c;
+  }
+  return quoted + "'";
+}
+
+} // namespace
+
+X86Emitter::X86Emitter(const IrModule &module) : module(module) {}
+
+std::string X86Emitter::slotAddress(int slot) const {
+  int offset = 8 * (static_cast<int>(savedRegisters.size()) + 1 + slot);
+  return "qword ptr [rbp - " + std::to_string(offset) + "]";
+}
+
+std::string X86Emitter::operand(uint32_t value) const {
+  const Location &location = locations[value];
+  if (location.reg >= 0)
+    return registerNames[location.reg];
+  return slotAddress(location.slot);
+}
+
+bool X86Emitter::sameLocation(uint32_t a, uint32_t b) const {
+  return locations[a].reg == locations[b].reg &&
+         locations[a].slot == locations[b].slot;
+}
+
+bool X86Emitter::inRegister(uint32_t value) const {
+  return locations[value].reg >= 0;
+}
+
+std::string X86Emitter::blockLabel(uint32_t block) const {
+  return ".L" + std::to_string(index) + "_b" + std::to_string(block);
+}
+
+std::string X86Emitter::label(const char *what) const {
+  return ".L" + std::to_string(index) + "_" + what;
+}
+
+// Poletto and Sarkar's linear scan. An interval runs from the first to the
+// last position where the value is defined, used or live at a block edge,
+// with blocks taken in code order.
+void X86Emitter::allocateRegisters() {
+  const uint32_t none = UINT32_MAX;
+  uint32_t registers = function->registers;
+  std::vector<uint32_t> first(registers, none);
+  std::vector<uint32_t> last(registers, 0);
+  std::vector<uint32_t> calls;
+  auto touch = [&](uint32_t value, uint32_t position) {
+    if (value == IrInstr::NO_VALUE)
+      return;
+    first[value] = std::min(first[value], position);
+    last[value] = std::max(last[value], position);
+  };
+
+  uint32_t position = 0;
+  for (const IrBlock &block : function->blocks) {
+    uint32_t start = position++;
+    for (uint32_t value = 0; value < registers; value++)
+      if (block.liveIn.test(value))
+        touch(value, start);
+    for (const IrInstr &instr : block.code) {
+      touch(instr.a, position);
+      touch(instr.b, position);
+      touch(instr.c, position);
+      for (uint32_t i = 0; i < instr.argCount; i++)
+        touch(function->args[instr.argStart + i], position);
+      touch(instr.dst, position);
+      if (instr.op == IR_CALL)
+        calls.push_back(position);
+      position++;
+    }
+    uint32_t end = position++;
+    touch(block.term.cond, end);
+    touch(block.term.value, end);
+    for (uint32_t value = 0; value < registers; value++)
+      if (block.liveOut.test(value))
+        touch(value, end);
+  }
+  // Parameters arrive on entry.
+  for (uint32_t param = 0; param < function->params; param++)
+    if (first[param] != none)
+      first[param] = 0;
+
+  std::vector<Interval> intervals;
+  for (uint32_t value = 0; value < registers; value++) {
+    if (first[value] == none)
+      continue;
+    auto call = std::upper_bound(calls.begin(), calls.end(), first[value]);
+    intervals.push_back(Interval{value, first[value], last[value],
+                                 call != calls.end() && *call < last[value]});
+  }
+  std::sort(intervals.begin(), intervals.end(),
+            [](const Interval &a, const Interval &b) {
+              return a.start < b.start;
+            });
+
+  locations.assign(registers, Location());
+  slots = 1;
+  bool busy[16] = {};
+  bool used[16] = {};
+  std::vector<const Interval *> active;
+  for (const Interval &current : intervals) {
+    // An operand's last use and the result of the same instruction may
+    // share a register: operands are read into scratch first.
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [&](const Interval *interval) {
+                                  if (interval->end > current.start)
+                                    return false;
+                                  busy[locations[interval->value].reg] = false;
+                                  return true;
+                                }),
+                 active.end());
+
+    int chosen = -1;
+    if (!current.crossesCall)
+      for (int reg : callerSaved)
+        if (chosen < 0 && !busy[reg])
+          chosen = reg;
+    for (int reg : calleeSaved)
+      if (chosen < 0 && !busy[reg])
+        chosen = reg;
+
+    if (chosen < 0) {
+      // Spill whichever eligible interval ends last.
+      const Interval *victim = nullptr;
+      for (const Interval *interval : active) {
+        int reg = locations[interval->value].reg;
+        bool callerSavedReg =
+            std::find(std::begin(callerSaved), std::end(callerSaved), reg) !=
+            std::end(callerSaved);
+        if (current.crossesCall && callerSavedReg)
+          continue;
+        if (victim == nullptr || interval->end > victim->end)
+          victim = interval;
+      }
+      if (victim == nullptr || victim->end <= current.end) {
+        locations[current.value].slot = slots++;
+        continue;
+      }
+      chosen = locations[victim->value].reg;
+      locations[victim->value].reg = -1;
+      locations[victim->value].slot = slots++;
+      active.erase(std::find(active.begin(), active.end(), victim));
+    }
+    locations[current.value].reg = chosen;
+    busy[chosen] = true;
+    used[chosen] = true;
+    active.push_back(&current);
+  }
+
+  savedRegisters.clear();
+  for (int reg : calleeSaved)
+    if (used[reg])
+      savedRegisters.push_back(reg);
+  // Keeps rsp 16-byte aligned at calls.
+  if ((savedRegisters.size() + slots) % 2 != 0)
+    slots++;
+}
+
+void X86Emitter::emitPrologue() {
+  std::ostream &out = *this->out;
+  for (int reg : savedRegisters)
+    out << "  push " << registerNames[reg] << "\n";
+  out << "  sub rsp, " << 8 * slots << "\n";
+  out << "  cmp rsp, qword ptr [rip + __stack_limit]\n";
+  out << "  jb " << label("stack") << "\n";
+
+  // Spill the register arguments first so that no parameter's new home
+  // overwrites one still waiting to be moved.
+  unsigned int ints = 0;
+  unsigned int floats = 0;
+  unsigned int stacked = 0;
+  std::vector<uint32_t> pushed;
+  for (uint32_t param = 0; param < function->params; param++) {
+    bool isFloat = function->floatParams[param];
+    if (isFloat && floats < floatArguments) {
+      out << "  sub rsp, 8\n  movq qword ptr [rsp], xmm" << floats++ << "\n";
+      pushed.push_back(param);
+    } else if (!isFloat && ints < 6) {
+      out << "  push " << registerNames[intArguments[ints++]] << "\n";
+      pushed.push_back(param);
+    } else if (locations[param].reg >= 0 || locations[param].slot >= 0) {
+      out << "  mov rax, qword ptr [rbp + " << 16 + 8 * stacked++ << "]\n";
+      out << "  mov " << operand(param) << ", rax\n";
+    } else {
+      stacked++;
+    }
+  }
+  for (auto it = pushed.rbegin(); it != pushed.rend(); ++it) {
+    if (locations[*it].reg >= 0 || locations[*it].slot >= 0)
+      out << "  pop " << operand(*it) << "\n";
+    else
+      out << "  add rsp, 8\n";
+  }
+  if (static_cast<int>(index) != module.bytecode->init) {
+    out << "  mov rax, qword ptr [rip + __heap_top]\n";
+    out << "  mov " << slotAddress(0) << ", rax\n";
+  }
+}
+
+void X86Emitter::emitFunction() {
+  std::ostream &out = *this->out;
+  allocateRegisters();
+  labels = 0;
+  out << "\n";
+  if (static_cast<int>(index) == module.bytecode->init)
+    out << "__init:\n";
+  else
+    out << "fn_" << Interner::current().text(function->name) << ":\n";
+  out << "  push rbp\n  mov rbp, rsp\n";
+  emitPrologue();
+
+  for (uint32_t b = 0; b < function->blocks.size(); b++) {
+    const IrBlock &block = function->blocks[b];
+    out << blockLabel(b) << ":\n";
+    // A compare that only feeds the branch after it sets the flags the
+    // branch tests directly.
+    bool fused = block.term.kind == TERM_BRANCH && !block.code.empty() &&
+                 isCompare(block.code.back().op) &&
+                 !block.code.back().isFloat &&
+                 block.code.back().dst == block.term.cond &&
+                 !block.liveOut.test(block.term.cond);
+    for (size_t i = 0; i < block.code.size(); i++) {
+      if (fused && i + 1 == block.code.size())
+        emitCompare(block.code[i], true);
+      else
+        emitInstr(block.code[i]);
+    }
+    emitTerminator(block, b, fused);
+  }
+
+  out << label("null") << ":\n";
+  out << "  lea rsi, [rip + " << label("name") << "]\n  jmp __rt_null\n";
+  out << label("index") << ":\n  mov rax, rcx\n";
+  out << "  lea rsi, [rip + " << label("name") << "]\n  jmp __rt_index\n";
+  out << label("div") << ":\n";
+  out << "  lea rsi, [rip + " << label("name") << "]\n  jmp __rt_div\n";
+  out << label("stack") << ":\n";
+  out << "  lea rsi, [rip + " << label("name") << "]\n  jmp __rt_stack\n";
+  out << "  .section .rodata\n";
+  out << label("name") << ": .asciz \"";
+  if (static_cast<int>(index) != module.bytecode->init)
+    out << Interner::current().text(function->name);
+  out << "\"\n  .text\n";
+}
+
+void X86Emitter::emitInstr(const IrInstr &instr) {
+  std::ostream &out = *this->out;
+  switch (instr.op) {
+  case IR_CONST: {
+    auto string = strings.find(instr.imm);
+    if (string != strings.end()) {
+      out << "  mov rax, qword ptr [rip + __string" << string->second
+          << "]\n";
+      out << "  mov " << operand(instr.dst) << ", rax\n";
+      break;
+    }
+    int64_t value = module.bytecode->constants[instr.imm].i;
+    if (value >= INT32_MIN && value <= INT32_MAX) {
+      out << "  mov " << operand(instr.dst) << ", " << value << "\n";
+    } else if (inRegister(instr.dst)) {
+      out << "  movabs " << operand(instr.dst) << ", " << value << "\n";
+    } else {
+      out << "  movabs rax, " << value << "\n";
+      out << "  mov " << operand(instr.dst) << ", rax\n";
+    }
+    break;
+  }
+  case IR_COPY:
+    if (sameLocation(instr.dst, instr.a))
+      break;
+    if (inRegister(instr.dst) || inRegister(instr.a)) {
+      out << "  mov " << operand(instr.dst) << ", " << operand(instr.a)
+          << "\n";
+    } else {
+      out << "  mov rax, " << operand(instr.a) << "\n";
+      out << "  mov " << operand(instr.dst) << ", rax\n";
+    }
+    break;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_DIV:
+    emitArithmetic(instr);
+    break;
+  case IR_LT:
+  case IR_LE:
+  case IR_EQ:
+  case IR_NE:
+    emitCompare(instr, false);
+    break;
+  case IR_ITOF:
+    out << "  cvtsi2sd xmm0, " << operand(instr.a) << "\n";
+    out << "  movq " << operand(instr.dst) << ", xmm0\n";
+    break;
+  case IR_FTOI: {
+    // cvttsd2si gives INT64_MIN for NaN and out-of-range values; the VM
+    // gives 0 for NaN and saturates the rest.
+    std::string done = label(std::to_string(labels++).c_str());
+    std::string nan = label(std::to_string(labels++).c_str());
+    out << "  movq xmm0, " << operand(instr.a) << "\n";
+    out << "  cvttsd2si rax, xmm0\n";
+    out << "  movabs rcx, -9223372036854775808\n";
+    out << "  cmp rax, rcx\n  jne " << done << "\n";
+    out << "  ucomisd xmm0, xmm0\n  jp " << nan << "\n";
+    out << "  xorpd xmm1, xmm1\n  ucomisd xmm0, xmm1\n  jbe " << done
+        << "\n";
+    out << "  not rax\n  jmp " << done << "\n";
+    out << nan << ":\n  xor eax, eax\n";
+    out << done << ":\n  mov " << operand(instr.dst) << ", rax\n";
+    break;
+  }
+  case IR_GETG:
+    out << "  mov rax, qword ptr [rip + __globals + " << 8 * instr.imm
+        << "]\n";
+    out << "  mov " << operand(instr.dst) << ", rax\n";
+    break;
+  case IR_SETG:
+    out << "  mov rax, " << operand(instr.a) << "\n";
+    out << "  mov qword ptr [rip + __globals + " << 8 * instr.imm
+        << "], rax\n";
+    break;
+  case IR_NEW:
+    out << "  mov eax, " << instr.imm << "\n  call __rt_new\n";
+    out << "  mov " << operand(instr.dst) << ", rax\n";
+    break;
+  case IR_GETX:
+  case IR_GETF:
+    emitSlotAddress(instr);
+    out << "  mov rax, qword ptr [rdx]\n";
+    out << "  mov " << operand(instr.dst) << ", rax\n";
+    break;
+  case IR_SETX:
+  case IR_SETF:
+    emitSlotAddress(instr);
+    out << "  mov r11, "
+        << operand(instr.op == IR_SETX ? instr.c : instr.b) << "\n";
+    out << "  mov qword ptr [rdx], r11\n";
+    break;
+  default:
+    emitCall(instr);
+    break;
+  }
+}
+
+void X86Emitter::emitArithmetic(const IrInstr &instr) {
+  std::ostream &out = *this->out;
+  std::string dst = operand(instr.dst);
+  std::string a = operand(instr.a);
+  std::string b = operand(instr.b);
+  if (instr.isFloat) {
+    static const char *const ops[] = {"addsd", "subsd", "mulsd", "divsd"};
+    out << "  movq xmm0, " << a << "\n  movq xmm1, " << b << "\n";
+    out << "  " << ops[instr.op - IR_ADD] << " xmm0, xmm1\n";
+    out << "  movq " << dst << ", xmm0\n";
+    return;
+  }
+  if (instr.op == IR_DIV) {
+    // The VM negates for -1 rather than trapping on INT64_MIN / -1.
+    std::string divide = label(std::to_string(labels++).c_str());
+    std::string done = label(std::to_string(labels++).c_str());
+    out << "  mov rcx, " << b << "\n  test rcx, rcx\n  jz " << label("div")
+        << "\n";
+    out << "  mov rax, " << a << "\n  cmp rcx, -1\n  jne " << divide << "\n";
+    out << "  neg rax\n  jmp " << done << "\n";
+    out << divide << ":\n  cqo\n  idiv rcx\n";
+    out << done << ":\n  mov " << dst << ", rax\n";
+    return;
+  }
+  static const char *const ops[] = {"add", "sub", "imul"};
+  const char *op = ops[instr.op - IR_ADD];
+  if (inRegister(instr.dst) && !sameLocation(instr.dst, instr.b)) {
+    if (!sameLocation(instr.dst, instr.a))
+      out << "  mov " << dst << ", " << a << "\n";
+    out << "  " << op << " " << dst << ", " << b << "\n";
+    return;
+  }
+  out << "  mov rax, " << a << "\n  " << op << " rax, " << b << "\n";
+  out << "  mov " << dst << ", rax\n";
+}
+
+void X86Emitter::emitCompare(const IrInstr &instr, bool fused) {
+  std::ostream &out = *this->out;
+  std::string a = operand(instr.a);
+  std::string b = operand(instr.b);
+  if (instr.isFloat) {
+    out << "  movq xmm0, " << a << "\n  movq xmm1, " << b << "\n";
+    // NaN compares false, except for !=.
+    switch (instr.op) {
+    case IR_LT:
+      out << "  ucomisd xmm1, xmm0\n  seta al\n";
+      break;
+    case IR_LE:
+      out << "  ucomisd xmm1, xmm0\n  setae al\n";
+      break;
+    case IR_EQ:
+      out << "  ucomisd xmm0, xmm1\n  sete al\n  setnp cl\n  and al, cl\n";
+      break;
+    default:
+      out << "  ucomisd xmm0, xmm1\n  setne al\n  setp cl\n  or al, cl\n";
+      break;
+    }
+  } else {
+    if (inRegister(instr.a)) {
+      out << "  cmp " << a << ", " << b << "\n";
+    } else {
+      out << "  mov rax, " << a << "\n  cmp rax, " << b << "\n";
+    }
+    if (fused)
+      return;
+    out << "  set" << condition(instr.op, false) << " al\n";
+  }
+  out << "  movzx eax, al\n  mov " << operand(instr.dst) << ", rax\n";
+}
+
+// Leaves the address of the slot in rdx, after the VM's null and bounds
+// checks; the index is in rcx for the error message.
+void X86Emitter::emitSlotAddress(const IrInstr &instr) {
+  std::ostream &out = *this->out;
+  out << "  mov rax, " << operand(instr.a) << "\n";
+  out << "  lea rdx, [rip + __heap + 8]\n  cmp rax, rdx\n  jbe "
+      << label("null") << "\n";
+  out << "  cmp rax, qword ptr [rip + __heap_top]\n  jae " << label("null")
+      << "\n";
+  if (instr.op == IR_GETX || instr.op == IR_SETX)
+    out << "  mov rcx, " << operand(instr.b) << "\n";
+  else
+    out << "  mov ecx, " << instr.imm << "\n";
+  out << "  cmp rcx, qword ptr [rax - 8]\n  jae " << label("index") << "\n";
+  out << "  lea rdx, [rax + rcx*8]\n";
+  out << "  cmp rdx, qword ptr [rip + __heap_top]\n  jae " << label("index")
+      << "\n";
+}
+
+void X86Emitter::emitCall(const IrInstr &instr) {
+  std::ostream &out = *this->out;
+  const Function &callee = module.bytecode->functions[instr.imm];
+  // Where each argument goes: an integer or SSE register, or the stack.
+  std::vector<std::pair<uint32_t, std::string>> inRegisters;
+  std::vector<uint32_t> onStack;
+  unsigned int ints = 0;
+  unsigned int floats = 0;
+  for (uint32_t i = 0; i < instr.argCount; i++) {
+    uint32_t value = function->args[instr.argStart + i];
+    if (callee.floatParams[i] && floats < floatArguments)
+      inRegisters.push_back({value, "xmm" + std::to_string(floats++)});
+    else if (!callee.floatParams[i] && ints < 6)
+      inRegisters.push_back({value, registerNames[intArguments[ints++]]});
+    else
+      onStack.push_back(value);
+  }
+  size_t pad = onStack.size() % 2 ? 8 : 0;
+  if (pad)
+    out << "  sub rsp, 8\n";
+  for (auto it = onStack.rbegin(); it != onStack.rend(); ++it)
+    out << "  push " << operand(*it) << "\n";
+  // Through the stack, since the argument registers may hold other
+  // arguments' values.
+  for (const auto &arg : inRegisters)
+    out << "  push " << operand(arg.first) << "\n";
+  for (auto it = inRegisters.rbegin(); it != inRegisters.rend(); ++it) {
+    if (it->second[0] == 'x')
+      out << "  pop rax\n  movq " << it->second << ", rax\n";
+    else
+      out << "  pop " << it->second << "\n";
+  }
+  out << "  call fn_" << Interner::current().text(callee.name) << "\n";
+  if (!onStack.empty() || pad)
+    out << "  add rsp, " << 8 * onStack.size() + pad << "\n";
+  if (callee.floatResult)
+    out << "  movq " << operand(instr.dst) << ", xmm0\n";
+  else
+    out << "  mov " << operand(instr.dst) << ", rax\n";
+}
+
+void X86Emitter::emitTerminator(const IrBlock &block, uint32_t b,
+                                bool fused) {
+  std::ostream &out = *this->out;
+  uint32_t next = b + 1;
+  switch (block.term.kind) {
+  case TERM_JUMP:
+    if (block.succs[0] != next)
+      out << "  jmp " << blockLabel(block.succs[0]) << "\n";
+    return;
+  case TERM_BRANCH: {
+    const char *taken = "ne";
+    const char *notTaken = "e";
+    if (fused) {
+      taken = condition(block.code.back().op, false);
+      notTaken = condition(block.code.back().op, true);
+    } else if (inRegister(block.term.cond)) {
+      out << "  test " << operand(block.term.cond) << ", "
+          << operand(block.term.cond) << "\n";
+    } else {
+      out << "  cmp " << operand(block.term.cond) << ", 0\n";
+    }
+    if (block.succs[1] == next) {
+      out << "  j" << taken << " " << blockLabel(block.succs[0]) << "\n";
+    } else if (block.succs[0] == next) {
+      out << "  j" << notTaken << " " << blockLabel(block.succs[1]) << "\n";
+    } else {
+      out << "  j" << taken << " " << blockLabel(block.succs[0]) << "\n";
+      out << "  jmp " << blockLabel(block.succs[1]) << "\n";
+    }
+    return;
+  }
+  default:
+    break;
+  }
+  if (block.term.value != IrInstr::NO_VALUE)
+    out << "  mov rax, " << operand(block.term.value) << "\n";
+  else
+    out << "  xor eax, eax\n";
+  // Objects allocated by this call die with it, as in the VM.
+  if (static_cast<int>(index) != module.bytecode->init) {
+    out << "  mov rcx, " << slotAddress(0) << "\n";
+    out << "  mov qword ptr [rip + __heap_top], rcx\n";
+  }
+  if (function->floatResult)
+    out << "  movq xmm0, rax\n";
+  if (savedRegisters.empty())
+    out << "  mov rsp, rbp\n";
+  else
+    out << "  lea rsp, [rbp - " << 8 * savedRegisters.size() << "]\n";
+  for (auto it = savedRegisters.rbegin(); it != savedRegisters.rend(); ++it)
+    out << "  pop " << registerNames[*it] << "\n";
+  out << "  pop rbp\n  ret\n";
+}
+
+void X86Emitter::emitStart() {
+  std::ostream &out = *this->out;
+  const Bytecode &bytecode = *module.bytecode;
+  out << "\n_start:\n";
+  out << "  lea rax, [rsp - " << STACK_RESERVE << "]\n";
+  out << "  mov qword ptr [rip + __stack_limit], rax\n";
+  out << "  lea rax, [rip + __heap + 8]\n";
+  out << "  mov qword ptr [rip + __heap_top], rax\n";
+  // String literals are copied to the heap first, as the VM does.
+  for (size_t i = 0; i < bytecode.strings.size(); i++) {
+    out << "  mov eax, " << bytecode.strings[i].text.size()
+        << "\n  call __rt_new\n";
+    out << "  mov qword ptr [rip + __string" << i << "], rax\n";
+    out << "  lea rsi, [rip + __string" << i << "_text]\n";
+    out << "  mov rdi, rax\n  mov ecx, " << bytecode.strings[i].text.size()
+        << "\n  rep movsq\n";
+  }
+  if (bytecode.init >= 0)
+    out << "  call __init\n";
+  const Function &main = bytecode.functions[bytecode.main];
+  out << "  call fn_" << Interner::current().text(main.name) << "\n";
+  if (main.floatResult)
+    out << "  movq rax, xmm0\n";
+  out << "  mov rbx, rax\n";
+  out << "  lea rsi, [rip + .Lrt_returned]\n  call __rt_puts\n";
+  if (main.floatResult)
+    out << "  movq xmm0, rbx\n  call __rt_print_float\n";
+  else
+    out << "  mov rax, rbx\n  call __rt_print_int\n";
+  out << "  lea rsi, [rip + .Lrt_newline]\n  call __rt_puts\n";
+  out << "  xor edi, edi\n  jmp __rt_exit\n";
+}
+
+void X86Emitter::emitData() {
+  std::ostream &out = *this->out;
+  const Bytecode &bytecode = *module.bytecode;
+  out << "\n  .section .rodata\n  .align 8\n";
+  for (size_t i = 0; i < bytecode.strings.size(); i++) {
+    out << "__string" << i << "_text:";
+    const std::string &text = bytecode.strings[i].text;
+    for (size_t c = 0; c < text.size(); c++)
+      out << (c % 16 ? ", " : "\n  .quad ")
+          << static_cast<int>(static_cast<unsigned char>(text[c]));
+    out << "\n";
+  }
+  out << "\n  .bss\n  .align 16\n";
+  out << "__stack_limit: .skip 8\n";
+  out << "__heap_top: .skip 8\n";
+  for (size_t i = 0; i < bytecode.strings.size(); i++)
+    out << "__string" << i << ": .skip 8\n";
+  out << "__globals: .skip " << 8 * std::max<size_t>(bytecode.globals, 1)
+      << "\n";
+  out << "__heap: .skip " << HEAP_BYTES << "\n__heap_end:\n";
+  out << "\n  .section .note.GNU-stack,\"\",@progbits\n";
+}
+
+void X86Emitter::emit(std::ostream &out) {
+  this->out = &out;
+  strings.clear();
+  for (size_t i = 0; i < module.bytecode->strings.size(); i++)
+    strings.emplace(module.bytecode->strings[i].constant, i);
+  out << "  .intel_syntax noprefix\n  .text\n  .globl _start\n";
+  emitStart();
+  out << runtime;
+  for (index = 0; index < module.functions.size(); index++) {
+    function = &module.functions[index];
+    emitFunction();
+  }
+  emitData();
+  this->out = nullptr;
+}
+
+bool assembleAndLink(const std::string &assembly, const std::string &output,
+                     std::string &error) {
+  std::string object = output + ".o";
+  std::string assemble =
+      "as --64 -o " + quoteShell(object) + " " + quoteShell(assembly);
+  if (std::system(assemble.c_str()) != 0) {
+    error = "the assembler failed";
+    return false;
+  }
+  std::string link = "ld -o " + quoteShell(output) + " " + quoteShell(object);
+  int status = std::system(link.c_str());
+  std::remove(object.c_str());
+  if (status != 0) {
+    error = "the linker failed";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,388 @@
+#include "XrefIndex.h"
+#include "CompileCache.h"
+#include "Interner.h"
+#include "helpers.h"
+#include "lexer.h"
+#include "parser.h"
+#include "Prelude.h"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char XREF_MAGIC[] = "CMPXREF";
+static const uint32_t XREF_VERSION = 1;
+
+static_assert(sizeof(XrefHeader) == 32 && sizeof(XrefFile) == 16 &&
+                  sizeof(XrefName) == 16 && sizeof(XrefPosting) == 16,
+              "the index sections must stay 16-byte aligned");
+
+const char *referenceKindName(ReferenceKind kind) {
+  switch (kind) {
+  case REF_FUNCTION:
+    return "function";
+  case REF_STRUCT:
+    return "struct";
+  case REF_VARIABLE:
+    return "variable";
+  case REF_PARAMETER:
+    return "parameter";
+  case REF_MEMBER:
+    return "member";
+  case REF_USE:
+    return "use";
+  case REF_CALL:
+    return "call";
+  case REF_TYPE:
+    return "type";
+  case REF_MEMBER_USE:
+    return "member use";
+  }
+  return "unknown";
+}
+
+XrefIndex::~XrefIndex() { this->close(); }
+
+bool XrefIndex::open(const std::string &path) {
+  this->close();
+#ifdef __unix__
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+  void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED)
+    return false;
+  this->data = static_cast<const char *>(mapped);
+  this->size = static_cast<size_t>(info.st_size);
+#else
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return false;
+  this->copy.assign(std::istreambuf_iterator<char>(file),
+                    std::istreambuf_iterator<char>());
+  this->data = this->copy.data();
+  this->size = this->copy.size();
+#endif
+  if (this->size < sizeof(XrefHeader)) {
+    this->close();
+    return false;
+  }
+  const XrefHeader *header = reinterpret_cast<const XrefHeader *>(this->data);
+  uint64_t expected = sizeof(XrefHeader) +
+                      (static_cast<uint64_t>(header->files) + header->names +
+                       header->postings) *
+                          16 +
+                      header->stringBytes;
+  if (std::memcmp(header->magic, XREF_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != XREF_VERSION || expected != this->size) {
+    this->close();
+    return false;
+  }
+  this->header = header;
+  this->files = reinterpret_cast<const XrefFile *>(header + 1);
+  this->names = reinterpret_cast<const XrefName *>(this->files + header->files);
+  this->postings =
+      reinterpret_cast<const XrefPosting *>(this->names + header->names);
+  this->strings =
+      reinterpret_cast<const char *>(this->postings + header->postings);
+  return true;
+}
+
+void XrefIndex::close() {
+#ifdef __unix__
+  if (this->data != nullptr && this->copy.empty())
+    munmap(const_cast<char *>(this->data), this->size);
+#endif
+  this->copy.clear();
+  this->data = nullptr;
+  this->size = 0;
+  this->header = nullptr;
+  this->files = nullptr;
+  this->names = nullptr;
+  this->postings = nullptr;
+  this->strings = nullptr;
+}
+
+std::string_view XrefIndex::text(uint32_t offset, uint32_t length) const {
+  if (static_cast<uint64_t>(offset) + length > this->header->stringBytes)
+    return std::string_view();
+  return std::string_view(this->strings + offset, length);
+}
+
+const XrefPosting *XrefIndex::lookup(std::string_view name,
+                                     size_t &count) const {
+  count = 0;
+  if (this->header == nullptr)
+    return nullptr;
+  size_t low = 0;
+  size_t high = this->header->names;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (this->nameText(mid) < name)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if (low == this->header->names || this->nameText(low) != name)
+    return nullptr;
+  return this->namePostings(low, count);
+}
+
+std::string_view XrefIndex::filePath(uint32_t file) const {
+  if (this->header == nullptr || file >= this->header->files)
+    return std::string_view();
+  return this->text(this->files[file].path, this->files[file].pathLength);
+}
+
+uint64_t XrefIndex::fileHash(uint32_t file) const {
+  if (this->header == nullptr || file >= this->header->files)
+    return 0;
+  return this->files[file].hash;
+}
+
+uint32_t XrefIndex::getFlags() const {
+  return this->header ? this->header->flags : 0;
+}
+
+size_t XrefIndex::fileCount() const {
+  return this->header ? this->header->files : 0;
+}
+
+size_t XrefIndex::nameCount() const {
+  return this->header ? this->header->names : 0;
+}
+
+size_t XrefIndex::postingCount() const {
+  return this->header ? this->header->postings : 0;
+}
+
+std::string_view XrefIndex::nameText(size_t name) const {
+  return this->text(this->names[name].text, this->names[name].length);
+}
+
+const XrefPosting *XrefIndex::namePostings(size_t name, size_t &count) const {
+  const XrefName &entry = this->names[name];
+  count = 0;
+  if (static_cast<uint64_t>(entry.first) + entry.count > this->header->postings)
+    return nullptr;
+  count = entry.count;
+  return this->postings + entry.first;
+}
+
+// A file on its own, without its includes: its references only depend on
+// its own tokens.
+static void parseReferences(std::string contents, uint32_t file,
+                            bool unicodeIdentifiers,
+                            std::unordered_map<std::string,
+                                               std::vector<XrefPosting>> &names) {
+  Lexer lexer(std::move(contents));
+  lexer.setUnicodeIdentifiers(unicodeIdentifiers);
+  lexer.setIncludeResolver(
+      [](const std::string &, std::string &) { return false; });
+  auto tokens = std::make_shared<std::vector<Token>>();
+  lexer.tokenize(*tokens);
+  std::vector<Reference> references;
+  BasicParser<NullSink> parser;
+  parser.setReferences(&references);
+  parser.setTokens(tokens);
+  parser.parse();
+  std::shared_ptr<const SourceMap> sources = lexer.getSources();
+  const Interner &interner = Interner::current();
+  for (const Reference &reference : references) {
+    XrefPosting posting;
+    posting.file = file;
+    sources->position(reference.file, reference.offset, posting.line,
+                      posting.column);
+    posting.kind = reference.kind;
+    names[std::string(interner.text(reference.name))].push_back(posting);
+  }
+}
+
+static void writeIndex(
+    const std::string &path, uint32_t flags,
+    const std::map<std::string, uint64_t> &hashes,
+    std::unordered_map<std::string, std::vector<XrefPosting>> &byName,
+    XrefStats &stats) {
+  std::vector<const std::string *> order;
+  order.reserve(byName.size());
+  for (const auto &name : byName)
+    order.push_back(&name.first);
+  std::sort(order.begin(), order.end(),
+            [](const std::string *a, const std::string *b) { return *a < *b; });
+
+  std::string strings;
+  std::vector<XrefFile> files;
+  for (const auto &file : hashes) {
+    files.push_back({file.second, static_cast<uint32_t>(strings.size()),
+                     static_cast<uint32_t>(file.first.size())});
+    strings += file.first;
+  }
+  std::vector<XrefName> names;
+  std::vector<XrefPosting> postings;
+  for (const std::string *name : order) {
+    std::vector<XrefPosting> &runs = byName[*name];
+    std::sort(runs.begin(), runs.end(),
+              [](const XrefPosting &a, const XrefPosting &b) {
+                if (a.file != b.file)
+                  return a.file < b.file;
+                if (a.line != b.line)
+                  return a.line < b.line;
+                if (a.column != b.column)
+                  return a.column < b.column;
+                return a.kind < b.kind;
+              });
+    names.push_back({static_cast<uint32_t>(strings.size()),
+                     static_cast<uint32_t>(name->size()),
+                     static_cast<uint32_t>(postings.size()),
+                     static_cast<uint32_t>(runs.size())});
+    strings += *name;
+    postings.insert(postings.end(), runs.begin(), runs.end());
+  }
+
+  XrefHeader header;
+  std::memcpy(header.magic, XREF_MAGIC, sizeof(header.magic));
+  header.version = XREF_VERSION;
+  header.files = static_cast<uint32_t>(files.size());
+  header.names = static_cast<uint32_t>(names.size());
+  header.postings = static_cast<uint32_t>(postings.size());
+  header.stringBytes = static_cast<uint32_t>(strings.size());
+  header.flags = flags;
+
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+      throw FileError(tmp);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(files.data()),
+              files.size() * sizeof(XrefFile));
+    out.write(reinterpret_cast<const char *>(names.data()),
+              names.size() * sizeof(XrefName));
+    out.write(reinterpret_cast<const char *>(postings.data()),
+              postings.size() * sizeof(XrefPosting));
+    out.write(strings.data(), strings.size());
+    if (!out.good())
+      throw FileError(tmp);
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, path, ec);
+  if (ec)
+    throw FileError(path);
+  stats.files = files.size();
+  stats.names = names.size();
+  stats.postings = postings.size();
+}
+
+XrefStats updateXrefIndex(const std::string &path,
+                          const std::vector<std::string> &entries,
+                          bool unicodeIdentifiers) {
+  XrefStats stats;
+  uint32_t flags = unicodeIdentifiers ? XREF_UNICODE_IDENTIFIERS : 0;
+
+  // Every file reached from the entries, by path, which is also the order
+  // of their IDs in the new index.
+  std::map<std::string, std::string> contents;
+  std::deque<std::string> queue(entries.begin(), entries.end());
+  while (!queue.empty()) {
+    std::string file = std::move(queue.front());
+    queue.pop_front();
+    if (contents.count(file))
+      continue;
+    std::string source;
+    try {
+      source = readInclude(file);
+    } catch (const FileError &) {
+      stats.missing++;
+      continue;
+    }
+    Lexer scanner(source);
+    scanner.setUnicodeIdentifiers(unicodeIdentifiers);
+    for (std::string &include : scanner.scanIncludes())
+      queue.push_back(std::move(include));
+    contents.emplace(std::move(file), std::move(source));
+  }
+
+  std::map<std::string, uint64_t> hashes;
+  for (const auto &file : contents)
+    hashes.emplace(file.first, CompileCache::hash(file.second));
+
+  // The old index's files that were not reached are carried over with the
+  // hash they were indexed at, unless they have been deleted since. The
+  // others were read again above, and are dropped if that failed.
+  XrefIndex old;
+  bool reuse = old.open(path) && old.getFlags() == flags;
+  for (uint32_t i = 0; reuse && i < old.fileCount(); i++) {
+    std::string file(old.filePath(i));
+    std::error_code ec;
+    if (!contents.count(file) &&
+        (findPrelude(file) != nullptr || std::filesystem::exists(file, ec)))
+      hashes.emplace(std::move(file), old.fileHash(i));
+  }
+
+  // The new IDs follow the order of the paths.
+  std::unordered_map<std::string_view, uint32_t> ids;
+  for (const auto &file : hashes)
+    ids.emplace(file.first, static_cast<uint32_t>(ids.size()));
+
+  // Old file IDs whose text is unchanged, mapped to their new IDs.
+  std::vector<int64_t> kept;
+  if (reuse) {
+    kept.assign(old.fileCount(), -1);
+    for (uint32_t i = 0; i < old.fileCount(); i++) {
+      std::string_view file = old.filePath(i);
+      auto found = hashes.find(std::string(file));
+      if (found != hashes.end() && found->second == old.fileHash(i))
+        kept[i] = ids[file];
+    }
+  }
+
+  std::unordered_map<std::string, std::vector<XrefPosting>> byName;
+  for (size_t i = 0; i < old.nameCount() && !kept.empty(); i++) {
+    size_t count;
+    const XrefPosting *postings = old.namePostings(i, count);
+    std::vector<XrefPosting> *runs = nullptr;
+    for (size_t j = 0; j < count; j++) {
+      if (postings[j].file >= kept.size() || kept[postings[j].file] < 0)
+        continue;
+      if (runs == nullptr)
+        runs = &byName[std::string(old.nameText(i))];
+      XrefPosting posting = postings[j];
+      posting.file = static_cast<uint32_t>(kept[posting.file]);
+      runs->push_back(posting);
+    }
+  }
+
+  std::vector<bool> reused(hashes.size(), false);
+  for (int64_t file : kept) {
+    if (file >= 0)
+      reused[file] = true;
+  }
+  for (auto &source : contents) {
+    uint32_t file = ids[source.first];
+    if (!reused[file]) {
+      parseReferences(std::move(source.second), file, unicodeIdentifiers,
+                      byName);
+      stats.parsed++;
+    }
+  }
+  old.close();
+
+  writeIndex(path, flags, hashes, byName, stats);
+  return stats;
+}
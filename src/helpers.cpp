@@ -1,15 +1,25 @@
 #include "helpers.h"
 #include <fstream>
-#include <sstream>
-#include <iostream>
+#include <iterator>
 
 std::string readFile(const std::string &fileName) {
     std::ifstream file(fileName);
-    if (!file.is_open()) {
-        std::cerr << "Error: Unable to open file \"" << fileName << "\"" << std::endl;
-        exit(EXIT_FAILURE);
+    if (!file.is_open())
+        throw FileError(fileName);
+    // Size the string up front and read straight into it, instead of going
+    // through a stringstream that grows and is then copied out.
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::string contents;
+    if (size < 0) {
+        file.clear();
+        contents.assign(std::istreambuf_iterator<char>(file),
+                        std::istreambuf_iterator<char>());
+    } else if (size > 0) {
+        contents.resize(static_cast<size_t>(size));
+        file.read(&contents[0], size);
+        contents.resize(static_cast<size_t>(file.gcount()));
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    return contents;
 }
@@ -1,28 +1,247 @@
-#include "Lexer.h"
+#include "lexer.h"
+#include "AllocStats.h"
+#include "CharClass.h"
+#include "ConstLexer.h"
+#include "ConstantPool.h"
+#include "Interner.h"
+#include "Prelude.h"
+#include "TokenRing.h"
+#include "Utf8.h"
 #include "helpers.h"
-#include <cctype>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <string_view>
 
 using namespace std;
 
-Lexer::Lexer(const string &sourceCode) : source(sourceCode), pos(0), line(1) {
-  keywords = {{"IfTrue", "Condition"},   {"Imw", "Integer"},
-              {"SIMw", "SInteger"},      {"Chj", "Character"},
-              {"Series", "String"},      {"IMwf", "Float"},
-              {"SIMwf", "SFloat"},       {"NOReturn", "Void"},
-              {"RepeatWhen", "Loop"},    {"Reiterate", "Loop"},
-              {"Turnback", "Return"},    {"OutLoop", "Break"},
-              {"Loli", "Struct"},        {"include", "Inclusion"},
-              {"int", "Type"},           {"Stop", "Break"},
-              {"Otherwise", "Condition"}};
+Lexer::Lexer(string sourceCode)
+    : Lexer(std::move(sourceCode), std::make_shared<SourceMap>()) {}
+
+Lexer::Lexer(string sourceCode, shared_ptr<SourceMap> sources)
+    : Lexer(std::move(sourceCode), std::move(sources), UINT16_MAX) {}
+
+Lexer::Lexer(string sourceCode, shared_ptr<SourceMap> sources, uint16_t file)
+    : source(std::move(sourceCode)), pos(0), sources(std::move(sources)) {
+  if (file == UINT16_MAX) {
+    this->file = this->sources->add(source);
+  } else {
+    this->file = file;
+    this->sources->replace(file, source);
+  }
+  keywordTypes.assign(SYM_KEYWORD_COUNT, TokenType::INVALID);
+  for (const Keyword &keyword : KEYWORDS)
+    keywordTypes[Interner::current().intern(keyword.text)] = keyword.type;
+}
+
+void Lexer::setStream(TokenRing *ring) { stream = ring; }
+
+void Lexer::setMaxErrors(size_t limit) { max_errors = limit; }
+
+void Lexer::setUnicodeIdentifiers(bool enabled) {
+  unicode_identifiers = enabled;
+}
+
+void Lexer::setIncludeResolver(IncludeResolver resolver) {
+  this->resolver = std::move(resolver);
+}
+
+size_t Lexer::getErrorCount() const { return error_count; }
+
+const string &Lexer::getSource() const { return source; }
+
+shared_ptr<const SourceMap> Lexer::getSources() const { return sources; }
+
+uint16_t Lexer::getFile() const { return file; }
+
+void Lexer::setFileName(const string &name) { sources->setName(file, name); }
+
+void Lexer::emit(vector<Token> &tokens, Token token) {
+  if (token.error)
+    error_count++;
+  tokens.push_back(std::move(token));
+}
+
+void Lexer::emitTrivia(const vector<Token> &tokens, Token token) {
+  if (token.error)
+    error_count++;
+  trivia.push_back(
+      {static_cast<uint32_t>(published + tokens.size()), std::move(token)});
+}
+
+// The sources in tests/ average three and a half to four bytes per token once
+// brackets and operators are counted, so a vector reserved to this is usually
+// allocated once.
+size_t Lexer::expectedTokens() const { return source.size() / 3 + 16; }
+
+// Every "/^" and "/@" in the source, including those inside strings and
+// comments, so this is an upper bound found with one memchr pass.
+size_t Lexer::countComments() const {
+  size_t count = 0;
+  const char *at = source.data();
+  const char *end = at + source.size();
+  while ((at = static_cast<const char *>(std::memchr(at, '/', end - at))) &&
+         ++at < end) {
+    if (*at == '^' || *at == '@')
+      count++;
+  }
+  return count;
+}
+
+vector<Trivia> Lexer::releaseTrivia() { return std::move(trivia); }
+
+bool Lexer::publish(vector<Token> &tokens) {
+  size_t count = tokens.size();
+  if (!stream->push(std::move(tokens)))
+    return false;
+  published += count;
+  tokens = vector<Token>();
+  tokens.reserve(STREAM_BATCH);
+  return true;
 }
 
 vector<Token> Lexer::tokenize() {
   vector<Token> tokens;
+  tokenize(tokens);
+  return tokens;
+}
+
+void Lexer::tokenize(vector<Token> &tokens) {
+  tokens.clear();
+  trivia.clear();
+  tokens.reserve(stream ? STREAM_BATCH : expectedTokens());
+  // A comment is at most three trivia entries.
+  trivia.reserve(3 * countComments());
+  // A file that includes itself is caught at its own directive, when it is
+  // named the way the directive names it.
+  unordered_set<string> active;
+  string self = sources->name(file);
+  if (!self.empty())
+    active.insert(std::move(self));
+  if (!lexFile(tokens, active, 0))
+    return;
+
+  Token eofToken;
+  eofToken.offset = static_cast<uint32_t>(pos);
+  eofToken.file = file;
+  eofToken.text = "";
+  eofToken.type = TokenType::EOF_TOKEN;
+  eofToken.error = false;
+  tokens.push_back(eofToken);
+
+  if (stream)
+    publish(tokens);
+}
+
+void Lexer::tokenize(vector<Token> &tokens, vector<Trivia> &comments) {
+  trivia.swap(comments);
+  tokenize(tokens);
+  trivia.swap(comments);
+}
+
+// Included files come first, the last include first, and then this file's
+// own tokens. The included files are found up front and lexed straight into
+// `tokens`, so a chain of nested includes is never copied level by level.
+// `active` holds the includes being lexed, to catch cycles.
+bool Lexer::lexFile(vector<Token> &tokens, unordered_set<string> &active,
+                    unsigned int depth) {
+  vector<string> includes = scanIncludes();
+  for (auto it = includes.rbegin(); it != includes.rend(); ++it) {
+    // Reported on the directive below.
+    if (depth >= MAX_INCLUDE_DEPTH || active.count(*it))
+      continue;
+    if (sources->full()) {
+      missing.insert(*it);
+      continue;
+    }
+    if (const Prelude *prelude = findPrelude(*it)) {
+      if (!lexPrelude(*prelude, tokens))
+        return false;
+      continue;
+    }
+    PhaseScope phase(PHASE_INCLUDE);
+    string contents;
+    if (!resolver)
+      contents = readFile(*it);
+    else if (!resolver(*it, contents)) {
+      missing.insert(*it);
+      continue;
+    }
+    Lexer includedLexer(std::move(contents), sources);
+    includedLexer.setFileName(*it);
+    includedLexer.setMaxErrors(max_errors);
+    includedLexer.setUnicodeIdentifiers(unicode_identifiers);
+    includedLexer.setIncludeResolver(resolver);
+    includedLexer.stream = stream;
+    includedLexer.published = published;
+    active.insert(*it);
+    bool lexed = includedLexer.lexFile(tokens, active, depth + 1);
+    active.erase(*it);
+    error_count += includedLexer.getErrorCount();
+    published = includedLexer.published;
+    trivia.insert(trivia.end(),
+                  std::make_move_iterator(includedLexer.trivia.begin()),
+                  std::make_move_iterator(includedLexer.trivia.end()));
+    if (!lexed)
+      return false;
+  }
+  return lexSource(tokens, active, depth);
+}
+
+// The tokens were lexed when the compiler was built; only the parts that
+// need the interner and the constant pool are filled in here.
+bool Lexer::lexPrelude(const Prelude &prelude, vector<Token> &tokens) {
+  uint16_t id = sources->add(string(prelude.source));
+  sources->setName(id, string(prelude.path));
+  for (size_t i = 0; i < prelude.tokenCount; i++) {
+    if (stream && tokens.size() >= STREAM_BATCH && !publish(tokens))
+      return false;
+    const ConstToken &built = prelude.tokens[i];
+    Token token(built.offset,
+                string(prelude.source.substr(built.offset, built.length)),
+                built.type, built.error);
+    token.file = id;
+    if (ConstLexer::isTrivia(token.type)) {
+      emitTrivia(tokens, std::move(token));
+      continue;
+    }
+    // Identifiers and keywords are the tokens that start like one.
+    if (isIdentStart(token.text[0]))
+      token.symbol = Interner::current().intern(token.text);
+    if (token.type == TokenType::CONSTANT && !token.error) {
+      token.constant =
+          decodeNumber(token.text, token.text.find('.') != string::npos);
+      token.error = token.constant == 0;
+    }
+    emit(tokens, std::move(token));
+  }
+  return true;
+}
+
+vector<Token> Lexer::tokenizeSource() {
+  vector<Token> tokens;
+  trivia.clear();
+  tokens.reserve(expectedTokens());
+  unordered_set<string> active;
+  lexSource(tokens, active, 0);
+  return tokens;
+}
+
+bool Lexer::lexSource(vector<Token> &tokens,
+                      const unordered_set<string> &active,
+                      unsigned int depth) {
+  // Almost every file is valid throughout, and then strings and comments
+  // need no further checks.
+  utf8_valid = pos + validUtf8Prefix(source.data() + pos, source.size() - pos);
   while (pos < source.size()) {
+    if (max_errors != 0 && error_count >= max_errors)
+      break;
+    if (stream && tokens.size() >= STREAM_BATCH && !publish(tokens))
+      return false;
     skipWhitespace();
     if (pos >= source.size())
       break;
@@ -30,60 +249,117 @@ vector<Token> Lexer::tokenize() {
     char current = peek();
 
     if (current == '/' && (peek(1) == '@' || peek(1) == '^')) {
-      vector<Token> commentTokens = lexComment();
-      tokens.insert(tokens.end(), commentTokens.begin(), commentTokens.end());
+      lexComment(tokens);
       continue;
     } else if (current == '"') {
-      tokens.push_back(lexString());
+      emit(tokens, lexString());
       continue;
     } else if (current == '\'') {
-      tokens.push_back(lexChar());
+      emit(tokens, lexChar());
       continue;
-    } else if (isalpha(current) || current == '_') {
+    } else if (identLength(pos) != 0) {
       Token keywordToken = lexIdentifierOrKeyword();
       if (keywordToken.type == TokenType::INCLUSION) {
         skipWhitespace();
         if (peek() == '"') {
           Token fileToken = lexString();
-          string includedFile = fileToken.text.substr(3, fileToken.text.size() - 4);
-
-          string includedCode = readFile(includedFile);
-          Lexer includedLexer(includedCode);
-          vector<Token> includedTokens = includedLexer.tokenize();
-          includedTokens.pop_back();
-          tokens.insert(tokens.begin(), includedTokens.begin(),
-                        includedTokens.end());
-
-          // Optional: log the include itself
-          tokens.push_back(keywordToken);
-          tokens.push_back(fileToken);
+          // A file that includes itself, directly or not, too deep a chain
+          // of includes, one the resolver had no file for, or one past the
+          // source map's limit was skipped above.
+          if (fileToken.type == TokenType::STRING_LITERAL &&
+              (depth >= MAX_INCLUDE_DEPTH ||
+               active.count(includePath(fileToken.text)) ||
+               missing.count(includePath(fileToken.text))))
+            fileToken.error = true;
+          emit(tokens, std::move(keywordToken));
+          emit(tokens, std::move(fileToken));
         } else {
           keywordToken.error = true;
           keywordToken.type = INVALID_INCLUSION;
-          tokens.push_back(keywordToken);
+          emit(tokens, std::move(keywordToken));
         }
       } else {
-        tokens.push_back(keywordToken);
+        emit(tokens, std::move(keywordToken));
       }
       continue;
-    } else if (isdigit(current) || (current == '-' && isdigit(peek(1))) ||
-               (current == '+' && isdigit(peek(1)))) {
-      tokens.push_back(lexNumber());
+    } else if (isDigitChar(current) ||
+               ((current == '-' || current == '+') && isDigitChar(peek(1)))) {
+      emit(tokens, lexNumber());
+      continue;
+    } else if (!isAsciiChar(current)) {
+      emit(tokens, lexNonAscii());
       continue;
     } else {
-      tokens.push_back(lexOperatorOrPunctuation());
+      emit(tokens, lexOperatorOrPunctuation());
       continue;
     }
   }
+  return true;
+}
 
-  Token eofToken;
-  eofToken.line = line;
-  eofToken.text = "";
-  eofToken.type = TokenType::EOF_TOKEN;
-  eofToken.error = false;
-  tokens.push_back(eofToken);
+string Lexer::includePath(const string &literal) {
+  if (literal.size() < 4)
+    return string();
+  return literal.substr(3, literal.size() - 4);
+}
 
-  return tokens;
+// Finds the include directives of this file without building tokens. It
+// follows the same skipping rules as tokenize() so that a quoted or commented
+// out "include" is not picked up.
+vector<string> Lexer::scanIncludes() {
+  vector<string> includes;
+  size_t i = pos;
+  const size_t n = source.size();
+  while (i < n) {
+    char c = source[i];
+    char next = i + 1 < n ? source[i + 1] : '\0';
+    if (isSpaceChar(c)) {
+      i++;
+    } else if (c == '/' && next == '@') {
+      size_t close = source.find("@/", i + 2);
+      i = close == string::npos ? n : close + 2;
+    } else if (c == '/' && next == '^') {
+      while (i < n && source[i] != '\n')
+        i++;
+    } else if (c == '"') {
+      i++;
+      while (i < n && source[i] != '"' && source[i] != '\n')
+        i++;
+      if (i < n && source[i] == '"')
+        i++;
+    } else if (c == '\'') {
+      i++;
+      if (i < n && source[i] != '\'')
+        i++;
+      if (i < n && source[i] == '\'')
+        i++;
+    } else if (identLength(i) != 0) {
+      size_t start = i;
+      while (i < n && (isDigitChar(source[i]) || identLength(i) != 0))
+        i += std::max<size_t>(identLength(i), 1);
+      if (source.compare(start, i - start, "include") != 0)
+        continue;
+      while (i < n && isSpaceChar(source[i]))
+        i++;
+      if (i < n && source[i] == '"') {
+        size_t open = i++;
+        while (i < n && source[i] != '"' && source[i] != '\n')
+          i++;
+        if (i < n && source[i] == '"')
+          includes.push_back(includePath(source.substr(open, ++i - open)));
+      }
+    } else if (isDigitChar(c) ||
+               ((c == '-' || c == '+') && isDigitChar(next))) {
+      i++;
+      while (i < n && (isDigitChar(source[i]) || source[i] == '.'))
+        i++;
+      while (i < n && (isDigitChar(source[i]) || identLength(i) != 0))
+        i += std::max<size_t>(identLength(i), 1);
+    } else {
+      i++;
+    }
+  }
+  return includes;
 }
 
 char Lexer::peek(int n) {
@@ -92,75 +368,87 @@ char Lexer::peek(int n) {
   return source[pos + n];
 }
 
-char Lexer::get() {
-  char c = source[pos++];
-  if (c == '\n')
-    line++;
-  return c;
-}
+char Lexer::get() { return source[pos++]; }
 
 void Lexer::skipWhitespace() {
-  while (pos < source.size() && isspace(source[pos])) {
-    if (source[pos] == '\n')
-      line++;
+  while (pos < source.size() && isSpaceChar(source[pos]))
     pos++;
-  }
 }
 
-TokenType Lexer::TokenTypeFromString(const string &typeStr) {
-  if (typeStr == "Condition")
-    return TokenType::CONDITION;
-  if (typeStr == "Integer")
-    return TokenType::INTEGER;
-  if (typeStr == "SInteger")
-    return TokenType::SINTEGER;
-  if (typeStr == "Character")
-    return TokenType::CHARACTER;
-  if (typeStr == "String")
-    return TokenType::STRING;
-  if (typeStr == "Float")
-    return TokenType::FLOAT;
-  if (typeStr == "SFloat")
-    return TokenType::SFLOAT;
-  if (typeStr == "Void")
-    return TokenType::VOID;
-  if (typeStr == "Loop")
-    return TokenType::LOOP;
-  if (typeStr == "Return")
-    return TokenType::RETURN;
-  if (typeStr == "Break")
-    return TokenType::BREAK;
-  if (typeStr == "Struct")
-    return TokenType::STRUCT;
-  if (typeStr == "Inclusion")
-    return TokenType::INCLUSION;
-  if (typeStr == "Type")
-    return TokenType::INTEGER;
-  return TokenType::INVALID;
+// Bytes of the identifier character at `at`: one for ASCII letters and '_',
+// a whole UTF-8 sequence when Unicode identifiers are on, 0 otherwise.
+// Digits are left to the callers, since they cannot start an identifier.
+size_t Lexer::identLength(size_t at) const {
+  if (at >= source.size())
+    return 0;
+  char c = source[at];
+  if (isIdentStart(c))
+    return 1;
+  if (!unicode_identifiers || isAsciiChar(c))
+    return 0;
+  return utf8SequenceLength(source.data() + at, source.size() - at);
+}
+
+bool Lexer::validText(size_t start, size_t end) const {
+  if (end <= utf8_valid)
+    return true;
+  start = std::max(start, utf8_valid);
+  return validUtf8Prefix(source.data() + start, end - start) == end - start;
+}
+
+// A run of bytes from 0x80 up outside strings and comments is one error
+// token, however long it is: UNKNOWN if it is well-formed UTF-8, and
+// INVALID_ENCODING if it is not.
+Token Lexer::lexNonAscii() {
+  Token token;
+  token.offset = static_cast<uint32_t>(pos);
+  token.file = file;
+  token.error = true;
+  size_t start = pos;
+  bool valid = true;
+  while (pos < source.size() && !isAsciiChar(source[pos]) &&
+         identLength(pos) == 0) {
+    size_t length =
+        utf8SequenceLength(source.data() + pos, source.size() - pos);
+    valid = valid && length != 0;
+    pos += std::max<size_t>(length, 1);
+  }
+  token.type = valid ? TokenType::UNKNOWN : TokenType::INVALID_ENCODING;
+  token.text.assign(source, start, pos - start);
+  return token;
 }
 
 Token Lexer::lexIdentifierOrKeyword() {
   Token token;
-  token.line = line;
+  token.offset = static_cast<uint32_t>(pos);
+  token.file = file;
   token.error = false;
-  string result;
+  size_t start = pos;
 
-  while (pos < source.size() && (isalnum(peek()) || peek() == '_')) {
-    result.push_back(get());
+  while (pos < source.size()) {
+    if (isDigitChar(source[pos]))
+      pos++;
+    else if (size_t length = identLength(pos))
+      pos += length;
+    else
+      break;
   }
 
-  if (keywords.find(result) != keywords.end()) {
-    token.type = TokenTypeFromString(keywords[result]);
+  string_view lexeme(source.data() + start, pos - start);
+  token.symbol = Interner::current().intern(lexeme);
+  if (token.symbol < keywordTypes.size()) {
+    token.type = keywordTypes[token.symbol];
   } else {
     token.type = TokenType::IDENTIFIER;
   }
-  token.text = result;
+  token.text.assign(lexeme);
   return token;
 }
 
 Token Lexer::lexNumber() {
   Token token;
-  token.line = line;
+  token.offset = static_cast<uint32_t>(pos);
+  token.file = file;
   token.error = false;
   string numberStr;
   bool seenDot = false;
@@ -169,7 +457,7 @@ Token Lexer::lexNumber() {
     numberStr.push_back(get());
   }
 
-  while (pos < source.size() && (isdigit(peek()) || peek() == '.')) {
+  while (pos < source.size() && (isDigitChar(peek()) || peek() == '.')) {
     char c = peek();
     if (c == '.') {
       if (seenDot) {
@@ -180,47 +468,83 @@ Token Lexer::lexNumber() {
     numberStr.push_back(get());
   }
 
-  if (pos < source.size() && (isalpha(peek()) || peek() == '_')) {
+  if (identLength(pos) != 0) {
     token.error = true;
-    while (pos < source.size() && (isalnum(peek()) || peek() == '_')) {
+    while (pos < source.size() &&
+           (isDigitChar(peek()) || identLength(pos) != 0)) {
       numberStr.push_back(get());
     }
     token.type = TokenType::INVALID_IDENTIFIER;
   } else {
-    // token.type = seenDot ? TokenType::FLOAT : TokenType::INTEGER;
     token.type = TokenType::CONSTANT;
+    if (!token.error) {
+      token.constant = decodeNumber(numberStr, seenDot);
+      // Out of range for its type.
+      token.error = token.constant == 0;
+    }
   }
 
   token.text = numberStr;
   return token;
 }
 
+// Decodes a literal once, so nothing downstream parses the text again.
+// Returns its pool ID, or 0 if the value does not fit an Imw or IMwf.
+uint32_t Lexer::decodeNumber(const string &text, bool isFloat) {
+  const char *first = text.data();
+  const char *last = first + text.size();
+  // from_chars takes a minus sign but not a plus.
+  if (*first == '+')
+    first++;
+  if (isFloat) {
+    double value;
+    std::from_chars_result result =
+        std::from_chars(first, last, value, std::chars_format::fixed);
+    if (result.ec != std::errc() || result.ptr != last)
+      return 0;
+    return ConstantPool::current().addFloat(value);
+  }
+  int64_t value;
+  std::from_chars_result result = std::from_chars(first, last, value);
+  if (result.ec != std::errc() || result.ptr != last)
+    return 0;
+  return ConstantPool::current().addInt(value);
+}
+
 Token Lexer::lexString() {
   Token token;
-  token.line = line;
+  token.offset = static_cast<uint32_t>(pos);
+  token.file = file;
   token.error = false;
-  string str = "\"";
+  size_t start = pos;
   get();
 
-  while (pos < source.size() && peek() != '"') {
-    str.push_back(get());
+  // An unterminated literal ends with its line rather than taking the rest
+  // of the file with it.
+  while (pos < source.size() && peek() != '"' && peek() != '\n') {
+    get();
   }
 
   if (peek() == '"') {
-    str.push_back(get());
+    get();
     token.type = TokenType::STRING_LITERAL;
   } else {
     token.type = TokenType::UNTERMINATED_STRING;
     token.error = true;
   }
+  // UTF-8 is fine in a string, but a malformed sequence makes the whole
+  // literal one error.
+  if (!validText(start, pos))
+    token.error = true;
 
-  token.text = str;
+  token.text.assign(source, start, pos - start);
   return token;
 }
 
 Token Lexer::lexChar() {
   Token token;
-  token.line = line;
+  token.offset = static_cast<uint32_t>(pos);
+  token.file = file;
   token.error = false;
   string str = "'";
   get();
@@ -243,7 +567,8 @@ Token Lexer::lexChar() {
 
 Token Lexer::lexOperatorOrPunctuation() {
   Token token;
-  token.line = line;
+  token.offset = static_cast<uint32_t>(pos);
+  token.file = file;
   token.error = false;
   char current = get();
   string op(1, current);
@@ -289,27 +614,37 @@ Token Lexer::lexOperatorOrPunctuation() {
       op += get();
       token.type = TokenType::ACCESS_OP;
     } else
-      token.type = TokenType::ADDOP;
+      token.type = TokenType::MINUS;
     break;
   case '+':
-    token.type = TokenType::ADDOP;
+    token.type = TokenType::PLUS;
     break;
   case '*':
-    token.type = TokenType::MULOP;
+    token.type = TokenType::STAR;
     break;
   case '/':
-    token.type = TokenType::MULOP;
+    token.type = TokenType::SLASH;
     break;
   case '~':
     token.type = TokenType::LOGIC_OP;
     break;
   case '(':
+    token.type = TokenType::LEFT_PAREN;
+    break;
   case ')':
+    token.type = TokenType::RIGHT_PAREN;
+    break;
   case '{':
+    token.type = TokenType::LEFT_BRACE;
+    break;
   case '}':
+    token.type = TokenType::RIGHT_BRACE;
+    break;
   case '[':
+    token.type = TokenType::LEFT_BRACKET;
+    break;
   case ']':
-    token.type = TokenType::BRACE;
+    token.type = TokenType::RIGHT_BRACKET;
     break;
   case ';':
     token.type = TokenType::SEMICOLON;
@@ -327,10 +662,10 @@ Token Lexer::lexOperatorOrPunctuation() {
   return token;
 }
 
-vector<Token> Lexer::lexComment() {
-  vector<Token> commentTokens;
+void Lexer::lexComment(const vector<Token> &tokens) {
   Token tokenStart;
-  tokenStart.line = line;
+  tokenStart.offset = static_cast<uint32_t>(pos);
+  tokenStart.file = file;
   tokenStart.error = false;
 
   char second = peek(1);
@@ -339,20 +674,24 @@ vector<Token> Lexer::lexComment() {
     tokenStart.type = TokenType::COMMENT_START;
     get();
     get();
-    commentTokens.push_back(tokenStart);
+    emitTrivia(tokens, std::move(tokenStart));
     Token tokenContent;
-    tokenContent.line = line;
+    tokenContent.offset = static_cast<uint32_t>(pos);
+    tokenContent.file = file;
     tokenContent.error = false;
-    string content;
-    while (pos < source.size() && !(peek() == '@' && peek(1) == '/')) {
-      content.push_back(get());
-    }
-    tokenContent.text = content;
+    size_t start = pos;
+    // An unterminated comment runs to the end of the file and is one
+    // error. Nothing is lexed after it, so the search is done at most once
+    // per file that fails it.
+    pos = std::min(source.find("@/", pos), source.size());
+    tokenContent.text.assign(source, start, pos - start);
     tokenContent.type = TokenType::COMMENT_CONTENT;
-    commentTokens.push_back(tokenContent);
+    tokenContent.error = !validText(start, pos);
+    emitTrivia(tokens, std::move(tokenContent));
 
     Token tokenEnd;
-    tokenEnd.line = line;
+    tokenEnd.offset = static_cast<uint32_t>(pos);
+    tokenEnd.file = file;
     tokenEnd.error = false;
     if (peek() == '@' && peek(1) == '/') {
       tokenEnd.text = "@/";
@@ -360,28 +699,29 @@ vector<Token> Lexer::lexComment() {
       get();
       get();
     } else {
+      // Reported where the comment was opened, not at the end of the file.
+      tokenEnd.offset = static_cast<uint32_t>(start - 2);
       tokenEnd.text = "";
       tokenEnd.type = TokenType::INVALID_COMMENT;
       tokenEnd.error = true;
     }
-    commentTokens.push_back(tokenEnd);
+    emitTrivia(tokens, std::move(tokenEnd));
   } else if (second == '^') {
     tokenStart.text = "/^";
     tokenStart.type = TokenType::SINGLE_LINE_COMMENT_START;
     get();
     get();
-    commentTokens.push_back(tokenStart);
+    emitTrivia(tokens, std::move(tokenStart));
 
     Token tokenContent;
-    tokenContent.line = line;
+    tokenContent.offset = static_cast<uint32_t>(pos);
+    tokenContent.file = file;
     tokenContent.error = false;
-    string content;
-    while (pos < source.size() && peek() != '\n') {
-      content.push_back(get());
-    }
-    tokenContent.text = content;
+    size_t start = pos;
+    pos = std::min(source.find('\n', pos), source.size());
+    tokenContent.text.assign(source, start, pos - start);
     tokenContent.type = TokenType::SINGLE_LINE_COMMENT_CONTENT;
-    commentTokens.push_back(tokenContent);
+    tokenContent.error = !validText(start, pos);
+    emitTrivia(tokens, std::move(tokenContent));
   }
-  return commentTokens;
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "helpers.h"
 #include "Token.h"
 
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -11,16 +12,169 @@
 #include <unordered_map>
 #include <cctype>
 #include <iomanip>
+#include "AllocStats.h"
 #include "Compiler.h"
+#include "Prelude.h"
+#include "Project.h"
+#include "Watcher.h"
+#include "XrefIndex.h"
+#include <thread>
 
 using namespace std;
 
-int main() {
-    string fileName;
-    cout << "Enter the file name: ";
-    getline(cin, fileName);
-
-    Compiler myCompiler(fileName);
-    myCompiler.compile();
+// Updates the index from the given files, if any, then answers each lookup
+// from the mapped index.
+static int crossReference(const string &indexPath,
+                          const vector<string> &fileNames,
+                          const vector<string> &lookups,
+                          bool unicodeIdentifiers) {
+    if (fileNames.empty() && lookups.empty()) {
+        cerr << "Error: --xref needs files to index or a --lookup" << endl;
+        return EXIT_FAILURE;
+    }
+    if (!fileNames.empty()) {
+        XrefStats stats =
+            updateXrefIndex(indexPath, fileNames, unicodeIdentifiers);
+        cout << "Indexed " << stats.files << " files (" << stats.parsed
+             << " parsed): " << stats.names << " names, " << stats.postings
+             << " references\n";
+        if (stats.missing != 0)
+            cout << stats.missing << " files could not be read\n";
+    }
+    if (lookups.empty())
+        return 0;
+    XrefIndex index;
+    if (!index.open(indexPath)) {
+        cerr << "Error: \"" << indexPath << "\" is not a cross-reference index"
+             << endl;
+        return EXIT_FAILURE;
+    }
+    for (const string &name : lookups) {
+        size_t count;
+        const XrefPosting *postings = index.lookup(name, count);
+        cout << name << ": " << count
+             << (count == 1 ? " reference\n" : " references\n");
+        for (size_t i = 0; i < count; i++) {
+            cout << "  " << index.filePath(postings[i].file) << ":"
+                 << postings[i].line << ":" << postings[i].column << " "
+                 << referenceKindName(
+                        static_cast<ReferenceKind>(postings[i].kind))
+                 << "\n";
+        }
+    }
     return 0;
 }
+
+static int compileAll(int argc, char *argv[]) {
+    vector<string> fileNames;
+    CompilerOptions options;
+    bool showStats = false;
+    bool project = false;
+    bool watch = false;
+    unsigned int jobs = 0;
+    string xrefPath;
+    vector<string> lookups;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--pipeline") {
+            options.pipelined = true;
+        } else if (arg == "--run") {
+            options.run = true;
+        } else if (arg == "--dump-ir") {
+            options.dumpIr = true;
+        } else if (arg == "--time-passes") {
+            options.timePasses = true;
+        } else if (arg == "--layout") {
+            options.layout = true;
+        } else if (arg == "--reorder-fields") {
+            options.reorderFields = true;
+        } else if (arg == "--native" && i + 1 < argc) {
+            options.nativeOutput = argv[++i];
+        } else if (arg == "--project") {
+            project = true;
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--check-prelude") {
+            return checkPreludes(cout) ? 0 : 1;
+        } else if (arg == "--xref" && i + 1 < argc) {
+            xrefPath = argv[++i];
+        } else if (arg == "--lookup" && i + 1 < argc) {
+            lookups.push_back(argv[++i]);
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = static_cast<unsigned int>(atoi(argv[++i]));
+        } else if (arg == "--no-optimize") {
+            options.optimize = false;
+        } else if (arg == "--stats") {
+            showStats = true;
+        } else if (arg == "--max-errors" && i + 1 < argc) {
+            options.maxErrors = static_cast<unsigned int>(atoi(argv[++i]));
+        } else if (arg == "--unicode-identifiers") {
+            options.unicodeIdentifiers = true;
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            options.cacheDir = argv[++i];
+        } else if (arg == "--report" && i + 1 < argc) {
+            string format = argv[++i];
+            if (format == "ndjson")
+                options.report = FORMAT_NDJSON;
+            else if (format == "none")
+                options.report = FORMAT_NONE;
+            else
+                options.report = FORMAT_TEXT;
+        } else if (arg == "--cache-max-bytes" && i + 1 < argc) {
+            options.cacheMaxBytes = strtoull(argv[++i], nullptr, 10);
+        } else {
+            fileNames.push_back(arg);
+        }
+    }
+    if (!xrefPath.empty())
+        return crossReference(xrefPath, fileNames, lookups,
+                              options.unicodeIdentifiers);
+    if (showStats)
+        enableAllocationTracking();
+    if (fileNames.empty()) {
+        string fileName;
+        cout << "Enter the file name: ";
+        getline(cin, fileName);
+        fileNames.push_back(fileName);
+    }
+
+    // In batch mode every file gets its own results file; the interner is
+    // shared by all of them.
+    CompileStats stats;
+    bool passed = true;
+    if (project || watch) {
+        // Shared includes are lexed once and the entries compiled in
+        // parallel; see Project.h.
+        unsigned int threads = jobs != 0 ? jobs : thread::hardware_concurrency();
+        Project build(fileNames, options);
+        passed = build.build(threads);
+        build.printSchedule(cout);
+        build.collectStats(stats);
+        if (watch)
+            passed = Watcher(build, threads).run() && passed;
+    } else {
+        for (const string &fileName : fileNames) {
+            string resultsName = fileNames.size() == 1
+                                     ? "result.txt"
+                                     : fileName + ".result.txt";
+            Compiler myCompiler(fileName, resultsName, options);
+            passed = myCompiler.compile() && passed;
+            myCompiler.collectStats(stats);
+        }
+    }
+    if (showStats)
+        printStats(stats);
+    return passed ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        return compileAll(argc, argv);
+    } catch (const FileError &error) {
+        cerr << "Error: " << error.what() << endl;
+        return EXIT_FAILURE;
+    } catch (const length_error &error) {
+        cerr << "Error: " << error.what() << endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -1,636 +1,1069 @@
 #include "parser.h"
+#include "CharClass.h"
+#include "Interner.h"
+#include "TokenRing.h"
 #include <algorithm>
 #include <iostream>
 
-Parser::Parser()
-    : token_index(0), line_count(1), slow_count(1), error_count(0),
-      in_function_scope(false) {}
+template <typename Sink>
+BasicParser<Sink>::BasicParser(Sink sink)
+    : sink(std::move(sink)), stream(nullptr), current_token(&eof_token),
+      token_index(0), error_count(0), in_function_scope(false),
+      semantic_error_count(0), checked_index(0), current_struct(0),
+      member_owner(0), references(nullptr), referenced_member(0),
+      max_errors(0), last_error_index(-1), panic_mode(false), depth(0),
+      aborted(false), main_file(0), eof_token(0, "", EOF_TOKEN, false),
+      speculating(false) {}
 
-void Parser::setTokens(const std::vector<Token> &input_tokens) {
-  tokens = input_tokens;
+template <typename Sink>
+void BasicParser<Sink>::setSources(std::shared_ptr<const SourceMap> sources) {
+  this->sources = std::move(sources);
+}
+
+template <typename Sink>
+void BasicParser<Sink>::report(ReportKind kind, uint16_t file, uint32_t offset,
+                    const std::string &message) {
+  if (!Sink::enabled)
+    return;
+  uint32_t line = 0;
+  uint32_t column = 0;
+  std::string path;
+  if (sources) {
+    sources->position(file, offset, line, column);
+    if (file != main_file)
+      path = sources->name(file);
+  }
+  if (speculating) {
+    held.push_back({kind, file, std::move(path), line, column, message});
+    return;
+  }
+  sink.report(kind, file, path, line, column, message);
+}
+
+template <typename Sink>
+void BasicParser<Sink>::report(ReportKind kind, const std::string &message) {
+  report(kind, current_token->file, current_token->offset, message);
+}
+
+template <typename Sink>
+void BasicParser<Sink>::rule(const char *name) {
+  if (Sink::enabled)
+    report(REPORT_RULE, name);
+}
+
+// EOF reports at the last token that was actually read.
+template <typename Sink>
+void BasicParser<Sink>::moveToEof() {
+  if (current_token != &eof_token) {
+    eof_token.offset = current_token->offset;
+    eof_token.file = current_token->file;
+  }
+  current_token = &eof_token;
+}
+
+template <typename Sink>
+void BasicParser<Sink>::setMaxErrors(unsigned int limit) { max_errors = limit; }
+
+template <typename Sink>
+bool BasicParser<Sink>::wasAborted() const { return aborted; }
+
+template <typename Sink>
+void BasicParser<Sink>::setReferences(std::vector<Reference> *references) {
+  this->references = references;
+}
+
+// The parser only keeps a reference on the lexer's buffer; tokens are read in
+// place and never copied.
+template <typename Sink>
+void BasicParser<Sink>::setTokens(TokenBuffer buffer) {
+  this->buffer = std::move(buffer);
+  tokens = TokenSpan(*this->buffer);
+  stream = nullptr;
   token_index = 0;
+  current_token = &eof_token;
+  main_file = tokens.empty() ? 0 : tokens[tokens.size() - 1].file;
   if (!tokens.empty()) {
-    current_token = tokens[0];
+    current_token = &tokens[0];
   }
 }
 
-int Parser::getNum(const std::string &s) {
-  size_t pos = s.find("Line:");
-  if (pos == std::string::npos)
-    pos += 5;
-  while (pos < s.size() && std::isspace(s[pos]))
-    ++pos;
-  int n = 0;
-  while (pos < s.size() && std::isdigit(s[pos])) {
-    n = n * 10 + (s[pos] - '0');
-    ++pos;
+// Tokens are pulled from the ring lazily, so parsing starts as soon as the
+// lexer has published its first batch.
+template <typename Sink>
+void BasicParser<Sink>::setTokenStream(TokenRing &ring, size_t expected) {
+  buffer.reset();
+  streamed.clear();
+  streamed.reserve(expected);
+  tokens = TokenSpan();
+  stream = &ring;
+  token_index = 0;
+  main_file = 0;
+  current_token = &eof_token;
+  while (tokens.empty() && fetchBatch()) {
+  }
+  if (!tokens.empty()) {
+    current_token = &tokens[0];
   }
-  return n;
 }
 
-void Parser::printParserOutput(std::ofstream &out) {
-  std::sort(this->output_lines.begin(), this->output_lines.end(),
-            [&](const std::string &a, const std::string &b) {
-              return getNum(a) < getNum(b);
-            });
-  for (auto &&i : this->output_lines) {
-    std::cout << i << std::endl;
-    out << i << std::endl;
+// Appending may move the streamed tokens, so the view and the current token
+// pointer are refreshed after every batch.
+template <typename Sink>
+bool BasicParser<Sink>::fetchBatch() {
+  std::vector<Token> batch;
+  if (stream == nullptr || !stream->pop(batch)) {
+    stream = nullptr;
+    return false;
+  }
+  bool at_eof = current_token == &eof_token;
+  if (streamed.capacity() == 0) {
+    streamed = std::move(batch);
+  } else {
+    streamed.insert(streamed.end(), std::make_move_iterator(batch.begin()),
+                    std::make_move_iterator(batch.end()));
   }
+  tokens = TokenSpan(streamed);
+  if (!at_eof && token_index < tokens.size()) {
+    current_token = &tokens[token_index];
+  }
+  return true;
 }
 
-int Parser::parse(std::ofstream &out) {
-  if (tokens.empty()) {
-    output_lines.push_back("No tokens to parse!");
+template <typename Sink>
+void BasicParser<Sink>::drainTokenStream() {
+  while (fetchBatch()) {
+  }
+}
 
+template <typename Sink>
+TokenBuffer BasicParser<Sink>::releaseTokens() {
+  if (!buffer) {
+    buffer = std::make_shared<const std::vector<Token>>(std::move(streamed));
+    tokens = TokenSpan(*buffer);
+  }
+  return buffer;
+}
+
+template <typename Sink>
+void BasicParser<Sink>::printParserOutput(std::ostream &console,
+                                          std::ostream &out) {
+  sink.print(console);
+  sink.print(out);
+}
+
+template <typename Sink>
+int BasicParser<Sink>::parse() {
+  sink.begin();
+  if (tokens.empty()) {
+    sink.report(REPORT_NOTE, main_file, std::string(), 0, 0,
+                "No tokens to parse!");
+    sink.finish(0, 0);
     return 1;
   }
-  output_lines.push_back("\nParser Results:\n");
-  output_lines.push_back(std::string(50, '-'));
+  // A parser can be given the tokens of another file and parsed again.
+  error_count = 0;
+  semantic_error_count = 0;
+  in_function_scope = false;
+  symbols.clear();
+  pending_calls.clear();
+  checked_index = 0;
+  current_struct = 0;
+  member_owner = 0;
+  referenced_member = 0;
+  last_error_index = -1;
+  panic_mode = false;
+  depth = 0;
+  aborted = false;
+  held.clear();
+  speculating = false;
+
+  parseDeclarations();
+  while (current_token->type != EOF_TOKEN && !aborted) {
+    throwError();
+    parseDeclarations();
+  }
+  checkPendingCalls();
+  sink.finish(error_count, semantic_error_count);
+  return error_count == 0 && semantic_error_count == 0 ? 0 : 1;
+}
+
+template <typename Sink>
+unsigned int BasicParser<Sink>::getErrorCount() const { return error_count; }
+
+template <typename Sink>
+unsigned int BasicParser<Sink>::getSemanticErrorCount() const {
+  return semantic_error_count;
+}
+
+template <typename Sink>
+bool BasicParser<Sink>::firstVisit() {
+  if (token_index < checked_index)
+    return false;
+  checked_index = token_index + 1;
+  return true;
+}
+
+// The message is only put together for a sink that shows it, so NullSink
+// counts errors without building a string for each.
+template <typename Sink>
+template <typename... Parts>
+void BasicParser<Sink>::semanticError(const Parts &...parts) {
+  if (aborted)
+    return;
+  semantic_error_count++;
+  if (Sink::enabled) {
+    std::string message;
+    (message.append(parts), ...);
+    report(REPORT_SEMANTIC_ERROR, message);
+  }
+  if (errorLimitReached())
+    abortParse("Too many errors, parsing stopped after " +
+                 std::to_string(max_errors));
+}
 
-  parseDeclarations(out);
-  if (current_token.type != EOF_TOKEN) {
-    throwError(out);
+template <typename Sink>
+bool BasicParser<Sink>::errorLimitReached() const {
+  return max_errors != 0 && error_count + semantic_error_count >= max_errors;
+}
+
+// Jumps straight to EOF. Every parse function then falls through without
+// consuming anything, so the recursion unwinds in one pass.
+template <typename Sink>
+void BasicParser<Sink>::abortParse(const std::string &note) {
+  aborted = true;
+  stream = nullptr;
+  if (Sink::enabled)
+    report(REPORT_NOTE, note);
+  moveToEof();
+}
+
+// Guards the recursive rules, so that a deeply nested input is one syntax
+// error instead of a stack overflow. Every successful call is paired with a
+// depth-- at the end of the rule.
+template <typename Sink>
+bool BasicParser<Sink>::enterNesting() {
+  if (aborted)
+    return false;
+  if (depth >= MAX_NESTING) {
+    error_count++;
+    if (Sink::enabled)
+      report(REPORT_SYNTAX_ERROR, "Nested more than " +
+                                      std::to_string(MAX_NESTING) +
+                                      " levels deep");
+    abortParse("Nesting too deep, parsing stopped");
+    return false;
   }
-  output_lines.push_back("Total NO of errors: " + std::to_string(error_count));
-  return error_count == 0 ? 0 : 1;
+  depth++;
+  return true;
 }
 
-unsigned int Parser::getErrorCount() const { return error_count; }
+template <typename Sink>
+void BasicParser<Sink>::declareName(const Token &name, SymbolKind kind, uint32_t type) {
+  if (name.type != IDENTIFIER)
+    return;
+  if (references) {
+    static const ReferenceKind kinds[] = {REF_VARIABLE, REF_PARAMETER,
+                                          REF_FUNCTION, REF_STRUCT};
+    recordReference(name, current_struct != 0 && kind == SYMBOL_VARIABLE
+                              ? REF_MEMBER
+                              : kinds[kind]);
+  }
+  if (current_struct != 0 && kind == SYMBOL_VARIABLE) {
+    if (!symbols.declareMember(current_struct, name.symbol, type))
+      semanticError("Duplicate member '", name.text, "'");
+    return;
+  }
+  if (!symbols.declare(name.symbol, kind, type))
+    semanticError("Redeclaration of '", name.text, "'");
+}
 
-bool Parser::isDataType(TokenType token) {
-  return token == INTEGER || token == SINTEGER || token == CHARACTER ||
-         token == STRING || token == FLOAT || token == SFLOAT ||
-         token == VOID || token == STRUCT;
+// Calls are only recorded here: functions may be called before the point
+// where they are declared, so they are resolved once the whole file is read.
+template <typename Sink>
+void BasicParser<Sink>::checkIdentifierUse() {
+  if (current_token->type != IDENTIFIER || !firstVisit())
+    return;
+  const Token &next = peekToken();
+  if (references)
+    recordReference(*current_token,
+                    next.type == LEFT_PAREN ? REF_CALL : REF_USE);
+  if (next.type == LEFT_PAREN) {
+    pending_calls.push_back({current_token->symbol, current_token->offset,
+                             current_token->file, current_token->text});
+    return;
+  }
+  if (symbols.lookup(current_token->symbol) == nullptr)
+    semanticError("Undeclared identifier '", current_token->text, "'");
+}
+
+template <typename Sink>
+void BasicParser<Sink>::checkStructType(const Token &name) {
+  if (name.type != IDENTIFIER)
+    return;
+  if (references)
+    recordReference(name, REF_TYPE);
+  const Symbol *symbol = symbols.lookup(name.symbol);
+  if (symbol == nullptr || symbol->kind != SYMBOL_STRUCT)
+    semanticError("Unknown struct '", name.text, "'");
+}
+
+template <typename Sink>
+void BasicParser<Sink>::recordReference(const Token &name, ReferenceKind kind) {
+  references->push_back({name.symbol, name.offset, name.file, kind});
+}
+
+// Whether a member exists depends on declarations that may be in another
+// file, so every name after "->" is recorded, known or not.
+template <typename Sink>
+void BasicParser<Sink>::recordMemberUse() {
+  if (!references || current_token->type != IDENTIFIER ||
+      token_index < referenced_member)
+    return;
+  referenced_member = token_index + 1;
+  recordReference(*current_token, REF_MEMBER_USE);
+}
+
+template <typename Sink>
+void BasicParser<Sink>::checkPendingCalls() {
+  for (const auto &call : pending_calls) {
+    if (aborted || errorLimitReached())
+      break;
+    const Symbol *symbol = symbols.lookup(call.name);
+    if (symbol == nullptr || symbol->kind != SYMBOL_FUNCTION) {
+      semantic_error_count++;
+      if (Sink::enabled)
+        report(REPORT_SEMANTIC_ERROR, call.file, call.offset,
+               "Call to undefined function '" + call.text + "'");
+    }
+  }
+  pending_calls.clear();
 }
 
-bool Parser::isStartOfStatement(TokenType type) {
-  return type == IDENTIFIER || type == CONSTANT || type == STRING_LITERAL ||
-         type == CHARACTER_LITERAL ||
-         (type == BRACE &&
-          (current_token.text == "(" || current_token.text == "{")) ||
-         type == CONDITION || type == LOOP || type == RETURN || type == BREAK;
+template <typename Sink>
+bool BasicParser<Sink>::isDataType(TokenType token) {
+  return isDataTypeToken(token);
 }
 
-bool Parser::isStartsOfLine(TokenType token) { return token == INCLUSION; }
+static const uint64_t STATEMENT_START_TOKENS =
+    tokenMask(IDENTIFIER) | tokenMask(CONSTANT) | tokenMask(STRING_LITERAL) |
+    tokenMask(CHARACTER_LITERAL) | tokenMask(LEFT_PAREN) |
+    tokenMask(LEFT_BRACE) | CONDITION_TOKENS | LOOP_TOKENS |
+    tokenMask(RETURN) | tokenMask(BREAK);
 
-void Parser::nextToken() {
+template <typename Sink>
+bool BasicParser<Sink>::isStartOfStatement(TokenType type) {
+  return inMask(type, STATEMENT_START_TOKENS);
+}
+
+template <typename Sink>
+bool BasicParser<Sink>::isStartsOfLine(TokenType token) { return token == INCLUSION; }
+
+template <typename Sink>
+const Token &BasicParser<Sink>::peekToken() {
+  while (token_index + 1 >= tokens.size() && fetchBatch()) {
+  }
+  if (token_index + 1 < tokens.size()) {
+    return tokens[token_index + 1];
+  }
+  return *current_token;
+}
+
+// Every token a rule consumes goes through here, so this is where panic
+// mode ends. Recovery skips tokens with advance() instead.
+template <typename Sink>
+void BasicParser<Sink>::nextToken() {
+  panic_mode = false;
+  advance();
+}
+
+template <typename Sink>
+void BasicParser<Sink>::advance() {
+  if (aborted) {
+    moveToEof();
+    return;
+  }
+  while (token_index + 1 >= tokens.size() && fetchBatch()) {
+  }
   if (token_index + 1 < tokens.size()) {
-    slow_count +=
-        (this->current_token.type == SEMICOLON ||
-         this->current_token.type == COMMENT_END ||
-         this->current_token.type == SINGLE_LINE_COMMENT_CONTENT ||
-         (this->current_token.type == BRACE &&
-          (this->current_token.text == "{" || this->current_token.text == "}")))
-            ? 1
-            : 0;
     token_index++;
-    current_token = tokens[token_index];
-    line_count = current_token.line;
+    current_token = &tokens[token_index];
   } else {
-    current_token = Token(line_count, "", EOF_TOKEN, false);
+    moveToEof();
   }
 }
 
-void Parser::throwError(std::ofstream &out) {
-  error_count++;
-  output_lines.push_back("Line : " + std::to_string(slow_count) +
-                         " Not Matched Error: Unexpected token '" +
-                         current_token.text + "'");
-  while (current_token.type != SEMICOLON && current_token.type != BRACE &&
-         current_token.type != EOF_TOKEN && token_index < tokens.size()) {
-    nextToken();
+// Tokens that start or end a declaration or statement in the grammar.
+static const uint64_t SYNC_TOKENS =
+    tokenMask(SEMICOLON) | DATA_TYPE_TOKENS | CONDITION_TOKENS | LOOP_TOKENS |
+    tokenMask(RETURN) | tokenMask(BREAK) | tokenMask(INCLUSION) |
+    tokenMask(LEFT_BRACE) | tokenMask(RIGHT_BRACE) | tokenMask(EOF_TOKEN);
+
+static bool isSyncToken(const Token &token) {
+  return inMask(token.type, SYNC_TOKENS);
+}
+
+// Reports the current token and skips to the next sync token. Until a rule
+// accepts a token after that, the parser is in panic mode: the rules it
+// unwinds through fail on the same few tokens, and those errors are only a
+// cascade of this one, so they are counted and reported once.
+template <typename Sink>
+void BasicParser<Sink>::throwError() {
+  if (aborted)
+    return;
+  if (last_error_index == static_cast<long>(token_index)) {
+    // Nothing was consumed since the last error. Skip the token that keeps
+    // failing, so that recovery always makes progress.
+    advance();
+  } else {
+    last_error_index = token_index;
+    if (!panic_mode) {
+      error_count++;
+      if (Sink::enabled)
+        report(REPORT_SYNTAX_ERROR,
+               "Unexpected token '" + current_token->text + "'");
+      if (errorLimitReached()) {
+        abortParse("Too many errors, parsing stopped after " +
+                   std::to_string(max_errors));
+        return;
+      }
+    }
   }
-  if (current_token.type == SEMICOLON && token_index + 1 < tokens.size()) {
-    nextToken();
+  panic_mode = true;
+  while (!isSyncToken(*current_token) && token_index < tokens.size()) {
+    advance();
+  }
+  if (current_token->type == SEMICOLON && token_index + 1 < tokens.size()) {
+    advance();
   }
 }
 
-void Parser::parseDeclarations(std::ofstream &out) {
-  while (isDataType(current_token.type) || current_token.type == INCLUSION ||
-         current_token.type == COMMENT_START ||
-         current_token.type == SINGLE_LINE_COMMENT_START) {
-    if (current_token.type == INCLUSION) {
-      parseIncludeCommand(out);
-    } else if (current_token.type == COMMENT_START ||
-               current_token.type == SINGLE_LINE_COMMENT_START) {
-      parseComment(out);
+template <typename Sink>
+void BasicParser<Sink>::parseDeclarations() {
+  while (isDataType(current_token->type) || current_token->type == INCLUSION) {
+    if (current_token->type == INCLUSION) {
+      parseIncludeCommand();
     } else {
-      parseDeclaration(out);
+      parseDeclaration();
     }
   }
 }
 
-void Parser::parseDeclarationList(std::ofstream &out) {
-  while (isDataType(current_token.type)) {
-    parseDeclaration(out);
+template <typename Sink>
+void BasicParser<Sink>::parseDeclarationList() {
+  while (isDataType(current_token->type)) {
+    parseDeclaration();
   }
 }
 
-void Parser::parseDeclaration(std::ofstream &out) {
-  int start_line = current_token.line;
-  if (isDataType(current_token.type)) {
-    bool isStruct = (current_token.type == STRUCT);
-    parseTypeSpecifier(out);
-    if (current_token.type == IDENTIFIER) {
-      parseIdAssign(out);
-      if (current_token.type == BRACE && current_token.text == "(") {
-        output_lines.push_back("Line : " + std::to_string(slow_count) +
-                               " Matched Rule used: Function-declaration");
+template <typename Sink>
+void BasicParser<Sink>::parseDeclaration() {
+  if (isDataType(current_token->type)) {
+    bool isStruct = (current_token->type == STRUCT);
+    parseTypeSpecifier();
+    if (current_token->type == IDENTIFIER) {
+      // An index, not a reference: in pipelined mode the token storage can
+      // move while more batches arrive.
+      unsigned int name_index = token_index;
+      parseIdAssign();
+      if (current_token->type == LEFT_PAREN) {
+        rule("Function-declaration");
+        declareName(tokens[name_index], SYMBOL_FUNCTION);
         in_function_scope = true;
-        parseFunDec(out);
+        symbols.pushScope();
+        parseFunDec();
+        symbols.popScope();
         in_function_scope = false;
-      } else if (current_token.type == BRACE && current_token.text == "{") {
-        output_lines.push_back("Line : " + std::to_string(slow_count) +
-                               " Matched Rule used: Struct-declaration");
-        parseStructDec(out);
+      } else if (current_token->type == LEFT_BRACE) {
+        rule("Struct-declaration");
+        declareName(tokens[name_index], SYMBOL_STRUCT);
+        current_struct = tokens[name_index].symbol;
+        parseStructDec();
+        current_struct = 0;
       } else {
-        output_lines.push_back("Line : " + std::to_string(slow_count) +
-                               " Matched Rule used: Variable-declaration");
-        parseVarDec(out, isStruct);
+        rule("Variable-declaration");
+        if (isStruct) {
+          checkStructType(tokens[name_index]);
+          declareName(*current_token, SYMBOL_VARIABLE,
+                      tokens[name_index].symbol);
+        } else {
+          declareName(tokens[name_index], SYMBOL_VARIABLE);
+        }
+        parseVarDec(isStruct);
       }
     } else {
-      throwError(out);
+      throwError();
     }
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseStructDec(std::ofstream &out) {
-  if (current_token.type == BRACE && current_token.text == "{") {
+template <typename Sink>
+void BasicParser<Sink>::parseStructDec() {
+  if (current_token->type == LEFT_BRACE) {
     nextToken();
-    parseLocalDecs(out);
-    if (current_token.type == BRACE && current_token.text == "}") {
+    parseLocalDecs();
+    if (current_token->type == RIGHT_BRACE) {
       nextToken();
-      if (current_token.type == SEMICOLON) {
+      if (current_token->type == SEMICOLON) {
         nextToken();
       } else {
-        throwError(out);
+        throwError();
       }
     } else {
-      throwError(out);
+      throwError();
     }
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseVarDec(std::ofstream &out, bool isStruct) {
-  if (current_token.type == IDENTIFIER) {
+template <typename Sink>
+void BasicParser<Sink>::parseVarDec(bool isStruct) {
+  if (current_token->type == IDENTIFIER) {
+    // Global declarations have already been recorded by parseDeclaration.
+    bool declares = symbols.depth() > 0 || current_struct != 0;
+    uint32_t type = 0;
     // so i either look back at the type which breaks the rule of top->down and
     // left->right, or i pass in a boo.
     if (isStruct) {
-      parseIdAssign(out);
+      if (declares) {
+        checkStructType(*current_token);
+        type = current_token->symbol;
+      }
+      parseIdAssign();
     }
-    parseIdAssign(out);
-    if (current_token.type == ASSIGNMENT_OP) {
+    if (declares) {
+      declareName(*current_token, SYMBOL_VARIABLE, type);
+    }
+    parseIdAssign();
+    if (current_token->type == ASSIGNMENT_OP) {
       if (!in_function_scope) {
-        output_lines.push_back("Line : " + std::to_string(slow_count) +
-                               "ERROR: Variable initialization only allowed "
-                               "inside function");
-        throwError(out);
+        if (Sink::enabled)
+          report(REPORT_SYNTAX_ERROR,
+                 "Variable initialization only allowed inside function");
+        throwError();
       } else {
         nextToken();
-        parseExpression(out);
+        parseExpression();
       }
     }
-    if (current_token.type == BRACE && current_token.text == "[") {
+    if (current_token->type == LEFT_BRACKET) {
       nextToken();
-      if (current_token.type == CONSTANT) {
+      if (current_token->type == CONSTANT) {
         nextToken();
-        if (current_token.type == BRACE && current_token.text == "]") {
+        if (current_token->type == RIGHT_BRACKET) {
           nextToken();
         } else {
-          throwError(out);
+          throwError();
         }
       } else {
-        throwError(out);
+        throwError();
       }
     }
-  } else if (current_token.type == ARITHMETIC_OP && current_token.text == "*") {
-    nextToken();
-    if (current_token.type == IDENTIFIER) {
-      parseIdAssign(out);
-    } else {
-      throwError(out);
-    }
-  } else if (current_token.type == SEMICOLON) {
+  } else if (current_token->type == SEMICOLON) {
     nextToken();
     return;
   } else {
-    throwError(out);
+    throwError();
   }
-  if (current_token.type == SEMICOLON) {
+  if (current_token->type == SEMICOLON) {
     nextToken();
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseTypeSpecifier(std::ofstream &out) {
-  if (isDataType(current_token.type)) {
+template <typename Sink>
+void BasicParser<Sink>::parseTypeSpecifier() {
+  if (isDataType(current_token->type)) {
     nextToken();
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseFunDec(std::ofstream &out) {
-  if (current_token.type == BRACE && current_token.text == "(") {
+template <typename Sink>
+void BasicParser<Sink>::parseFunDec() {
+  if (current_token->type == LEFT_PAREN) {
     nextToken();
-    parseParams(out);
-    if (current_token.type == BRACE && current_token.text == ")") {
+    parseParams();
+    if (current_token->type == RIGHT_PAREN) {
       nextToken();
-      if (current_token.type == BRACE && current_token.text == "{") {
-        parseCompoundStmt(out);
+      if (current_token->type == LEFT_BRACE) {
+        parseCompoundStmt();
       } else {
-        throwError(out);
+        throwError();
       }
     } else {
-      throwError(out);
+      throwError();
     }
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseParams(std::ofstream &out) {
-  if (current_token.type == VOID) {
+template <typename Sink>
+void BasicParser<Sink>::parseParams() {
+  if (current_token->type == VOID) {
     nextToken();
     return;
   }
-  if (isDataType(current_token.type)) {
-    parseParamList(out);
+  if (isDataType(current_token->type)) {
+    parseParamList();
   }
 }
 
-void Parser::parseParamList(std::ofstream &out) {
-  parseParam(out);
-  parsePList(out);
+template <typename Sink>
+void BasicParser<Sink>::parseParamList() {
+  parseParam();
+  parsePList();
 }
 
-void Parser::parsePList(std::ofstream &out) {
-  if (current_token.type == COMMA) {
+template <typename Sink>
+void BasicParser<Sink>::parsePList() {
+  while (current_token->type == COMMA) {
     nextToken();
-    parseParam(out);
-    parsePList(out);
+    parseParam();
   }
 }
 
-void Parser::parseParam(std::ofstream &out) {
-  if (isDataType(current_token.type)) {
-    if (current_token.type == STRUCT) {
+template <typename Sink>
+void BasicParser<Sink>::parseParam() {
+  if (isDataType(current_token->type)) {
+    uint32_t type = 0;
+    if (current_token->type == STRUCT) {
       nextToken();
+      checkStructType(*current_token);
+      type = current_token->symbol;
     }
     nextToken();
-    if (current_token.type == IDENTIFIER) {
-      parseIdAssign(out);
+    if (current_token->type == IDENTIFIER) {
+      declareName(*current_token, SYMBOL_PARAMETER, type);
+      parseIdAssign();
     } else {
-      throwError(out);
+      throwError();
     }
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseCompoundStmt(std::ofstream &out) {
-  if (current_token.type == BRACE && current_token.text == "{") {
+template <typename Sink>
+void BasicParser<Sink>::parseCompoundStmt() {
+  if (current_token->type == LEFT_BRACE) {
     nextToken();
-    if (current_token.type == COMMENT_START ||
-        current_token.type == SINGLE_LINE_COMMENT_START) {
-      parseComment(out);
-    }
-    parseLocalDecs(out);
-    parseStmtList(out);
-    if (current_token.type == BRACE && current_token.text == "}") {
+    symbols.pushScope();
+    parseLocalDecs();
+    parseStmtList();
+    symbols.popScope();
+    if (current_token->type == RIGHT_BRACE) {
       nextToken();
     } else {
-      throwError(out);
+      throwError();
     }
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseLocalDecs(std::ofstream &out) {
-  while (isDataType(current_token.type)) {
-    bool isStruct = current_token.type == STRUCT;
-    parseTypeSpecifier(out);
-    parseVarDec(out, isStruct);
+template <typename Sink>
+void BasicParser<Sink>::parseLocalDecs() {
+  while (isDataType(current_token->type)) {
+    bool isStruct = current_token->type == STRUCT;
+    parseTypeSpecifier();
+    parseVarDec(isStruct);
   }
 }
 
-void Parser::parseStmtList(std::ofstream &out) {
-  while (isStartOfStatement(current_token.type)) {
-    parseStatement(out);
+template <typename Sink>
+void BasicParser<Sink>::parseStmtList() {
+  while (isStartOfStatement(current_token->type)) {
+    parseStatement();
   }
 }
 
-void Parser::parseStatement(std::ofstream &out) {
-  int start_line = current_token.line;
-  switch (current_token.type) {
+template <typename Sink>
+void BasicParser<Sink>::parseStatement() {
+  if (!enterNesting())
+    return;
+  switch (current_token->type) {
   case IDENTIFIER:
   case CONSTANT:
   case STRING_LITERAL:
   case CHARACTER_LITERAL:
-    output_lines.push_back("Line : " + std::to_string(slow_count) +
-                           " Matched Rule used: Expression-statement");
-    parseExpressionStmt(out);
+    rule("Expression-statement");
+    parseExpressionStmt();
     break;
-  case BRACE:
-    if (current_token.text == "(") {
-      output_lines.push_back("Line : " + std::to_string(slow_count) +
-                             " Matched Rule used: Expression-statement");
-      parseExpressionStmt(out);
-
-    } else if (current_token.text == "{") {
-      output_lines.push_back("Line : " + std::to_string(slow_count) +
-                             " Matched Rule used: Compound-statement");
-      parseCompoundStmt(out);
-
-    } else {
-      throwError(out);
-    }
+  case LEFT_PAREN:
+    rule("Expression-statement");
+    parseExpressionStmt();
+    break;
+  case LEFT_BRACE:
+    rule("Compound-statement");
+    parseCompoundStmt();
     break;
   case CONDITION:
-    output_lines.push_back("Line : " + std::to_string(slow_count) +
-                           " Matched Rule used: Selection-statement");
-    parseSelectionStmt(out);
+  case OTHERWISE:
+    rule("Selection-statement");
+    parseSelectionStmt();
 
     break;
   case LOOP:
-    output_lines.push_back("Line : " + std::to_string(slow_count) +
-                           " Matched Rule used: Iteration-statement");
-    parseIterationStmt(out);
+  case REITERATE:
+    rule("Iteration-statement");
+    parseIterationStmt();
 
     break;
   case RETURN:
   case BREAK:
-    output_lines.push_back("Line : " + std::to_string(slow_count) +
-                           " Matched Rule used: Jump-statement");
-    parseJumpStmt(out);
+    rule("Jump-statement");
+    parseJumpStmt();
 
     break;
   default:
-    throwError(out);
+    throwError();
   }
+  depth--;
 }
 
-void Parser::parseExpressionStmt(std::ofstream &out) {
-  if (current_token.type == SEMICOLON) {
+template <typename Sink>
+void BasicParser<Sink>::parseExpressionStmt() {
+  if (current_token->type == SEMICOLON) {
     nextToken();
     return;
   }
-  parseExpression(out);
-  if (current_token.type == SEMICOLON) {
+  parseExpression();
+  if (current_token->type == SEMICOLON) {
     nextToken();
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseSelectionStmt(std::ofstream &out) {
-  if (current_token.type == CONDITION) {
+template <typename Sink>
+void BasicParser<Sink>::parseSelectionStmt() {
+  if (inMask(current_token->type, CONDITION_TOKENS)) {
     nextToken();
-    if (current_token.type == BRACE && current_token.text == "(") {
+    if (current_token->type == LEFT_PAREN) {
       nextToken();
-      parseExpression(out);
-      if (current_token.type == BRACE && current_token.text == ")") {
+      parseExpression();
+      if (current_token->type == RIGHT_PAREN) {
         nextToken();
-        parseStatement(out);
-        if (current_token.type == CONDITION &&
-            current_token.text == "Otherwise") {
+        parseStatement();
+        if (current_token->type == OTHERWISE) {
           nextToken();
-          parseStatement(out);
+          parseStatement();
         }
       } else {
-        throwError(out);
+        throwError();
       }
     } else {
-      throwError(out);
+      throwError();
     }
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseIterationStmt(std::ofstream &out) {
-  if (current_token.type == LOOP) {
-    if (current_token.text == "Reiterate") {
+template <typename Sink>
+void BasicParser<Sink>::parseIterationStmt() {
+  if (inMask(current_token->type, LOOP_TOKENS)) {
+    if (current_token->type == REITERATE) {
       nextToken();
-      if (current_token.type == BRACE && current_token.text == "(") {
+      if (current_token->type == LEFT_PAREN) {
         nextToken();
+        // The loop variable is only visible inside the loop.
+        symbols.pushScope();
         // so in the rules its reiterate (exp;exp;exp) but if it's supposed to
         // be a for loop then the first one is either an expression or vardec. i
         // dunno man.
-        if (isDataType(current_token.type)) {
-          parseTypeSpecifier(out);
+        if (isDataType(current_token->type)) {
+          parseTypeSpecifier();
           // vardec consumes the ; from the line while expression does not
           // because it's always wrapped with expression statement.
-          parseVarDec(out, false);
+          parseVarDec(false);
           token_index -= 2;
           nextToken();
         } else {
-          parseExpression(out);
+          parseExpression();
         }
-        if (current_token.type == SEMICOLON) {
+        if (current_token->type == SEMICOLON) {
           nextToken();
-          parseExpression(out);
-          if (current_token.type == SEMICOLON) {
+          parseExpression();
+          if (current_token->type == SEMICOLON) {
             nextToken();
-            parseExpression(out);
-            if (current_token.type == BRACE && current_token.text == ")") {
+            parseExpression();
+            if (current_token->type == RIGHT_PAREN) {
               nextToken();
-              parseStatement(out);
+              parseStatement();
             } else {
-              throwError(out);
+              throwError();
             }
           } else {
-            throwError(out);
+            throwError();
           }
         } else {
-          throwError(out);
+          throwError();
         }
+        symbols.popScope();
       } else {
-        throwError(out);
+        throwError();
       }
     } else {
       nextToken();
-      if (current_token.type == BRACE && current_token.text == "(") {
+      if (current_token->type == LEFT_PAREN) {
         nextToken();
-        parseExpression(out);
-        if (current_token.type == BRACE && current_token.text == ")") {
+        parseExpression();
+        if (current_token->type == RIGHT_PAREN) {
           nextToken();
-          parseStatement(out);
+          parseStatement();
         } else {
-          throwError(out);
+          throwError();
         }
       } else {
-        throwError(out);
+        throwError();
       }
     }
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseJumpStmt(std::ofstream &out) {
-  if (current_token.type == RETURN) {
+template <typename Sink>
+void BasicParser<Sink>::parseJumpStmt() {
+  if (current_token->type == RETURN) {
     nextToken();
-    if (current_token.type != SEMICOLON) {
-      parseExpression(out);
+    if (current_token->type != SEMICOLON) {
+      parseExpression();
     }
-    if (current_token.type == SEMICOLON) {
+    if (current_token->type == SEMICOLON) {
       nextToken();
     } else {
-      throwError(out);
+      throwError();
     }
-  } else if (current_token.type == BREAK) {
+  } else if (current_token->type == BREAK) {
     nextToken();
-    if (current_token.type == SEMICOLON) {
+    if (current_token->type == SEMICOLON) {
       nextToken();
     } else {
-      throwError(out);
+      throwError();
     }
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseExpression(std::ofstream &out) {
-  if (current_token.type == IDENTIFIER) {
-    // I'm not sure we can edit the grammar beyond accounting for left recursion
-    // so i'll use backtracking here even though i've been avoiding it.
-    int id_token = token_index;
-    parseIdAssign(out);
-    if (current_token.type == ASSIGNMENT_OP) {
-      nextToken();
-      parseExpression(out);
-    } else {
-      token_index = id_token - 1;
-      nextToken();
-      parseSimpleExpression(out);
+template <typename Sink>
+typename BasicParser<Sink>::Checkpoint BasicParser<Sink>::speculate() {
+  Checkpoint checkpoint = {token_index,
+                           error_count,
+                           semantic_error_count,
+                           checked_index,
+                           referenced_member,
+                           member_owner,
+                           last_error_index,
+                           panic_mode,
+                           speculating,
+                           pending_calls.size(),
+                           references ? references->size() : 0,
+                           held.size()};
+  speculating = true;
+  return checkpoint;
+}
+
+template <typename Sink>
+void BasicParser<Sink>::keep(const Checkpoint &checkpoint) {
+  speculating = checkpoint.speculating;
+  if (speculating)
+    return;
+  for (const HeldReport &held_report : held)
+    sink.report(held_report.kind, held_report.file, held_report.path,
+                held_report.line, held_report.column, held_report.message);
+  held.clear();
+}
+
+template <typename Sink>
+void BasicParser<Sink>::undo(const Checkpoint &checkpoint) {
+  error_count = checkpoint.error_count;
+  semantic_error_count = checkpoint.semantic_error_count;
+  checked_index = checkpoint.checked_index;
+  referenced_member = checkpoint.referenced_member;
+  member_owner = checkpoint.member_owner;
+  last_error_index = checkpoint.last_error_index;
+  pending_calls.resize(checkpoint.pending_calls);
+  if (references)
+    references->resize(checkpoint.references);
+  held.resize(checkpoint.held);
+  speculating = checkpoint.speculating;
+  token_index = checkpoint.token_index - 1;
+  nextToken();
+  panic_mode = checkpoint.panic_mode;
+}
+
+template <typename Sink>
+void BasicParser<Sink>::parseExpression() {
+  // A chain of assignments, a = b = c, is consumed in a loop. An aborted
+  // parse has already jumped to EOF, so what it reported is kept.
+  while (current_token->type == IDENTIFIER) {
+    Checkpoint checkpoint = speculate();
+    checkIdentifierUse();
+    parseIdAssign();
+    if (current_token->type != ASSIGNMENT_OP && !aborted) {
+      undo(checkpoint);
+      break;
     }
-  } else {
-    parseSimpleExpression(out);
+    keep(checkpoint);
+    if (aborted)
+      break;
+    nextToken();
   }
+  parseSimpleExpression();
 }
 
-void Parser::parseIdAssign(std::ofstream &out) {
-  if (current_token.type == IDENTIFIER) {
-    if (!std::isalpha(current_token.text[0]) && current_token.text[0] != '_') {
-      output_lines.push_back("Line : " + std::to_string(current_token.line) +
-                             " Not Matched Error: Invalid identifier \"" +
-                             current_token.text + "\"");
+template <typename Sink>
+void BasicParser<Sink>::parseIdAssign() {
+  if (!enterNesting())
+    return;
+  uint32_t owner = member_owner;
+  member_owner = 0;
+  if (current_token->type == IDENTIFIER) {
+    char first = current_token->text[0];
+    if (!isIdentStart(first) && isAsciiChar(first)) {
+      if (Sink::enabled)
+        report(REPORT_SYNTAX_ERROR,
+               "Invalid identifier \"" + current_token->text + "\"");
 
-      throwError(out);
+      throwError();
     } else {
+      // Struct type of this name, used to check the member after "->".
+      uint32_t type = 0;
+      if (owner != 0) {
+        int64_t member = symbols.memberType(owner, current_token->symbol);
+        if (member < 0 && firstVisit()) {
+          semanticError("No member '", current_token->text, "' in '",
+                        Interner::current().text(owner), "'");
+        }
+        type = member > 0 ? static_cast<uint32_t>(member) : 0;
+      } else if (const Symbol *symbol = symbols.lookup(current_token->symbol)) {
+        type = symbol->kind == SYMBOL_STRUCT ? 0 : symbol->type;
+      }
       nextToken();
-      if (current_token.type == ACCESS_OP) {
+      if (current_token->type == ACCESS_OP) {
         nextToken();
-        parseIdAssign(out);
-      } else if (current_token.type == BRACE && current_token.text == "[") {
+        recordMemberUse();
+        member_owner = type;
+        parseIdAssign();
+      } else if (current_token->type == LEFT_BRACKET) {
         nextToken();
-        if (current_token.type == IDENTIFIER) {
-          parseIdAssign(out);
-        } else if (current_token.type == CONSTANT) {
+        if (current_token->type == IDENTIFIER) {
+          checkIdentifierUse();
+          parseIdAssign();
+        } else if (current_token->type == CONSTANT) {
           nextToken();
         } else {
-          throwError(out);
+          throwError();
         }
-        if (current_token.type != BRACE || current_token.text != "]") {
-          throwError(out);
+        if (current_token->type != RIGHT_BRACKET) {
+          throwError();
         } else {
           nextToken();
         }
       }
     }
   } else {
-    throwError(out);
+    throwError();
   }
+  depth--;
 }
 
-void Parser::parseSimpleExpression(std::ofstream &out) {
-  parseAdditiveExpression(out);
-  if (current_token.type == RELATIONAL_OP || current_token.type == LOGIC_OP) {
-    parseRelop(out);
-    parseAdditiveExpression(out);
+template <typename Sink>
+void BasicParser<Sink>::parseSimpleExpression() {
+  parseAdditiveExpression();
+  if (current_token->type == RELATIONAL_OP || current_token->type == LOGIC_OP) {
+    parseRelop();
+    parseAdditiveExpression();
   }
 }
 
-void Parser::parseRelop(std::ofstream &out) {
-  if (current_token.type == RELATIONAL_OP || current_token.type == LOGIC_OP) {
+template <typename Sink>
+void BasicParser<Sink>::parseRelop() {
+  if (current_token->type == RELATIONAL_OP || current_token->type == LOGIC_OP) {
     nextToken();
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseAdditiveExpression(std::ofstream &out) {
-  parseTerm(out);
-  parseAdditiveExpressionPrime(out);
+template <typename Sink>
+void BasicParser<Sink>::parseAdditiveExpression() {
+  parseTerm();
+  parseAdditiveExpressionPrime();
 }
 
-void Parser::parseAdditiveExpressionPrime(std::ofstream &out) {
-  if (current_token.type == ADDOP) {
-    parseAddOp(out);
-    parseTerm(out);
-    parseAdditiveExpressionPrime(out);
+template <typename Sink>
+void BasicParser<Sink>::parseAdditiveExpressionPrime() {
+  while (isAddOpToken(current_token->type)) {
+    parseAddOp();
+    parseTerm();
   }
 }
 
-void Parser::parseAddOp(std::ofstream &out) {
-  if (current_token.type == ADDOP) {
+template <typename Sink>
+void BasicParser<Sink>::parseAddOp() {
+  if (isAddOpToken(current_token->type)) {
     nextToken();
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseTerm(std::ofstream &out) {
-  parseFactor(out);
-  parseTermPrime(out);
+template <typename Sink>
+void BasicParser<Sink>::parseTerm() {
+  parseFactor();
+  parseTermPrime();
 }
 
-void Parser::parseTermPrime(std::ofstream &out) {
-  if (current_token.type == MULOP) {
-    parseMulOp(out);
-    parseFactor(out);
-    parseTermPrime(out);
+template <typename Sink>
+void BasicParser<Sink>::parseTermPrime() {
+  while (isMulOpToken(current_token->type)) {
+    parseMulOp();
+    parseFactor();
   }
 }
 
-void Parser::parseMulOp(std::ofstream &out) {
-  if (current_token.type == MULOP) {
+template <typename Sink>
+void BasicParser<Sink>::parseMulOp() {
+  if (isMulOpToken(current_token->type)) {
     nextToken();
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseFactor(std::ofstream &out) {
-  switch (current_token.type) {
-  case BRACE:
-    if (current_token.text == "(") {
+template <typename Sink>
+void BasicParser<Sink>::parseFactor() {
+  if (!enterNesting())
+    return;
+  switch (current_token->type) {
+  case LEFT_PAREN:
+    nextToken();
+    parseExpression();
+    if (current_token->type == RIGHT_PAREN) {
       nextToken();
-      parseExpression(out);
-      if (current_token.type == BRACE && current_token.text == ")") {
-        nextToken();
-      } else {
-        throwError(out);
-      }
     } else {
-      throwError(out);
+      throwError();
     }
     break;
   case IDENTIFIER: {
-    parseIdAssign(out);
-    if (current_token.type == BRACE && current_token.text == "(") {
-      parseCall(out);
-    } else if (current_token.type == ACCESS_OP) {
+    checkIdentifierUse();
+    parseIdAssign();
+    if (current_token->type == LEFT_PAREN) {
+      parseCall();
+    } else if (current_token->type == ACCESS_OP) {
       nextToken();
-      parseIdAssign(out);
+      recordMemberUse();
+      parseIdAssign();
     }
   } break;
   case CONSTANT:
@@ -638,159 +1071,138 @@ void Parser::parseFactor(std::ofstream &out) {
   case CHARACTER_LITERAL:
     nextToken();
     break;
-  case ADDOP:
-    parseSignedNum(out);
-    break;
-  case ARITHMETIC_OP:
-    if (current_token.text == "*") {
-      nextToken();
-      parseFactor(out);
-    } else {
-      throwError(out);
-    }
+  case PLUS:
+  case MINUS:
+    parseSignedNum();
     break;
   default:
-    throwError(out);
+    throwError();
   }
+  depth--;
 }
 
-void Parser::parseCall(std::ofstream &out) {
-  if (current_token.type == BRACE && current_token.text == "(") {
+template <typename Sink>
+void BasicParser<Sink>::parseCall() {
+  if (current_token->type == LEFT_PAREN) {
     nextToken();
-    parseArgs(out);
-    if (current_token.type == BRACE && current_token.text == ")") {
+    parseArgs();
+    if (current_token->type == RIGHT_PAREN) {
       nextToken();
     } else {
-      throwError(out);
+      throwError();
     }
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseArgs(std::ofstream &out) {
-  if (current_token.type != BRACE || current_token.text != ")") {
-    parseArgList(out);
+template <typename Sink>
+void BasicParser<Sink>::parseArgs() {
+  if (current_token->type != RIGHT_PAREN) {
+    parseArgList();
   }
 }
 
-void Parser::parseArgList(std::ofstream &out) {
-  parseExpression(out);
-  parseAList(out);
+template <typename Sink>
+void BasicParser<Sink>::parseArgList() {
+  parseExpression();
+  parseAList();
 }
 
-void Parser::parseAList(std::ofstream &out) {
-  if (current_token.type == COMMA) {
+template <typename Sink>
+void BasicParser<Sink>::parseAList() {
+  while (current_token->type == COMMA) {
     nextToken();
-    parseExpression(out);
-    parseAList(out);
+    parseExpression();
   }
 }
 
-void Parser::parseNum(std::ofstream &out) {
-  if (current_token.type == ADDOP) {
-    parseSignedNum(out);
-  } else if (current_token.type == CONSTANT) {
-    parseUnsignedNum(out);
+template <typename Sink>
+void BasicParser<Sink>::parseNum() {
+  if (isAddOpToken(current_token->type)) {
+    parseSignedNum();
+  } else if (current_token->type == CONSTANT) {
+    parseUnsignedNum();
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseSignedNum(std::ofstream &out) {
-  if (current_token.type == ADDOP) {
-    if (current_token.text == "+") {
-      parsePosNum(out);
-    } else if (current_token.text == "-") {
-      parseNegNum(out);
-    } else {
-      throwError(out);
-    }
+template <typename Sink>
+void BasicParser<Sink>::parseSignedNum() {
+  if (current_token->type == PLUS) {
+    parsePosNum();
+  } else if (current_token->type == MINUS) {
+    parseNegNum();
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseUnsignedNum(std::ofstream &out) { parseValue(out); }
-
-void Parser::parsePosNum(std::ofstream &out) {
-  if (current_token.type == ADDOP && current_token.text == "+") {
-    nextToken();
-    parseValue(out);
-  } else {
-    throwError(out);
-  }
-}
+template <typename Sink>
+void BasicParser<Sink>::parseUnsignedNum() { parseValue(); }
 
-void Parser::parseNegNum(std::ofstream &out) {
-  if (current_token.type == ADDOP && current_token.text == "-") {
+template <typename Sink>
+void BasicParser<Sink>::parsePosNum() {
+  if (current_token->type == PLUS) {
     nextToken();
-    parseValue(out);
+    parseValue();
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseValue(std::ofstream &out) {
-  if (current_token.type == CONSTANT) {
+template <typename Sink>
+void BasicParser<Sink>::parseNegNum() {
+  if (current_token->type == MINUS) {
     nextToken();
+    parseValue();
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseComment(std::ofstream &out) {
-  int start_line = current_token.line;
-  if (current_token.type == COMMENT_START) {
+template <typename Sink>
+void BasicParser<Sink>::parseValue() {
+  if (current_token->type == CONSTANT) {
     nextToken();
-    if (current_token.type == COMMENT_CONTENT) {
-      nextToken();
-    }
-    if (current_token.type == COMMENT_END ||
-        current_token.type == INVALID_COMMENT) {
-      nextToken();
-    } else {
-      throwError(out);
-    }
-  } else if (current_token.type == SINGLE_LINE_COMMENT_START) {
-    nextToken();
-    if (current_token.type == SINGLE_LINE_COMMENT_CONTENT) {
-      nextToken();
-    }
-  output_lines.push_back("Line : " + std::to_string(slow_count) +
-                         " Matched Rule used: Comment");
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseIncludeCommand(std::ofstream &out) {
-  int start_line = current_token.line;
-  if (current_token.type == INCLUSION) {
+template <typename Sink>
+void BasicParser<Sink>::parseIncludeCommand() {
+  if (current_token->type == INCLUSION) {
     nextToken();
-    if (current_token.type == STRING_LITERAL ||
-        current_token.type == INVALID_INCLUSION) {
-      parseFName(out);
-      if (current_token.type == SEMICOLON) {
-        output_lines.push_back("Line : " + std::to_string(slow_count) +
-                               " Matched Rule used: Include-command");
+    if (current_token->type == STRING_LITERAL ||
+        current_token->type == INVALID_INCLUSION) {
+      parseFName();
+      if (current_token->type == SEMICOLON) {
+        rule("Include-command");
         nextToken();
       } else {
-        throwError(out);
+        throwError();
       }
     } else {
-      throwError(out);
+      throwError();
     }
   } else {
-    throwError(out);
+    throwError();
   }
 }
 
-void Parser::parseFName(std::ofstream &out) {
-  if (current_token.type == STRING_LITERAL ||
-      current_token.type == INVALID_INCLUSION) {
+template <typename Sink>
+void BasicParser<Sink>::parseFName() {
+  if (current_token->type == STRING_LITERAL ||
+      current_token->type == INVALID_INCLUSION) {
     nextToken();
   } else {
-    throwError(out);
+    throwError();
   }
 }
+
+template class BasicParser<NullSink>;
+template class BasicParser<StructuredSink>;
+template class BasicParser<TextSink>;
+template class BasicParser<NdjsonSink>;
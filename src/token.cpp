@@ -8,6 +8,7 @@ string tokenTypeToString(TokenType type) {
   case TokenType::CLEAR:
     return "CLEAR";
   case TokenType::CONDITION:
+  case TokenType::OTHERWISE:
     return "CONDITION";
   case TokenType::INTEGER:
     return "INTEGER";
@@ -24,6 +25,7 @@ string tokenTypeToString(TokenType type) {
   case TokenType::VOID:
     return "VOID";
   case TokenType::LOOP:
+  case TokenType::REITERATE:
     return "LOOP";
   case TokenType::RETURN:
     return "RETURN";
@@ -37,7 +39,12 @@ string tokenTypeToString(TokenType type) {
     return "ASSIGNMENT_OP";
   case TokenType::ACCESS_OP:
     return "ACCESS_OP";
-  case TokenType::BRACE:
+  case TokenType::LEFT_PAREN:
+  case TokenType::RIGHT_PAREN:
+  case TokenType::LEFT_BRACE:
+  case TokenType::RIGHT_BRACE:
+  case TokenType::LEFT_BRACKET:
+  case TokenType::RIGHT_BRACKET:
     return "BRACE";
   case TokenType::CONSTANT:
     return "CONSTANT";
@@ -83,14 +90,18 @@ string tokenTypeToString(TokenType type) {
     return "UNTERMINATED_CHAR";
   case TokenType::INVALID_IDENTIFIER:
     return "INVALID_IDENTIFIER";
-  case TokenType::ADDOP:
+  case TokenType::PLUS:
+  case TokenType::MINUS:
     return "ADDOP";
-  case TokenType::MULOP:
+  case TokenType::STAR:
+  case TokenType::SLASH:
     return "MULOP";
   case TokenType::AMPERSAND:
     return "AMPERSAND";
   case TokenType::UNKNOWN:
     return "UNKNOWN";
+  case TokenType::INVALID_ENCODING:
+    return "INVALID_ENCODING";
   case TokenType::EOF_TOKEN:
     return "EOF_TOKEN";
   default:
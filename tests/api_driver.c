@@ -0,0 +1,187 @@
+/* Drives the C interface the way an embedding program would: includes come
+   from a resolver, and the tokens, comments and diagnostics of each compile
+   are read back. One context compiles on the main thread and prints what it
+   sees; then four threads, each with its own context, compile the same
+   sources over and over and compare every result with those first ones.
+
+   Built and run by the api_driver case of tests/run_tests.sh. */
+
+#include "CompilerApi.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define THREADS 4
+#define ROUNDS 500
+
+static const char LIB[] = "/^ Doubles its argument\n"
+                          "Imw twice(Imw x) {\n"
+                          "    Turnback x * 2;\n"
+                          "}\n";
+
+static const char GOOD[] = "include\".\\lib.txt\";\n"
+                           "/@ Uses the included function @/\n"
+                           "Imw main() {\n"
+                           "    Turnback twice(21);\n"
+                           "}\n";
+
+static const char BAD[] = "include\".\\gone.txt\";\n"
+                          "include\".\\lib.txt\";\n"
+                          "Imw main() {\n"
+                          "    Turnback 1 +;\n"
+                          "}\n";
+
+static const char *const SOURCES[] = {GOOD, BAD};
+
+static int resolve(void *user, const char *path, const char **data,
+                   size_t *size) {
+  (void)user;
+  if (strcmp(path, "lib.txt") != 0)
+    return 0;
+  *data = LIB;
+  *size = sizeof(LIB) - 1;
+  return 1;
+}
+
+/* What one compile produced, reduced to something cheap to compare. */
+struct summary {
+  int result;
+  size_t tokens;
+  size_t comments;
+  size_t diagnostics;
+  unsigned int errors;
+  unsigned int semantic_errors;
+  unsigned long checksum;
+};
+
+static unsigned long mix(unsigned long hash, const char *text, size_t size) {
+  size_t i;
+  for (i = 0; i < size; i++)
+    hash = hash * 31 + (unsigned char)text[i];
+  return hash;
+}
+
+static unsigned long mix_token(unsigned long hash, const cmp_context *context,
+                               const cmp_token *token) {
+  const char *name = cmp_file_name(context, token->file);
+  hash = mix(hash, token->text, token->size);
+  hash = mix(hash, token->type, strlen(token->type));
+  hash = mix(hash, name, strlen(name));
+  return hash * 31 + token->line * 1000 + token->column;
+}
+
+static struct summary summarize(const cmp_context *context, int result) {
+  struct summary summary;
+  cmp_token token;
+  cmp_diagnostic diagnostic;
+  size_t i, before;
+  summary.result = result;
+  summary.tokens = cmp_token_count(context);
+  summary.comments = cmp_comment_count(context);
+  summary.diagnostics = cmp_diagnostic_count(context);
+  summary.errors = cmp_error_count(context);
+  summary.semantic_errors = cmp_semantic_error_count(context);
+  summary.checksum = 0;
+  for (i = 0; cmp_token_get(context, i, &token); i++)
+    summary.checksum = mix_token(summary.checksum, context, &token);
+  for (i = 0; cmp_comment_get(context, i, &token, &before); i++)
+    summary.checksum = mix_token(summary.checksum, context, &token) + before;
+  for (i = 0; cmp_diagnostic_get(context, i, &diagnostic); i++) {
+    const char *name = cmp_file_name(context, diagnostic.file);
+    summary.checksum = mix(summary.checksum, diagnostic.message,
+                           strlen(diagnostic.message));
+    summary.checksum = mix(summary.checksum, name, strlen(name));
+    summary.checksum = summary.checksum * 31 + diagnostic.line;
+  }
+  return summary;
+}
+
+static int same_summary(const struct summary *a, const struct summary *b) {
+  return a->result == b->result && a->tokens == b->tokens &&
+         a->comments == b->comments && a->diagnostics == b->diagnostics &&
+         a->errors == b->errors && a->semantic_errors == b->semantic_errors &&
+         a->checksum == b->checksum;
+}
+
+static const char *file_label(const cmp_context *context, uint16_t file) {
+  const char *name = cmp_file_name(context, file);
+  return name[0] == '\0' ? "main" : name;
+}
+
+static void print_results(const cmp_context *context, int result) {
+  cmp_token token;
+  cmp_diagnostic diagnostic;
+  size_t i, before;
+  printf("result %d: %u lexical, %u syntax, %u semantic errors\n", result,
+         cmp_lexical_error_count(context), cmp_error_count(context),
+         cmp_semantic_error_count(context));
+  printf("%lu tokens\n", (unsigned long)cmp_token_count(context));
+  for (i = 0; cmp_token_get(context, i, &token); i++) {
+    if (token.error)
+      printf("  error token %.*s (%s) at %s:%u:%u\n", (int)token.size,
+             token.text, token.type, file_label(context, token.file),
+             token.line, token.column);
+  }
+  for (i = 0; cmp_comment_get(context, i, &token, &before); i++)
+    printf("  comment %s \"%.*s\" at %s:%u:%u before token %lu\n", token.type,
+           (int)token.size, token.text, file_label(context, token.file),
+           token.line, token.column, (unsigned long)before);
+  for (i = 0; cmp_diagnostic_get(context, i, &diagnostic); i++) {
+    if (diagnostic.kind == CMP_REPORT_RULE)
+      continue;
+    printf("  diagnostic %d at %s:%u:%u: %s\n", (int)diagnostic.kind,
+           file_label(context, diagnostic.file), diagnostic.line,
+           diagnostic.column, diagnostic.message);
+  }
+}
+
+static struct summary expected[2];
+
+static void *compile_rounds(void *unused) {
+  long mismatches = 0;
+  int round;
+  cmp_context *context = cmp_context_new(0, 0);
+  (void)unused;
+  if (context == NULL)
+    return (void *)-1L;
+  cmp_context_set_include_resolver(context, resolve, NULL);
+  for (round = 0; round < ROUNDS; round++) {
+    const char *source = SOURCES[round % 2];
+    int result = cmp_compile(context, source, strlen(source));
+    struct summary summary = summarize(context, result);
+    if (!same_summary(&summary, &expected[round % 2]))
+      mismatches++;
+  }
+  cmp_context_free(context);
+  return (void *)mismatches;
+}
+
+int main(void) {
+  pthread_t threads[THREADS];
+  long mismatches = 0;
+  int i, result;
+  cmp_context *context = cmp_context_new(0, 0);
+  if (context == NULL)
+    return 1;
+  cmp_context_set_include_resolver(context, resolve, NULL);
+  for (i = 0; i < 2; i++) {
+    result = cmp_compile(context, SOURCES[i], strlen(SOURCES[i]));
+    printf("%s source\n", i == 0 ? "Good" : "Bad");
+    print_results(context, result);
+    expected[i] = summarize(context, result);
+  }
+  printf("file 1 is \"%s\", file 9 is %s\n", cmp_file_name(context, 1),
+         cmp_file_name(context, 9) == NULL ? "unknown" : "known");
+  cmp_context_free(context);
+
+  for (i = 0; i < THREADS; i++)
+    pthread_create(&threads[i], NULL, compile_rounds, NULL);
+  for (i = 0; i < THREADS; i++) {
+    void *count;
+    pthread_join(threads[i], &count);
+    mismatches += (long)count;
+  }
+  printf("%d threads x %d compiles: %ld mismatches\n", THREADS, ROUNDS,
+         mismatches);
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#!/bin/sh
+# Runs the compiler on every case and compares what it prints with the
+# expected output checked in beside it.
+#
+#   tests/run_tests.sh COMPILER [--update]
+#
+# A case is a file tests/expected/NAME.out. Each line of NAME.args next to
+# it is one run of the compiler with those arguments; without that file the
+# case is a single run on tests/NAME.txt. The runs of a case share a scratch
+# directory holding a copy of every tests/*.txt, and their output, each
+# followed by its exit status, is compared as a whole. A run that links a
+# native executable called "prog" is followed by a run of it. Timings are
+# blanked so the output is stable, and if NAME.filter exists only the lines
+# matching one of its extended regular expressions are kept. A line of
+# NAME.args that starts with "!" is a shell command instead, run in the
+# scratch directory to change its files between runs, with the compiler's
+# path in $COMPILER for runs that outlive one line and this directory in
+# $TESTS for cases that build something of their own. With --update the
+# expected output is rewritten instead of compared.
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 COMPILER [--update]" >&2
+    exit 2
+fi
+case "$1" in
+/*) compiler="$1" ;;
+*) compiler="$(pwd)/$1" ;;
+esac
+update=false
+[ "$2" = "--update" ] && update=true
+
+tests="$(cd "$(dirname "$0")" && pwd)"
+scratch="$(mktemp -d)"
+trap 'rm -rf "$scratch"' EXIT
+
+# Timings differ from run to run; everything else must not.
+normalize() {
+    sed -e 's/ in [0-9.]* ms.*$/ in _ ms/' \
+        -e 's/^\(  [a-z][a-z0-9 +-]*[a-z0-9]\) *[0-9.]* ms/\1 _ ms/'
+}
+
+# Keeps what a case checks when the rest depends on the platform, such as
+# byte counts that follow the C++ library's string layout.
+select_lines() {
+    if [ -f "$1" ]; then
+        grep -E -f "$1"
+    else
+        cat
+    fi
+}
+
+run_case() {
+    name="$1"
+    args="$tests/expected/$name.args"
+    rm -rf "$scratch/case"
+    mkdir "$scratch/case"
+    for input in "$tests"/*.txt; do
+        base="$(basename "$input")"
+        cp "$input" "$scratch/case/$base"
+        # Includes are written Windows-style, relative to the working
+        # directory (".\tests\x.txt"). Elsewhere that names a file called
+        # tests\x.txt.
+        cp "$input" "$scratch/case/tests\\$base"
+    done
+    (
+        cd "$scratch/case" || exit 1
+        if [ -f "$args" ]; then
+            cat "$args"
+        else
+            echo "$name.txt"
+        fi | while IFS= read -r line; do
+            case "$line" in
+            !*)
+                printf '$ %s\n' "${line#!}"
+                COMPILER="$compiler" TESTS="$tests" sh -c "${line#!}" \
+                    < /dev/null 2>&1
+                continue
+                ;;
+            esac
+            printf '$ compiler %s\n' "$line"
+            # shellcheck disable=SC2086
+            "$compiler" $line < /dev/null 2>&1
+            echo "[exit $?]"
+            if [ -x prog ]; then
+                echo "\$ ./prog"
+                ./prog 2>&1
+                echo "[exit $?]"
+                rm -f prog
+            fi
+        done
+    ) | normalize | select_lines "$tests/expected/$name.filter"
+}
+
+failed=0
+total=0
+for expected in "$tests"/expected/*.out; do
+    name="$(basename "$expected" .out)"
+    total=$((total + 1))
+    if $update; then
+        run_case "$name" > "$expected"
+        continue
+    fi
+    run_case "$name" > "$scratch/actual"
+    if ! diff -u "$expected" "$scratch/actual" > "$scratch/diff"; then
+        echo "FAIL $name"
+        cat "$scratch/diff"
+        failed=$((failed + 1))
+    fi
+done
+if $update; then
+    echo "Updated $total cases"
+    exit 0
+fi
+echo "$((total - failed)) of $total cases passed"
+[ "$failed" -eq 0 ]
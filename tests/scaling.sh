@@ -0,0 +1,118 @@
+#!/bin/sh
+# Checks that the compiler's time and memory grow linearly with its input.
+#
+#   tests/scaling.sh COMPILER [N]
+#
+# Each shape of input is generated at size N and 2N: one file with N small
+# functions, and a main file that includes N/10 files of one function each
+# (file IDs are 16 bits, so N/10 keeps 2N within them).
+# A shape fails if the larger input takes more than MAX_TIME_RATIO times as
+# long as the smaller one (best of three runs, so a busy machine does not
+# fail it), or if its peak live allocation, as --stats reports it, grows by
+# more than MAX_PEAK_RATIO. Linear work doubles; quadratic work would
+# quadruple. The compiler must be built with -DCOMPILER_ALLOC_STATS.
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 COMPILER [N]" >&2
+    exit 2
+fi
+case "$1" in
+/*) compiler="$1" ;;
+*) compiler="$(pwd)/$1" ;;
+esac
+size="${2:-40000}"
+
+MAX_TIME_RATIO=3
+MAX_PEAK_RATIO=2.5
+
+scratch="$(mktemp -d)"
+trap 'rm -rf "$scratch"' EXIT
+
+# N functions in one file.
+generate_large() {
+    awk -v n="$1" 'BEGIN {
+        for (i = 0; i < n; i++)
+            printf "Imw f_%d(Imw n) {\n    Imw x;\n    x = n * 2 + %d;\n    Turnback x;\n}\n", i, i
+        print "Imw main() {\n    Turnback f_0(1);\n}"
+    }' > main.txt
+}
+
+# A main file with N/10 includes, each of a file holding one function.
+generate_includes() {
+    awk -v n="$(($1 / 10))" 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "include\".\\part_%d.txt\";\n", i
+            part = "part_" i ".txt"
+            printf "Imw g_%d(Imw n) {\n    Turnback n + %d;\n}\n", i, i > part
+            close(part)
+        }
+        print "Imw main() {\n    Turnback g_0(1);\n}"
+    }' > main.txt
+}
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+# Prints "MILLISECONDS PEAK_BYTES" for the input in the current directory.
+measure() {
+    best=
+    for run in 1 2 3; do
+        start=$(now_ms)
+        "$compiler" --stats main.txt < /dev/null > stats.txt 2>&1
+        status=$?
+        elapsed=$(($(now_ms) - start))
+        if [ $status -ne 0 ]; then
+            echo "compiler exited with $status" >&2
+            tail -5 stats.txt >&2
+            return 1
+        fi
+        if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then
+            best=$elapsed
+        fi
+    done
+    peak=$(awk '/^Phase/ { table = 1; next }
+                table && NF == 4 && $4 > peak { peak = $4 }
+                END { print peak + 0 }' stats.txt)
+    if [ "$peak" -eq 0 ]; then
+        echo "no allocation counts; build with -DCOMPILER_ALLOC_STATS" >&2
+        return 1
+    fi
+    echo "$best $peak"
+}
+
+failures=0
+for shape in large includes; do
+    results=
+    for n in "$size" $((size * 2)); do
+        rm -rf "$scratch/run"
+        mkdir "$scratch/run"
+        result=$(cd "$scratch/run" && "generate_$shape" "$n" && measure) ||
+            exit 1
+        results="$results $result"
+        case "$shape" in
+        large) label="$n functions" ;;
+        includes) label="$((n / 10)) included files" ;;
+        esac
+        echo "$label: ${result% *} ms, peak ${result#* } bytes"
+    done
+    # shellcheck disable=SC2086
+    verdict=$(echo $results | awk -v time="$MAX_TIME_RATIO" \
+        -v peak="$MAX_PEAK_RATIO" '{
+        # Sub-millisecond runs would make the ratio meaningless.
+        t = ($1 > 0 ? $3 / $1 : 1)
+        p = $4 / $2
+        printf "time x%.2f, peak x%.2f", t, p
+        if (t > time || p > peak) printf " FAIL"
+    }')
+    echo "$shape: $verdict"
+    case "$verdict" in
+    *FAIL) failures=$((failures + 1)) ;;
+    esac
+done
+
+if [ $failures -ne 0 ]; then
+    echo "$failures of 2 shapes grew faster than linearly"
+    exit 1
+fi
+echo "Both shapes grew linearly"